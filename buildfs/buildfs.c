@@ -0,0 +1,582 @@
+/* buildfs.c - Builds a filesystem image for the OS from a host directory
+ *
+ * Produces the same on-disk format as createfs (boot block, inodes, data
+ * blocks) so images stay readable by any filesystem.c, but chooses the
+ * layout itself:
+ *   - every file occupies one contiguous run of data blocks
+ *   - hot executables (-p) come first, then directories, then the other
+ *     executables, then everything else
+ *   - every directory's dentries are sorted by name
+ *   - optionally (-H) a name hash table for the root directory is stored in
+ *     an extra data block
+ *   - optionally (-z) every block is LZ4 compressed behind a block index,
+ *     which the kernel decompresses on demand into its block cache
+ * The sorted/hash properties are advertised in the boot block's reserved
+ * bytes, which older images leave zeroed.
+ *
+ * Subdirectories of the source directory become directory inodes whose data
+ * is an array of dentries holding "." and ".." along with the children,
+ * all sorted together so the kernel can bisect the whole array.
+ */
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BLOCK_SIZE 4096
+#define NAME_LEN 32
+#define ROOT_DENTRIES 63
+#define MAX_FILE_BLOCKS (BLOCK_SIZE / 4 - 1)
+#define DEFAULT_INODES 64
+#define MAX_NODES 1024
+
+// Must match student-distrib/filesystem.h
+#define FS_LAYOUT_MAGIC 0x53463933
+#define FS_FLAG_SORTED 0x1
+#define FS_FLAG_HASH 0x2
+#define FS_HASH_SLOTS 256
+#define FSZ_MAGIC 0x315A5346
+
+// Compressed block sizes at or above this are stored uncompressed, so hot
+// blocks that barely compress are served without decompression
+#define FSZ_RAW_THRESHOLD (BLOCK_SIZE - BLOCK_SIZE / 8)
+
+#define TYPE_RTC 0
+#define TYPE_DIR 1
+#define TYPE_FILE 2
+
+// Layout classes, placed in this order
+#define CLASS_HOT 0
+#define CLASS_DIR 1
+#define CLASS_EXE 2
+#define CLASS_DATA 3
+
+typedef struct dentry {
+    char name[NAME_LEN];
+    int32_t type;
+    int32_t inode;
+    uint8_t reserved[24];
+} dentry_t;
+
+typedef struct boot_block {
+    uint32_t num_dentries;
+    uint32_t num_inodes;
+    uint32_t num_data_blocks;
+    uint32_t layout_magic;
+    uint32_t layout_flags;
+    uint32_t hash_block;
+    uint8_t reserved[40];
+    dentry_t dentries[ROOT_DENTRIES];
+} boot_block_t;
+
+typedef struct fsz_header {
+    uint32_t magic;
+    uint32_t num_blocks;
+    uint32_t reserved[2];
+} fsz_header_t;
+
+typedef struct fsz_block {
+    uint32_t offset;
+    uint32_t length;
+} fsz_block_t;
+
+typedef struct node {
+    char name[NAME_LEN + 1];
+    char path[4096];
+    int32_t type;
+    int32_t class;
+    int32_t hot_rank;
+    int32_t parent;         // node index of the parent directory, -1 for root
+    int32_t inode;
+    uint32_t length;
+    uint32_t first_block;
+    uint32_t num_blocks;
+    int32_t children[MAX_NODES];
+    int32_t num_children;
+} node_t;
+
+static node_t* nodes;
+static int32_t num_nodes;
+static char** hot_names;
+static int32_t num_hot;
+
+/* uint32_t name_hash(const char* name, uint32_t len)
+ * Description: FNV-1a hash of a file name, must match filesystem.c
+ * Input: name - name to hash
+ *        len - length of name
+ * Output: the hash
+ * Side Effects: none
+ */
+static uint32_t name_hash(const char* name, uint32_t len) {
+    uint32_t hash = 2166136261u;
+    uint32_t i;
+    for (i = 0; i < len; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* uint32_t name_len(const char* name)
+ * Description: length of a possibly unterminated 32 byte dentry name
+ */
+static uint32_t name_len(const char* name) {
+    uint32_t len = 0;
+    while (len < NAME_LEN && name[len] != '\0') len++;
+    return len;
+}
+
+/* uint32_t lz4_emit_length(uint8_t* dst, uint32_t op, uint32_t cap, uint32_t len)
+ * Description: writes the 255 byte continuation of an LZ4 length of 15 or more
+ * Output: new output position, cap + 1 if it does not fit
+ */
+static uint32_t lz4_emit_length(uint8_t* dst, uint32_t op, uint32_t cap, uint32_t len) {
+    if (len < 15) {
+        return op;
+    }
+    len -= 15;
+    while (len >= 255) {
+        if (op >= cap) return cap + 1;
+        dst[op++] = 255;
+        len -= 255;
+    }
+    if (op >= cap) return cap + 1;
+    dst[op++] = len;
+    return op;
+}
+
+/* uint32_t lz4_compress(const uint8_t* src, uint32_t n, uint8_t* dst, uint32_t cap)
+ * Description: greedy LZ4 block compressor (no frame header)
+ * Input: src - data to compress
+ *        n - size of src
+ *        dst - output buffer
+ *        cap - size of dst
+ * Output: compressed size, 0 if it does not fit in cap
+ */
+static uint32_t lz4_compress(const uint8_t* src, uint32_t n, uint8_t* dst, uint32_t cap) {
+    int32_t table[4096];
+    uint32_t ip = 0, anchor = 0, op = 0;
+    // The format requires the last match to start 12 bytes before the end
+    // and the last 5 bytes to be literals
+    uint32_t match_limit = n > 12 ? n - 12 : 0;
+
+    memset(table, -1, sizeof(table));
+    while (ip < match_limit) {
+        uint32_t seq, ref_seq;
+        memcpy(&seq, src + ip, 4);
+        uint32_t h = (seq * 2654435761u) >> 20;
+        int32_t ref = table[h];
+        table[h] = ip;
+        if (ref < 0 || ip - ref > 65535) {
+            ip++;
+            continue;
+        }
+        memcpy(&ref_seq, src + ref, 4);
+        if (ref_seq != seq) {
+            ip++;
+            continue;
+        }
+
+        uint32_t match = 4;
+        while (ip + match < n - 5 && src[ref + match] == src[ip + match]) match++;
+
+        uint32_t literals = ip - anchor;
+        if (op >= cap) return 0;
+        uint32_t token = op++;
+        dst[token] = ((literals < 15 ? literals : 15) << 4) | (match - 4 < 15 ? match - 4 : 15);
+        op = lz4_emit_length(dst, op, cap, literals);
+        if (op > cap || cap - op < literals + 2) return 0;
+        memcpy(dst + op, src + anchor, literals);
+        op += literals;
+        dst[op++] = (ip - ref) & 0xFF;
+        dst[op++] = (ip - ref) >> 8;
+        op = lz4_emit_length(dst, op, cap, match - 4);
+        if (op > cap) return 0;
+
+        ip += match;
+        anchor = ip;
+    }
+
+    uint32_t literals = n - anchor;
+    if (op >= cap) return 0;
+    dst[op++] = (literals < 15 ? literals : 15) << 4;
+    op = lz4_emit_length(dst, op, cap, literals);
+    if (op > cap || cap - op < literals) return 0;
+    memcpy(dst + op, src + anchor, literals);
+    return op + literals;
+}
+
+/* uint32_t write_compressed(FILE* f, const uint8_t* image, uint32_t num_blocks)
+ * Description: writes image as a block index followed by LZ4 compressed
+ *              blocks. All-zero blocks take no space and blocks that do not
+ *              compress well are stored as is.
+ * Output: size of the written file, 0 on error
+ */
+static uint32_t write_compressed(FILE* f, const uint8_t* image, uint32_t num_blocks) {
+    fsz_header_t header = { FSZ_MAGIC, num_blocks, { 0, 0 } };
+    fsz_block_t* index = calloc(num_blocks, sizeof(fsz_block_t));
+    uint8_t* payload = malloc((size_t)num_blocks * BLOCK_SIZE);
+    uint8_t zero[BLOCK_SIZE] = { 0 };
+    uint32_t payload_len = 0;
+    uint32_t base = sizeof(header) + num_blocks * sizeof(fsz_block_t);
+    uint32_t i;
+
+    for (i = 0; i < num_blocks; i++) {
+        const uint8_t* block = image + (size_t)i * BLOCK_SIZE;
+        if (!memcmp(block, zero, BLOCK_SIZE)) {
+            index[i].offset = 0;
+            index[i].length = 0;
+            continue;
+        }
+        uint32_t len = lz4_compress(block, BLOCK_SIZE, payload + payload_len, FSZ_RAW_THRESHOLD);
+        if (len == 0) {
+            // Keep uncompressed blocks 4 byte aligned for the kernel
+            payload_len = (payload_len + 3) & ~3;
+            memcpy(payload + payload_len, block, BLOCK_SIZE);
+            len = BLOCK_SIZE;
+        }
+        index[i].offset = base + payload_len;
+        index[i].length = len;
+        payload_len += len;
+    }
+
+    if (fwrite(&header, sizeof(header), 1, f) != 1 ||
+        fwrite(index, sizeof(fsz_block_t), num_blocks, f) != num_blocks ||
+        fwrite(payload, 1, payload_len, f) != payload_len) {
+        return 0;
+    }
+    free(index);
+    free(payload);
+    return base + payload_len;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "usage: %s -i <source dir> -o <image> [-p hot,files] [-n inodes] [-H] [-z]\n"
+            "  -p  comma separated executables to place first (default: shell)\n"
+            "  -n  number of inodes in the image (default: %d)\n"
+            "  -H  embed a name hash table for the root directory\n"
+            "  -z  write a compressed image\n",
+            prog, DEFAULT_INODES);
+    exit(1);
+}
+
+/* int32_t is_executable(const char* path)
+ * Description: checks for the ELF magic number the loader looks for
+ */
+static int32_t is_executable(const char* path) {
+    unsigned char magic[4];
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        return 0;
+    }
+    size_t n = fread(magic, 1, 4, f);
+    fclose(f);
+    return n == 4 && magic[0] == 0x7f && magic[1] == 'E' && magic[2] == 'L' && magic[3] == 'F';
+}
+
+static int32_t new_node(const char* name, int32_t type, int32_t parent) {
+    if (num_nodes >= MAX_NODES) {
+        fprintf(stderr, "buildfs: too many files\n");
+        exit(1);
+    }
+    node_t* n = &nodes[num_nodes];
+    memset(n, 0, sizeof(node_t));
+    strncpy(n->name, name, NAME_LEN);
+    n->type = type;
+    n->parent = parent;
+    n->hot_rank = num_hot;
+    n->inode = -1;
+    if (parent >= 0) {
+        nodes[parent].children[nodes[parent].num_children++] = num_nodes;
+    }
+    return num_nodes++;
+}
+
+/* void scan_dir(int32_t dir)
+ * Description: adds a node for every entry in the host directory nodes[dir].path
+ */
+static void scan_dir(int32_t dir) {
+    DIR* d = opendir(nodes[dir].path);
+    struct dirent* ent;
+    struct stat st;
+    int32_t i;
+
+    if (d == NULL) {
+        perror(nodes[dir].path);
+        exit(1);
+    }
+    while ((ent = readdir(d)) != NULL) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+        if (strlen(ent->d_name) > NAME_LEN) {
+            fprintf(stderr, "buildfs: warning: truncating %s to %d characters\n", ent->d_name, NAME_LEN);
+        }
+        for (i = 0; i < nodes[dir].num_children; i++) {
+            if (!strncmp(nodes[nodes[dir].children[i]].name, ent->d_name, NAME_LEN)) {
+                fprintf(stderr, "buildfs: %s collides with another name after truncation\n", ent->d_name);
+                exit(1);
+            }
+        }
+
+        char path[sizeof(nodes[0].path)];
+        if (snprintf(path, sizeof(path), "%s/%s", nodes[dir].path, ent->d_name) >= (int)sizeof(path) ||
+            stat(path, &st) != 0) {
+            perror(path);
+            exit(1);
+        }
+
+        if (S_ISDIR(st.st_mode)) {
+            int32_t n = new_node(ent->d_name, TYPE_DIR, dir);
+            strcpy(nodes[n].path, path);
+            nodes[n].class = CLASS_DIR;
+            scan_dir(n);
+        } else if (S_ISREG(st.st_mode)) {
+            int32_t n = new_node(ent->d_name, TYPE_FILE, dir);
+            strcpy(nodes[n].path, path);
+            nodes[n].length = st.st_size;
+            nodes[n].class = is_executable(path) ? CLASS_EXE : CLASS_DATA;
+            for (i = 0; i < num_hot; i++) {
+                if (dir == 0 && !strcmp(hot_names[i], nodes[n].name)) {
+                    nodes[n].class = CLASS_HOT;
+                    nodes[n].hot_rank = i;
+                }
+            }
+            if ((nodes[n].length + BLOCK_SIZE - 1) / BLOCK_SIZE > MAX_FILE_BLOCKS) {
+                fprintf(stderr, "buildfs: %s is too large\n", path);
+                exit(1);
+            }
+        }
+    }
+    closedir(d);
+}
+
+static int compare_names(const void* a, const void* b) {
+    return memcmp(nodes[*(const int32_t*)a].name, nodes[*(const int32_t*)b].name, NAME_LEN);
+}
+
+static int compare_dentries(const void* a, const void* b) {
+    return memcmp(((const dentry_t*)a)->name, ((const dentry_t*)b)->name, NAME_LEN);
+}
+
+static int compare_layout(const void* a, const void* b) {
+    const node_t* x = &nodes[*(const int32_t*)a];
+    const node_t* y = &nodes[*(const int32_t*)b];
+    if (x->class != y->class) return x->class - y->class;
+    if (x->hot_rank != y->hot_rank) return x->hot_rank - y->hot_rank;
+    return strcmp(x->path, y->path);
+}
+
+static void put_dentry(dentry_t* d, const char* name, int32_t type, int32_t inode) {
+    memset(d, 0, sizeof(dentry_t));
+    memcpy(d->name, name, name_len(name));
+    d->type = type;
+    d->inode = inode;
+}
+
+int main(int argc, char** argv) {
+    const char* src = NULL;
+    const char* out = NULL;
+    char* hot = NULL;
+    uint32_t num_inodes = DEFAULT_INODES;
+    int32_t want_hash = 0;
+    int32_t want_compress = 0;
+    int32_t opt, i, j;
+
+    while ((opt = getopt(argc, argv, "i:o:p:n:Hz")) != -1) {
+        switch (opt) {
+        case 'i': src = optarg; break;
+        case 'o': out = optarg; break;
+        case 'p': hot = optarg; break;
+        case 'n': num_inodes = strtoul(optarg, NULL, 0); break;
+        case 'H': want_hash = 1; break;
+        case 'z': want_compress = 1; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (src == NULL || out == NULL || num_inodes == 0) {
+        usage(argv[0]);
+    }
+
+    hot = strdup(hot != NULL ? hot : "shell");
+    hot_names = calloc(strlen(hot) + 1, sizeof(char*));
+    for (char* tok = strtok(hot, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        hot_names[num_hot++] = tok;
+    }
+
+    nodes = calloc(MAX_NODES, sizeof(node_t));
+    int32_t root = new_node(".", TYPE_DIR, -1);
+    strncpy(nodes[root].path, src, sizeof(nodes[root].path) - 1);
+    new_node("rtc", TYPE_RTC, root);
+    scan_dir(root);
+
+    if (nodes[root].num_children + 1 > ROOT_DENTRIES) {
+        fprintf(stderr, "buildfs: the root directory holds at most %d entries\n", ROOT_DENTRIES - 1);
+        exit(1);
+    }
+
+    // Directory sizes are known once every child exists
+    for (i = 0; i < num_nodes; i++) {
+        qsort(nodes[i].children, nodes[i].num_children, sizeof(int32_t), compare_names);
+        if (nodes[i].type == TYPE_DIR && i != root) {
+            nodes[i].length = (nodes[i].num_children + 2) * sizeof(dentry_t);
+        }
+    }
+
+    // Order every inode-backed node by layout class and hand out inodes and
+    // data blocks in that order. Inode 0 stays reserved for the root.
+    int32_t* order = calloc((uint32_t)num_nodes, sizeof(int32_t));
+    int32_t num_order = 0;
+    for (i = 0; i < num_nodes; i++) {
+        if (i != root && nodes[i].type != TYPE_RTC) {
+            order[num_order++] = i;
+        }
+    }
+    qsort(order, num_order, sizeof(int32_t), compare_layout);
+
+    if ((uint32_t)num_order + 1 > num_inodes) {
+        fprintf(stderr, "buildfs: %d files need more than %u inodes\n", num_order, num_inodes);
+        exit(1);
+    }
+
+    uint32_t num_blocks = 0;
+    uint64_t file_bytes = 0;
+    for (i = 0; i < num_order; i++) {
+        node_t* n = &nodes[order[i]];
+        n->inode = i + 1;
+        n->first_block = num_blocks;
+        n->num_blocks = (n->length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        num_blocks += n->num_blocks;
+        file_bytes += n->length;
+    }
+    nodes[root].inode = 0;
+    for (i = 0; i < num_nodes; i++) {
+        if (nodes[i].type == TYPE_RTC) nodes[i].inode = 0;
+    }
+
+    uint32_t hash_block = 0;
+    if (want_hash) {
+        hash_block = num_blocks++;
+    }
+
+    uint32_t image_blocks = 1 + num_inodes + num_blocks;
+    uint8_t* image = calloc(image_blocks, BLOCK_SIZE);
+    boot_block_t* boot = (boot_block_t*)image;
+    uint8_t* inodes = image + BLOCK_SIZE;
+    uint8_t* data = image + (1 + num_inodes) * BLOCK_SIZE;
+
+    // Root dentries, sorted along with "." for the root itself
+    boot->num_inodes = num_inodes;
+    boot->num_data_blocks = num_blocks;
+    boot->layout_magic = FS_LAYOUT_MAGIC;
+    boot->layout_flags = FS_FLAG_SORTED;
+    int32_t* root_list = calloc(nodes[root].num_children + 1, sizeof(int32_t));
+    root_list[0] = root;
+    memcpy(root_list + 1, nodes[root].children, nodes[root].num_children * sizeof(int32_t));
+    boot->num_dentries = nodes[root].num_children + 1;
+    qsort(root_list, boot->num_dentries, sizeof(int32_t), compare_names);
+    for (i = 0; i < (int32_t)boot->num_dentries; i++) {
+        node_t* n = &nodes[root_list[i]];
+        put_dentry(&boot->dentries[i], n->name, n->type, n->inode);
+    }
+
+    // Inodes and their contiguous data
+    for (i = 0; i < num_order; i++) {
+        node_t* n = &nodes[order[i]];
+        uint32_t* inode = (uint32_t*)(inodes + n->inode * BLOCK_SIZE);
+        uint8_t* dst = data + n->first_block * BLOCK_SIZE;
+        inode[0] = n->length;
+        for (j = 0; j < (int32_t)n->num_blocks; j++) {
+            inode[j + 1] = n->first_block + j;
+        }
+
+        if (n->type == TYPE_DIR) {
+            dentry_t* d = (dentry_t*)dst;
+            put_dentry(&d[0], ".", TYPE_DIR, n->inode);
+            put_dentry(&d[1], "..", TYPE_DIR, nodes[n->parent].inode);
+            for (j = 0; j < n->num_children; j++) {
+                node_t* c = &nodes[n->children[j]];
+                put_dentry(&d[j + 2], c->name, c->type, c->inode);
+            }
+            // Names below '.' (' ', '#', '+', '-', ...) go ahead of "."
+            qsort(d, n->num_children + 2, sizeof(dentry_t), compare_dentries);
+        } else {
+            FILE* f = fopen(n->path, "rb");
+            if (f == NULL || fread(dst, 1, n->length, f) != n->length) {
+                perror(n->path);
+                exit(1);
+            }
+            fclose(f);
+        }
+    }
+
+    // Open addressed root name table, slot = dentry index + 1
+    uint32_t longest_probe = 0;
+    if (want_hash) {
+        uint8_t* slots = data + hash_block * BLOCK_SIZE;
+        boot->layout_flags |= FS_FLAG_HASH;
+        boot->hash_block = hash_block;
+        for (i = 0; i < (int32_t)boot->num_dentries; i++) {
+            const char* name = boot->dentries[i].name;
+            uint32_t slot = name_hash(name, name_len(name)) % FS_HASH_SLOTS;
+            uint32_t probe = 1;
+            while (slots[slot] != 0) {
+                slot = (slot + 1) % FS_HASH_SLOTS;
+                probe++;
+            }
+            slots[slot] = i + 1;
+            if (probe > longest_probe) longest_probe = probe;
+        }
+    }
+
+    FILE* f = fopen(out, "wb");
+    uint32_t written = 0;
+    if (f != NULL) {
+        if (want_compress) {
+            written = write_compressed(f, image, image_blocks);
+        } else if (fwrite(image, BLOCK_SIZE, image_blocks, f) == image_blocks) {
+            written = image_blocks * BLOCK_SIZE;
+        }
+    }
+    if (written == 0) {
+        perror(out);
+        exit(1);
+    }
+    fclose(f);
+
+    // Statistics
+    uint32_t files = 0, dirs = 0, exes = 0;
+    for (i = 0; i < num_order; i++) {
+        node_t* n = &nodes[order[i]];
+        if (n->type == TYPE_DIR) dirs++;
+        else files++;
+        if (n->class == CLASS_HOT || n->class == CLASS_EXE) exes++;
+    }
+    uint64_t data_bytes = (uint64_t)(num_blocks - (want_hash ? 1 : 0)) * BLOCK_SIZE;
+    printf("%s: %u blocks (%u bytes)\n", out, image_blocks, image_blocks * BLOCK_SIZE);
+    printf("  entries:  %u root dentries, %u files (%u executable), %u subdirectories\n",
+           boot->num_dentries, files, exes, dirs);
+    printf("  inodes:   %u of %u used\n", num_order + 1, num_inodes);
+    printf("  data:     %u blocks, %llu bytes used, %llu bytes slack (%.1f%%)\n",
+           num_blocks, (unsigned long long)file_bytes, (unsigned long long)(data_bytes - file_bytes),
+           data_bytes ? 100.0 * (data_bytes - file_bytes) / data_bytes : 0.0);
+    printf("  layout:   contiguous, sorted dentries, hot:");
+    for (i = 0; i < num_order && nodes[order[i]].class == CLASS_HOT; i++) {
+        printf(" %s@%u", nodes[order[i]].name, nodes[order[i]].first_block);
+    }
+    printf("\n");
+    if (want_compress) {
+        printf("  compressed: %u bytes (%.1f%% of %u)\n", written,
+               100.0 * written / (image_blocks * BLOCK_SIZE), image_blocks * BLOCK_SIZE);
+    }
+    if (want_hash) {
+        printf("  hash:     block %u, %u names in %d slots, longest probe %u\n",
+               hash_block, boot->num_dentries, FS_HASH_SLOTS, longest_probe);
+    }
+    return 0;
+}
@@ -3,6 +3,17 @@
 
 #include <stdint.h>
 
+/* One file for poll, with the events wanted and the events that happened. */
+typedef struct pollfd {
+    int32_t fd;
+    uint16_t events;
+    uint16_t revents;
+} pollfd_t;
+
+#define POLLIN 0x1
+#define POLLOUT 0x4
+#define POLLNVAL 0x20
+
 /* All calls return >= 0 on success or -1 on failure. */
 
 /*
@@ -28,6 +39,14 @@ extern int32_t thread_join(uint32_t tid);
 extern int32_t stat(int32_t fd, void *buf, int32_t nbytes);
 extern int32_t time();
 extern int32_t loadkeys();
+extern int32_t ioctl(int32_t fd, uint32_t request, uint32_t arg);
+extern int32_t poll(pollfd_t *fds, uint32_t nfds, int32_t timeout);
+
+/* Requests every file accepts through ioctl. */
+#define IOCTL_GETFL 1
+#define IOCTL_SETFL 2
+/* Throws away the keys waiting on /dev/kbd. */
+#define KBD_FLUSH 0x100
 
 enum signums {
     DIV_ZERO = 0,
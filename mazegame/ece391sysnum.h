@@ -18,5 +18,7 @@
 #define SYS_STAT 15
 #define SYS_TIME 16
 #define SYS_LOADKEYS 17
+#define SYS_IOCTL 19
+#define SYS_POLL 20
 
 #endif /* ECE391SYSNUM_H */
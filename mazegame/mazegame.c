@@ -15,6 +15,7 @@
 #define DOWN 162
 #define RIGHT 163
 #define LEFT 161
+#define KEY_BATCH 16 /* keys handled per read of /dev/kbd */
 #define STATUS_STR_LENGTH 26
 
 static unsigned char palette_colors[MAX_LEVEL][3] = {
@@ -67,6 +68,7 @@ volatile int next_dir;
 int play_x, play_y, last_dir, dir;
 int move_cnt = 0;
 int fd;
+int kbd_fd;
 unsigned long data;
 uint8_t counter = 0;
 static void set_player_color(int init){
@@ -346,14 +348,88 @@ static int badcount = 0;
 static int total = 0;
 
 /*
- * rtc_thread
- *   DESCRIPTION: Thread that handles updating the screen
+ * handle_keys
+ *   DESCRIPTION: Reads the keys that are waiting and updates the direction
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: sets next_dir, sets quit_flag on '`'
+ */
+static void handle_keys()
+{
+    int16_t keys[KEY_BATCH];
+    int32_t i, n;
+
+    n = read(kbd_fd, keys, sizeof(keys)) / (int32_t)sizeof(int16_t);
+
+    for (i = 0; i < n; i++)
+    {
+        // Check for '`' to quit
+        if (keys[i] == BACKQUOTE)
+        {
+            quit_flag = 1;
+            break;
+        }
+
+        switch(keys[i])
+        {
+        case UP:
+            next_dir = DIR_UP;
+            break;
+        case DOWN:
+            next_dir = DIR_DOWN;
+            break;
+        case RIGHT:
+            next_dir = DIR_RIGHT;
+            break;
+        case LEFT:
+            next_dir = DIR_LEFT;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+/*
+ * wait_for_tick
+ *   DESCRIPTION: Sleeps until the next periodic interrupt, handling any keys
+ *                that arrive in the meantime
+ *   INPUTS: none
+ *   OUTPUTS: data - number of interrupts since the last tick
+ *   RETURN VALUE: result of the rtc read
+ *   SIDE EFFECTS: see handle_keys
+ */
+static int wait_for_tick()
+{
+    pollfd_t fds[2];
+
+    fds[0].fd = fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = kbd_fd;
+    fds[1].events = POLLIN;
+
+    while (quit_flag == 0 && poll(fds, 2, -1) > 0)
+    {
+        if (fds[1].revents & POLLIN)
+            handle_keys();
+        if (fds[0].revents & POLLIN)
+            break;
+    }
+
+    return read(fd, &data, sizeof(unsigned long));
+}
+
+/*
+ * game_loop
+ *   DESCRIPTION: Plays the levels, updating the screen on every tick and
+ *                handling keys in between
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: none
  */
-static void rtc_thread() {
+static void game_loop() {
     int ticks = 0;
     int level;
     int ret;
@@ -401,13 +477,13 @@ static void rtc_thread() {
         game_info.last_fruit = 0;
         // get first Periodic Interrupt
 
-        ret = read(fd, &data, sizeof(unsigned long));
+        ret = wait_for_tick();
 
 
         while ((quit_flag == 0) && (goto_next_level == 0))
         {
             // Wait for Periodic Interrupt
-            ret = read(fd, &data, sizeof(unsigned long));
+            ret = wait_for_tick();
 
             // Update tick to keep track of time.  If we missed some
             // interrupts we want to update the player multiple times so
@@ -537,57 +613,6 @@ static void rtc_thread() {
     return;
 }
 
-/*
- * keyboard_thread
- *   DESCRIPTION: Thread that handles keyboard inputs
- *   INPUTS: none
- *   OUTPUTS: none
- *   RETURN VALUE: none
- *   SIDE EFFECTS: none
- */
-static void keyboard_thread()
-{
-    int kbd_fd = open((uint8_t*)"/dev/kbd");
-    int16_t key;
-    // Break only on win or quit input - '`'
-    while (winner == 0 && quit_flag == 0)
-    {
-        // Get Keyboard Input
-        read(kbd_fd, &key, 2);
-
-        // Check for '`' to quit
-        if (key == BACKQUOTE)
-        {
-            quit_flag = 1;
-            break;
-        }
-        else
-        {
-            switch(key)
-            {
-            case UP:
-                next_dir = DIR_UP;
-                break;
-            case DOWN:
-                next_dir = DIR_DOWN;
-                break;
-            case RIGHT:
-                next_dir = DIR_RIGHT;
-                break;
-            case LEFT:
-                next_dir = DIR_LEFT;
-                break;
-            default:
-                break;
-            }
-        }
-    }
-
-    close(kbd_fd);
-
-    return;
-}
-
 void exit(int signum) {
     quit_flag = 1;
 }
@@ -603,13 +628,13 @@ int main() {
     int x = 128;
     write(fd, &x, 4);
 
-    uint32_t tid1;
-    thread_create(&tid1, rtc_thread);
-    uint32_t tid2;
-    thread_create(&tid2, keyboard_thread);
+    kbd_fd = open((uint8_t*)"/dev/kbd");
+    // Drop keys typed before the game started
+    ioctl(kbd_fd, KBD_FLUSH, 0);
+
+    game_loop();
 
-    thread_join(tid1);
-    thread_join(tid2);
+    close(kbd_fd);
 
     clear_mode_X();
 
@@ -0,0 +1,162 @@
+/* apic.c - Local APIC and IOAPIC interrupt routing
+ *
+ * Used in place of the PICs when the CPU has a local APIC and an IOAPIC
+ * answers at IOAPIC_BASE. There is no ACPI or MP table parsing, so the
+ * ISA lines are routed the way every PC chipset wires them.
+ */
+
+#include "apic.h"
+#include "lib.h"
+#include "idt.h"
+#include "page.h"
+
+bool apic_active = false;
+
+volatile uint32_t* lapic_regs;
+
+static volatile uint32_t* ioapic_regs = (volatile uint32_t*)IOAPIC_BASE;
+
+// Local APIC of the one CPU, which every line is sent to
+static uint32_t lapic_id;
+
+// Bit n set if ISA line n is level triggered
+static uint32_t irq_level;
+
+#define NO_PIN 0xFF
+
+// IOAPIC pin of each ISA line. The PIT is moved to pin 2, and the cascade
+// line has no pin since there is no second PIC behind it.
+static const uint8_t irq_pins[NR_IRQS] = {
+    2, 1, NO_PIN, 3, 4, 5, 6, 7,
+    8, 9, 10, 11, 12, 13, 14, 15
+};
+
+// Vector of each line. The local APIC takes the highest pending vector
+// first and holds back lower priority classes (vector >> 4) while one is
+// in service, so the timer goes first, then the keyboard, then the RTC,
+// then everything else. All stay clear of the exceptions, the PIC's old
+// vectors and the system call.
+static const uint8_t irq_vectors[NR_IRQS] = {
+    0xE0, 0xD0, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57,
+    0xC0, 0x59, 0x5A, 0x5B, 0x5C, 0x5D, 0x5E, 0x5F
+};
+
+/* uint32_t ioapic_read(uint32_t reg)
+ * Description: Reads an IOAPIC register
+ * Input:  reg - register index
+ * Output: its value
+ * Side Effects: writes to IOREGSEL
+ */
+static uint32_t ioapic_read(uint32_t reg) {
+    ioapic_regs[IOAPIC_REGSEL / 4] = reg;
+    return ioapic_regs[IOAPIC_WIN / 4];
+}
+
+/* void ioapic_write(uint32_t reg, uint32_t value)
+ * Description: Writes an IOAPIC register
+ * Input:  reg - register index
+ *         value - value to write
+ * Output: none
+ * Side Effects: writes to IOREGSEL and the register
+ */
+static void ioapic_write(uint32_t reg, uint32_t value) {
+    ioapic_regs[IOAPIC_REGSEL / 4] = reg;
+    ioapic_regs[IOAPIC_WIN / 4] = value;
+}
+
+/* int32_t apic_init()
+ * Description: Switches interrupt delivery to the APIC. Every IOAPIC pin
+ *              starts masked, enable_irq unmasks them.
+ * Input:  none
+ * Output: 0 if the APIC is now in use, -1 if the PICs have to stay
+ * Side Effects: writes to the local APIC and the IOAPIC
+ */
+int32_t apic_init() {
+    uint32_t eax, ebx, ecx, edx;
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+    if (!(edx & CPUID_APIC)) {
+        return -1;
+    }
+
+    uint32_t lo, hi;
+    asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(IA32_APIC_BASE_MSR));
+    uint32_t base = lo & ~(KB4 - 1);
+    // Only the 4MB at APIC_MMIO_BASE is mapped
+    if (base < APIC_MMIO_BASE || base >= APIC_MMIO_BASE + MB4) {
+        return -1;
+    }
+
+    uint32_t ver = ioapic_read(IOAPIC_VER);
+    uint32_t max_pin = (ver >> 16) & 0xFF;
+    if (ver == 0xFFFFFFFF || max_pin < NR_IRQS - 1) {
+        return -1;
+    }
+
+    if (!(lo & APIC_BASE_ENABLE)) {
+        lo |= APIC_BASE_ENABLE;
+        asm volatile("wrmsr" : : "a"(lo), "d"(hi), "c"(IA32_APIC_BASE_MSR));
+    }
+    lapic_regs = (volatile uint32_t*)base;
+    lapic_id = lapic_regs[LAPIC_ID / 4] >> 24;
+
+    // The PIT, keyboard, cascade and RTC are always edge triggered. Level
+    // lines are taken as active high, which is how QEMU reports them.
+    irq_level = (inb(ELCR_PORT) | (inb(ELCR_PORT + 1) << 8)) & ~0x0107;
+
+    uint32_t pin;
+    for (pin = 0; pin <= max_pin; pin++) {
+        ioapic_write(IOAPIC_REDTBL(pin), IOAPIC_MASKED);
+        ioapic_write(IOAPIC_REDTBL(pin) + 1, 0);
+    }
+
+    lapic_regs[LAPIC_TPR / 4] = 0;
+    lapic_regs[LAPIC_SVR / 4] = LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR;
+
+    apic_active = true;
+    return 0;
+}
+
+/* uint32_t apic_vector(uint32_t irq)
+ * Description: Gives the vector an ISA line is delivered on
+ * Input:  irq - ISA line
+ * Output: its vector
+ * Side Effects: none
+ */
+uint32_t apic_vector(uint32_t irq) {
+    return irq_vectors[irq];
+}
+
+/* void apic_enable_irq(uint32_t irq)
+ * Description: Routes an ISA line to this CPU and unmasks it
+ * Input:  irq - ISA line
+ * Output: none
+ * Side Effects: writes to the IOAPIC
+ */
+void apic_enable_irq(uint32_t irq) {
+    uint32_t flags;
+    if (irq >= NR_IRQS || irq_pins[irq] == NO_PIN) {
+        return;
+    }
+
+    cli_and_save(flags);
+    ioapic_write(IOAPIC_REDTBL(irq_pins[irq]) + 1, lapic_id << 24);
+    ioapic_write(IOAPIC_REDTBL(irq_pins[irq]), irq_vectors[irq] | ((irq_level & (1 << irq)) ? IOAPIC_LEVEL : 0));
+    restore_flags(flags);
+}
+
+/* void apic_disable_irq(uint32_t irq)
+ * Description: Masks an ISA line
+ * Input:  irq - ISA line
+ * Output: none
+ * Side Effects: writes to the IOAPIC
+ */
+void apic_disable_irq(uint32_t irq) {
+    uint32_t flags;
+    if (irq >= NR_IRQS || irq_pins[irq] == NO_PIN) {
+        return;
+    }
+
+    cli_and_save(flags);
+    ioapic_write(IOAPIC_REDTBL(irq_pins[irq]), ioapic_read(IOAPIC_REDTBL(irq_pins[irq])) | IOAPIC_MASKED);
+    restore_flags(flags);
+}
@@ -0,0 +1,71 @@
+/* apic.h - Local APIC and IOAPIC interrupt routing
+ */
+
+#ifndef APIC_H
+#define APIC_H
+
+#include "types.h"
+
+// The IOAPIC and the local APIC both sit in this 4MB region, which every
+// page directory maps uncached for the kernel
+#define APIC_MMIO_BASE 0xFEC00000
+#define APIC_MMIO_PDE (APIC_MMIO_BASE >> 22)
+
+// Where the chipset puts the first IOAPIC
+#define IOAPIC_BASE 0xFEC00000
+#define IOAPIC_REGSEL 0x00
+#define IOAPIC_WIN 0x10
+#define IOAPIC_VER 0x01
+// Two registers per pin, the low one holds the vector and flags
+#define IOAPIC_REDTBL(pin) (0x10 + 2 * (pin))
+#define IOAPIC_LEVEL (1 << 15)
+#define IOAPIC_MASKED (1 << 16)
+
+// Local APIC registers, as byte offsets from its base
+#define LAPIC_ID 0x20
+#define LAPIC_TPR 0x80
+#define LAPIC_EOI 0xB0
+#define LAPIC_SVR 0xF0
+#define LAPIC_SVR_ENABLE 0x100
+
+// Delivered when an interrupt goes away before the CPU takes it. Needs
+// no EOI.
+#define APIC_SPURIOUS_VECTOR 0xFF
+
+#define IA32_APIC_BASE_MSR 0x1B
+#define APIC_BASE_ENABLE (1 << 11)
+// CPUID leaf 1, EDX
+#define CPUID_APIC (1 << 9)
+
+// Edge/level control registers, where the BIOS marks the lines PCI
+// devices share as level triggered
+#define ELCR_PORT 0x4D0
+
+// Set once the APIC has taken over from the PICs
+extern bool apic_active;
+
+extern volatile uint32_t* lapic_regs;
+
+// Switches interrupt delivery to the APIC if there is one
+extern int32_t apic_init();
+
+// Vector an ISA line is delivered on while the APIC is active
+extern uint32_t apic_vector(uint32_t irq);
+
+// Unmasks an ISA line in the IOAPIC
+extern void apic_enable_irq(uint32_t irq);
+
+// Masks an ISA line in the IOAPIC
+extern void apic_disable_irq(uint32_t irq);
+
+/* void apic_eoi()
+ * Description: Tells the local APIC the interrupt in service was handled
+ * Input:  none
+ * Output: none
+ * Side Effects: writes to the local APIC
+ */
+static inline void apic_eoi(void) {
+    lapic_regs[LAPIC_EOI / 4] = 0;
+}
+
+#endif
@@ -0,0 +1,309 @@
+#include "bcache.h"
+#include "lz4.h"
+#include "lib.h"
+#include "schedule.h"
+
+static bcache_entry_t bcache[BCACHE_SIZE];
+static block_t bcache_data[BCACHE_SIZE] __attribute__((aligned(BLOCK_SIZE)));
+static bcache_entry_t *hash_table[BCACHE_BUCKETS];
+static bcache_entry_t *lru_head;
+static bcache_entry_t *lru_tail;
+
+// Shared by every all-zero image block
+static block_t zero_block;
+
+// Where cached blocks come from
+static uint32_t num_blocks;
+// Returns blocks that can be used in place without caching, NULL otherwise
+static uint8_t* (*source_direct)(uint32_t block);
+// Fills data with a block, 0 on success
+static int32_t (*source_fill)(uint32_t block, uint8_t* data);
+
+// Compressed image source
+static uint8_t* image;
+static fsz_block_t* block_index;
+
+// Block device source
+static blkdev_t* disk;
+
+/* void lru_unlink(bcache_entry_t* entry)
+ * Description: removes entry from the LRU list
+ * Input:  entry - entry to remove
+ * Output: none
+ * Side Effects: modifies the LRU list
+ */
+static void lru_unlink(bcache_entry_t* entry) {
+    if (entry->lru_prev) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        lru_head = entry->lru_next;
+    }
+    if (entry->lru_next) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        lru_tail = entry->lru_prev;
+    }
+}
+
+/* void lru_push_front(bcache_entry_t* entry)
+ * Description: makes entry the most recently used entry
+ * Input:  entry - entry to move, must not be on the list
+ * Output: none
+ * Side Effects: modifies the LRU list
+ */
+static void lru_push_front(bcache_entry_t* entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = lru_head;
+    if (lru_head) {
+        lru_head->lru_prev = entry;
+    } else {
+        lru_tail = entry;
+    }
+    lru_head = entry;
+}
+
+/* void hash_unlink(bcache_entry_t* entry)
+ * Description: removes entry from its hash chain
+ * Input:  entry - entry to remove
+ * Output: none
+ * Side Effects: modifies hash_table
+ */
+static void hash_unlink(bcache_entry_t* entry) {
+    bcache_entry_t **p = &hash_table[entry->block & (BCACHE_BUCKETS - 1)];
+    while (*p) {
+        if (*p == entry) {
+            *p = entry->hash_next;
+            return;
+        }
+        p = &(*p)->hash_next;
+    }
+}
+
+/* void bcache_reset(void)
+ * Description: empties the cache
+ * Input:  none
+ * Output: none
+ * Side Effects: drops every cached block, nothing may hold one
+ */
+static void bcache_reset(void) {
+    uint32_t i;
+    memset(bcache, 0, sizeof(bcache));
+    memset(hash_table, 0, sizeof(hash_table));
+    lru_head = NULL;
+    lru_tail = NULL;
+    for (i = 0; i < BCACHE_SIZE; i++) {
+        lru_push_front(&bcache[i]);
+    }
+}
+
+/* uint8_t* image_direct(uint32_t block)
+ * Description: returns compressed image blocks that need no decompression
+ * Input:  block - image block number
+ * Output: the block inside the image or the zero block, NULL if it is compressed
+ * Side Effects: none
+ */
+static uint8_t* image_direct(uint32_t block) {
+    if (block_index[block].length == BLOCK_SIZE) {
+        return image + block_index[block].offset;
+    }
+    if (block_index[block].length == 0) {
+        return zero_block.data;
+    }
+    return NULL;
+}
+
+/* int32_t image_fill(uint32_t block, uint8_t* data)
+ * Description: decompresses a compressed image block
+ * Input:  block - image block number
+ *         data - BLOCK_SIZE buffer to decompress into
+ * Output: 0 on success, -1 if the block is corrupt
+ * Side Effects: writes to data
+ */
+static int32_t image_fill(uint32_t block, uint8_t* data) {
+    if (lz4_decompress(image + block_index[block].offset, block_index[block].length, data, BLOCK_SIZE) != BLOCK_SIZE) {
+        return -1;
+    }
+    return 0;
+}
+
+/* int32_t disk_fill(uint32_t block, uint8_t* data)
+ * Description: reads a block from the disk straight into the cache by DMA
+ * Input:  block - filesystem block number
+ *         data - BLOCK_SIZE buffer to read into
+ * Output: 0 on success, -1 on a device error
+ * Side Effects: may reschedule while the read is in flight
+ */
+static int32_t disk_fill(uint32_t block, uint8_t* data) {
+    return blk_read(disk, (uint64_t)block * (BLOCK_SIZE / SECTOR_SIZE), BLOCK_SIZE / SECTOR_SIZE, data);
+}
+
+/* int32_t bcache_init_image(void* start, void* end)
+ * Description: checks the compressed image header and block index and
+ *              makes it the source of cached blocks
+ * Input:  start - start of the compressed image
+ *         end - end of the compressed image
+ * Output: 0 on success, -1 if the image is not a valid compressed image
+ * Side Effects: empties the cache
+ */
+int32_t bcache_init_image(void* start, void* end) {
+    uint32_t size = (uint8_t*)end - (uint8_t*)start;
+    fsz_header_t* header = start;
+    fsz_block_t* index = (fsz_block_t*)(header + 1);
+    uint32_t i;
+
+    if (size < sizeof(fsz_header_t) || header->magic != FSZ_MAGIC ||
+        header->num_blocks > (size - sizeof(fsz_header_t)) / sizeof(fsz_block_t)) {
+        return -1;
+    }
+    for (i = 0; i < header->num_blocks; i++) {
+        if (index[i].length > BLOCK_SIZE || index[i].offset > size ||
+            index[i].length > size - index[i].offset) {
+            return -1;
+        }
+    }
+
+    uint32_t flags;
+    cli_and_save(flags);
+    bcache_reset();
+    image = start;
+    block_index = index;
+    num_blocks = header->num_blocks;
+    source_direct = image_direct;
+    source_fill = image_fill;
+    restore_flags(flags);
+    return 0;
+}
+
+/* int32_t bcache_init_blkdev(blkdev_t* dev, uint32_t blocks)
+ * Description: makes a block device the source of cached blocks
+ * Input:  dev - device holding an uncompressed filesystem image
+ *         blocks - number of filesystem blocks on the device
+ * Output: 0 on success, -1 if the device is too small
+ * Side Effects: empties the cache
+ */
+int32_t bcache_init_blkdev(blkdev_t* dev, uint32_t blocks) {
+    if (dev == NULL || (uint64_t)blocks * (BLOCK_SIZE / SECTOR_SIZE) > dev->num_sectors) {
+        return -1;
+    }
+
+    uint32_t flags;
+    cli_and_save(flags);
+    bcache_reset();
+    disk = dev;
+    num_blocks = blocks;
+    source_direct = NULL;
+    source_fill = disk_fill;
+    restore_flags(flags);
+    return 0;
+}
+
+/* uint8_t* bcache_get(uint32_t block)
+ * Description: returns the contents of a filesystem block. Blocks the source
+ *              can hand out in place are returned directly, the rest are
+ *              decompressed or read into the least recently used free slot
+ *              on their first access.
+ * Input:  block - filesystem block number (0 is the boot block)
+ * Output: pointer to BLOCK_SIZE bytes, NULL if the block does not exist,
+ *         could not be read or every slot is pinned
+ * Side Effects: pins the block until bcache_put, may evict a cache entry,
+ *               may reschedule while a disk read is in flight
+ */
+uint8_t* bcache_get(uint32_t block) {
+    if (source_fill == NULL || block >= num_blocks) {
+        return NULL;
+    }
+    if (source_direct) {
+        uint8_t* direct = source_direct(block);
+        if (direct) {
+            return direct;
+        }
+    }
+
+    uint32_t flags;
+    cli_and_save(flags);
+
+    bcache_entry_t *entry = hash_table[block & (BCACHE_BUCKETS - 1)];
+    while (entry && entry->block != block) {
+        entry = entry->hash_next;
+    }
+
+    if (entry) {
+        entry->refcount++;
+        lru_unlink(entry);
+        lru_push_front(entry);
+        restore_flags(flags);
+
+        // Someone else is filling it, wait for them
+        while (entry->loading) {
+            reschedule();
+        }
+        if (!entry->used) {
+            bcache_put(bcache_data[entry - bcache].data);
+            return NULL;
+        }
+        return bcache_data[entry - bcache].data;
+    }
+
+    // Least recently used block nobody is reading from
+    entry = lru_tail;
+    while (entry && entry->refcount != 0) {
+        entry = entry->lru_prev;
+    }
+    if (entry == NULL) {
+        restore_flags(flags);
+        return NULL;
+    }
+    if (entry->used) {
+        hash_unlink(entry);
+    }
+
+    // Claim the slot before filling it with interrupts on, so lookups of the
+    // same block wait for this fill rather than starting another one
+    entry->block = block;
+    entry->used = true;
+    entry->loading = true;
+    entry->refcount = 1;
+    entry->hash_next = hash_table[block & (BCACHE_BUCKETS - 1)];
+    hash_table[block & (BCACHE_BUCKETS - 1)] = entry;
+    lru_unlink(entry);
+    lru_push_front(entry);
+    restore_flags(flags);
+
+    uint8_t* data = bcache_data[entry - bcache].data;
+    int32_t ret = source_fill(block, data);
+
+    cli_and_save(flags);
+    if (ret != 0) {
+        hash_unlink(entry);
+        entry->used = false;
+    }
+    entry->loading = false;
+    restore_flags(flags);
+
+    if (ret != 0) {
+        bcache_put(data);
+        return NULL;
+    }
+    return data;
+}
+
+/* void bcache_put(const uint8_t* data)
+ * Description: releases a block returned by bcache_get
+ * Input:  data - pointer returned by bcache_get
+ * Output: none
+ * Side Effects: unpins the cache entry so it can be evicted
+ */
+void bcache_put(const uint8_t* data) {
+    const uint8_t* cache_start = bcache_data[0].data;
+    if (data < cache_start || data >= cache_start + sizeof(bcache_data)) {
+        return;
+    }
+
+    uint32_t flags;
+    cli_and_save(flags);
+    bcache_entry_t *entry = &bcache[(data - cache_start) / BLOCK_SIZE];
+    if (entry->refcount > 0) {
+        entry->refcount--;
+    }
+    restore_flags(flags);
+}
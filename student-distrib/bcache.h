@@ -0,0 +1,40 @@
+#ifndef BCACHE_H_
+#define BCACHE_H_
+
+#include "types.h"
+#include "blkdev.h"
+#include "filesystem.h"
+
+// Number of filesystem blocks kept in memory
+#define BCACHE_SIZE 64
+// Number of hash chains, must be a power of 2
+#define BCACHE_BUCKETS 32
+
+typedef struct bcache_entry {
+    // Image block held in the matching bcache_data slot
+    uint32_t block;
+    // Number of bcache_get calls not yet matched by bcache_put
+    uint32_t refcount;
+    bool used;
+    // Set while the block is being decompressed or read from disk
+    volatile bool loading;
+    // Hash chain
+    struct bcache_entry *hash_next;
+    // LRU list, lru_head is the most recently used entry
+    struct bcache_entry *lru_prev;
+    struct bcache_entry *lru_next;
+} bcache_entry_t;
+
+// caches blocks of the compressed image in [start, end), -1 if it is not valid
+extern int32_t bcache_init_image(void* start, void* end);
+
+// caches the first num_blocks blocks of a block device
+extern int32_t bcache_init_blkdev(blkdev_t* dev, uint32_t num_blocks);
+
+// returns a pointer to image block, pinned until bcache_put, NULL on error
+extern uint8_t* bcache_get(uint32_t block);
+
+// releases a block returned by bcache_get
+extern void bcache_put(const uint8_t* data);
+
+#endif
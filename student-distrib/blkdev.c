@@ -0,0 +1,145 @@
+#include "blkdev.h"
+#include "lib.h"
+#include "schedule.h"
+
+static blkdev_t* blkdevs;
+
+/* void blkdev_register(blkdev_t* dev)
+ * Description: adds a block device to the list of devices
+ * Input:  dev - device to add, name, num_sectors, start and poll filled in
+ * Output: none
+ * Side Effects: modifies the device list
+ */
+void blkdev_register(blkdev_t* dev) {
+    uint32_t flags;
+    cli_and_save(flags);
+    dev->queue_head = NULL;
+    dev->queue_tail = NULL;
+    dev->next = blkdevs;
+    blkdevs = dev;
+    restore_flags(flags);
+}
+
+/* blkdev_t* blkdev_find(const int8_t* name)
+ * Description: finds a registered device by name
+ * Input:  name - name of the device, eg. "vda"
+ * Output: the device, NULL if there is none
+ * Side Effects: none
+ */
+blkdev_t* blkdev_find(const int8_t* name) {
+    blkdev_t* dev;
+    for (dev = blkdevs; dev; dev = dev->next) {
+        if (!strncmp(dev->name, name, BLKDEV_NAME_LEN)) {
+            return dev;
+        }
+    }
+    return NULL;
+}
+
+/* int32_t blk_submit(blkdev_t* dev, blk_request_t* req)
+ * Description: queues a request and lets the driver start it if the
+ *              hardware has room. Returns without waiting for the transfer.
+ * Input:  dev - device to transfer with
+ *         req - request, sector, count, buf and write filled in
+ * Output: 0 if the request was queued, -1 if it is out of range
+ * Side Effects: req->status is BLK_PENDING until the transfer finishes
+ */
+int32_t blk_submit(blkdev_t* dev, blk_request_t* req) {
+    if (dev == NULL || req->count == 0 || req->sector >= dev->num_sectors ||
+        req->count > dev->num_sectors - req->sector) {
+        return -1;
+    }
+
+    uint32_t flags;
+    cli_and_save(flags);
+
+    req->status = BLK_PENDING;
+    req->next = NULL;
+    if (dev->queue_tail) {
+        dev->queue_tail->next = req;
+    } else {
+        dev->queue_head = req;
+    }
+    dev->queue_tail = req;
+    dev->start(dev);
+
+    restore_flags(flags);
+    return 0;
+}
+
+/* blk_request_t* blk_dequeue(blkdev_t* dev)
+ * Description: takes the oldest queued request off the device queue,
+ *              called by drivers with interrupts off
+ * Input:  dev - device whose queue to take from
+ * Output: the request, NULL if the queue is empty
+ * Side Effects: modifies the device queue
+ */
+blk_request_t* blk_dequeue(blkdev_t* dev) {
+    blk_request_t* req = dev->queue_head;
+    if (req) {
+        dev->queue_head = req->next;
+        if (dev->queue_head == NULL) {
+            dev->queue_tail = NULL;
+        }
+        req->next = NULL;
+    }
+    return req;
+}
+
+/* void blk_complete(blk_request_t* req, int32_t status)
+ * Description: marks a request finished, called by drivers
+ * Input:  req - finished request
+ *         status - 0 on success, -1 on a device error
+ * Output: none
+ * Side Effects: wakes anyone in blk_wait on req
+ */
+void blk_complete(blk_request_t* req, int32_t status) {
+    req->status = status;
+}
+
+/* int32_t blk_wait(blkdev_t* dev, blk_request_t* req)
+ * Description: waits for a submitted request. With interrupts on other
+ *              tasks run until the device interrupt completes it, during
+ *              boot with interrupts off the device is spun on.
+ * Input:  dev - device the request was submitted to
+ *         req - request to wait for
+ * Output: 0 on success, -1 on a device error
+ * Side Effects: may reschedule
+ */
+int32_t blk_wait(blkdev_t* dev, blk_request_t* req) {
+    while (1) {
+        // Polling is cheap and covers devices without a working interrupt
+        dev->poll(dev);
+        if (req->status != BLK_PENDING) {
+            break;
+        }
+        uint32_t flags;
+        cli_and_save(flags);
+        restore_flags(flags);
+        if (flags & EFLAGS_IF) {
+            reschedule();
+        }
+    }
+    return req->status;
+}
+
+/* int32_t blk_read(blkdev_t* dev, uint64_t sector, uint32_t count, uint8_t* buf)
+ * Description: reads sectors and waits for them
+ * Input:  dev - device to read from
+ *         sector - first sector to read
+ *         count - number of sectors to read
+ *         buf - kernel buffer of count * SECTOR_SIZE bytes
+ * Output: 0 on success, -1 on error
+ * Side Effects: may reschedule
+ */
+int32_t blk_read(blkdev_t* dev, uint64_t sector, uint32_t count, uint8_t* buf) {
+    blk_request_t req;
+    req.sector = sector;
+    req.count = count;
+    req.buf = buf;
+    req.write = false;
+    if (blk_submit(dev, &req) != 0) {
+        return -1;
+    }
+    return blk_wait(dev, &req);
+}
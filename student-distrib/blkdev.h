@@ -0,0 +1,68 @@
+/* blkdev.h - Block device layer with a per device request queue
+ */
+
+#ifndef BLKDEV_H
+#define BLKDEV_H
+
+#include "types.h"
+
+#define SECTOR_SIZE 512
+#define BLKDEV_NAME_LEN 8
+
+// blk_request_t.status while the request is queued or in flight
+#define BLK_PENDING 1
+
+// Interrupt enable bit in EFLAGS
+#define EFLAGS_IF 0x200
+
+typedef struct blk_request {
+    // First 512 byte sector to transfer
+    uint64_t sector;
+    // Number of sectors to transfer
+    uint32_t count;
+    // Kernel buffer the device DMAs to/from. Kernel memory is identity
+    // mapped, so it must not be in a user page.
+    uint8_t* buf;
+    bool write;
+    // BLK_PENDING until the driver finishes, then 0 or -1
+    volatile int32_t status;
+    // Device queue
+    struct blk_request* next;
+} blk_request_t;
+
+typedef struct blkdev {
+    int8_t name[BLKDEV_NAME_LEN];
+    uint64_t num_sectors;
+    // Hands as many queued requests to the hardware as it has room for,
+    // called with interrupts off
+    void (*start)(struct blkdev* dev);
+    // Completes finished requests without waiting for an interrupt
+    void (*poll)(struct blkdev* dev);
+    // Requests submitted but not yet handed to the hardware
+    blk_request_t* queue_head;
+    blk_request_t* queue_tail;
+    struct blkdev* next;
+} blkdev_t;
+
+// makes dev visible to blkdev_find
+extern void blkdev_register(blkdev_t* dev);
+
+// finds a registered device by name
+extern blkdev_t* blkdev_find(const int8_t* name);
+
+// queues req on dev without waiting for it, -1 if it is out of range
+extern int32_t blk_submit(blkdev_t* dev, blk_request_t* req);
+
+// takes the oldest queued request off dev for the driver, NULL if none
+extern blk_request_t* blk_dequeue(blkdev_t* dev);
+
+// called by drivers when the hardware finishes req
+extern void blk_complete(blk_request_t* req, int32_t status);
+
+// waits for a submitted request, returns its status
+extern int32_t blk_wait(blkdev_t* dev, blk_request_t* req);
+
+// reads count sectors into buf and waits for them
+extern int32_t blk_read(blkdev_t* dev, uint64_t sector, uint32_t count, uint8_t* buf);
+
+#endif
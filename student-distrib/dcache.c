@@ -0,0 +1,188 @@
+#include "dcache.h"
+#include "lib.h"
+
+static dcache_entry_t dcache[DCACHE_SIZE];
+static dcache_entry_t *hash_table[DCACHE_BUCKETS];
+static dcache_entry_t *lru_head;
+static dcache_entry_t *lru_tail;
+
+/* uint32_t dcache_hash(uint32_t parent, const int8_t* name, uint32_t len)
+ * Description: FNV-1a hash of the directory inode and name
+ * Input:  parent - directory the name lives in
+ *         name - name to hash (not necessarily null terminated)
+ *         len - number of bytes of name to hash
+ * Output: index into hash_table
+ * Side Effects: none
+ */
+static uint32_t dcache_hash(uint32_t parent, const int8_t* name, uint32_t len) {
+    uint32_t hash = 2166136261U ^ parent;
+    uint32_t i;
+    for (i = 0; i < len; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619U;
+    }
+    return hash & (DCACHE_BUCKETS - 1);
+}
+
+/* uint32_t name_len(const int8_t* name)
+ * Description: length of a dentry name, which is not null terminated when 32 bytes long
+ * Input:  name - dentry name
+ * Output: length of name
+ * Side Effects: none
+ */
+static uint32_t name_len(const int8_t* name) {
+    uint32_t len = 0;
+    while (len < 32 && name[len] != '\0') {
+        len++;
+    }
+    return len;
+}
+
+/* void lru_unlink(dcache_entry_t* entry)
+ * Description: removes entry from the LRU list
+ * Input:  entry - entry to remove
+ * Output: none
+ * Side Effects: modifies the LRU list
+ */
+static void lru_unlink(dcache_entry_t* entry) {
+    if (entry->lru_prev) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        lru_head = entry->lru_next;
+    }
+    if (entry->lru_next) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        lru_tail = entry->lru_prev;
+    }
+}
+
+/* void lru_push_front(dcache_entry_t* entry)
+ * Description: makes entry the most recently used entry
+ * Input:  entry - entry to move, must not be on the list
+ * Output: none
+ * Side Effects: modifies the LRU list
+ */
+static void lru_push_front(dcache_entry_t* entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = lru_head;
+    if (lru_head) {
+        lru_head->lru_prev = entry;
+    } else {
+        lru_tail = entry;
+    }
+    lru_head = entry;
+}
+
+/* void hash_unlink(dcache_entry_t* entry)
+ * Description: removes entry from its hash chain
+ * Input:  entry - entry to remove
+ * Output: none
+ * Side Effects: modifies hash_table
+ */
+static void hash_unlink(dcache_entry_t* entry) {
+    uint32_t bucket = dcache_hash(entry->parent, entry->dentry.name, name_len(entry->dentry.name));
+    dcache_entry_t **p = &hash_table[bucket];
+    while (*p) {
+        if (*p == entry) {
+            *p = entry->hash_next;
+            return;
+        }
+        p = &(*p)->hash_next;
+    }
+}
+
+/* void dcache_init(void)
+ * Description: empties the dentry cache
+ * Input:  none
+ * Output: none
+ * Side Effects: clears every cache entry
+ */
+void dcache_init(void) {
+    uint32_t flags;
+    cli_and_save(flags);
+
+    memset(dcache, 0, sizeof(dcache));
+    memset(hash_table, 0, sizeof(hash_table));
+    lru_head = NULL;
+    lru_tail = NULL;
+
+    // Every entry starts out free on the LRU list so the tail is always
+    // the next entry to hand out.
+    int i;
+    for (i = 0; i < DCACHE_SIZE; i++) {
+        lru_push_front(&dcache[i]);
+    }
+
+    restore_flags(flags);
+}
+
+/* int32_t dcache_lookup(uint32_t parent, const int8_t* name, uint32_t len, dentry_t* dentry)
+ * Description: looks up name in directory parent
+ * Input:  parent - inode of the directory to search
+ *         name - name to find (not necessarily null terminated)
+ *         len - length of name
+ *         dentry - dentry_t to copy the result into
+ * Output: 0 on a hit, -1 on a miss
+ * Side Effects: marks the entry as most recently used
+ */
+int32_t dcache_lookup(uint32_t parent, const int8_t* name, uint32_t len, dentry_t* dentry) {
+    if (len == 0 || len > 32) {
+        return -1;
+    }
+
+    uint32_t flags;
+    cli_and_save(flags);
+
+    dcache_entry_t *entry = hash_table[dcache_hash(parent, name, len)];
+    while (entry) {
+        if (entry->parent == parent && name_len(entry->dentry.name) == len &&
+            !strncmp(entry->dentry.name, name, len)) {
+            memcpy(dentry, &entry->dentry, sizeof(dentry_t));
+            lru_unlink(entry);
+            lru_push_front(entry);
+            restore_flags(flags);
+            return 0;
+        }
+        entry = entry->hash_next;
+    }
+
+    restore_flags(flags);
+    return -1;
+}
+
+/* void dcache_insert(uint32_t parent, const dentry_t* dentry)
+ * Description: remembers that dentry was found in directory parent,
+ *              evicting the least recently used entry
+ * Input:  parent - inode of the directory dentry was found in
+ *         dentry - result of the lookup
+ * Output: none
+ * Side Effects: may evict a cache entry
+ */
+void dcache_insert(uint32_t parent, const dentry_t* dentry) {
+    uint32_t len = name_len(dentry->name);
+    if (len == 0) {
+        return;
+    }
+
+    uint32_t flags;
+    cli_and_save(flags);
+
+    dcache_entry_t *entry = lru_tail;
+    if (entry->used) {
+        hash_unlink(entry);
+    }
+
+    entry->parent = parent;
+    memcpy(&entry->dentry, dentry, sizeof(dentry_t));
+    entry->used = true;
+
+    uint32_t bucket = dcache_hash(parent, dentry->name, len);
+    entry->hash_next = hash_table[bucket];
+    hash_table[bucket] = entry;
+
+    lru_unlink(entry);
+    lru_push_front(entry);
+
+    restore_flags(flags);
+}
@@ -0,0 +1,34 @@
+#ifndef DCACHE_H_
+#define DCACHE_H_
+
+#include "types.h"
+#include "filesystem.h"
+
+// Number of cached (parent directory, name) -> dentry translations
+#define DCACHE_SIZE 64
+// Number of hash chains, must be a power of 2
+#define DCACHE_BUCKETS 32
+
+typedef struct dcache_entry {
+    // Directory inode the name was looked up in
+    uint32_t parent;
+    // Result of the lookup, dentry.name is the key
+    dentry_t dentry;
+    bool used;
+    // Hash chain
+    struct dcache_entry *hash_next;
+    // LRU list, lru_head is the most recently used entry
+    struct dcache_entry *lru_prev;
+    struct dcache_entry *lru_next;
+} dcache_entry_t;
+
+// empties the dentry cache
+extern void dcache_init(void);
+
+// looks up name (len bytes) in directory parent, 0 on a hit and -1 on a miss
+extern int32_t dcache_lookup(uint32_t parent, const int8_t* name, uint32_t len, dentry_t* dentry);
+
+// remembers that dentry was found in directory parent
+extern void dcache_insert(uint32_t parent, const dentry_t* dentry);
+
+#endif
@@ -3,8 +3,16 @@
 
 extern void ignore_int();
 
+// The APIC's spurious vector, which only returns
+extern void spurious_int();
+
 extern void execute_shell();
 
+// The user trampoline page and the entry points in it
+extern void trampoline_page();
+extern void sigreturn_trampoline();
+extern void thread_exit_trampoline();
+
 extern void divide_error();
 extern void debug();
 extern void nmi();
@@ -1,12 +1,48 @@
 #include "filesystem.h"
+#include "bcache.h"
+#include "dcache.h"
 #include "lib.h"
 #include "task.h"
+#include "spinlock.h"
 
 static void* fs_start;
 static void* fs_end;
 
 static boot_block_t* boot_block;
 
+// Set when blocks come from the bcache (compressed module or disk) rather
+// than straight out of the module
+static bool cached;
+// Copy of the cached image's boot block, which is needed on every access
+static boot_block_t boot_block_copy;
+// Block 0 of a disk, read before deciding whether to mount it
+static block_t mount_block __attribute__((aligned(BLOCK_SIZE)));
+
+/* uint8_t* get_block(uint32_t block)
+ * Description: returns a block of the uncompressed image
+ * Input:  block - block number, 0 is the boot block and inodes follow it
+ * Output: pointer to the block, NULL on error
+ * Side Effects: the block must be released with put_block
+ */
+static uint8_t* get_block(uint32_t block) {
+    if (cached) {
+        return bcache_get(block);
+    }
+    return (uint8_t*)fs_start + block * BLOCK_SIZE;
+}
+
+/* void put_block(const uint8_t* data)
+ * Description: releases a block returned by get_block
+ * Input:  data - pointer returned by get_block
+ * Output: none
+ * Side Effects: lets the block cache evict the block
+ */
+static void put_block(const uint8_t* data) {
+    if (cached) {
+        bcache_put(data);
+    }
+}
+
 /* void file_system_init(void* start, void* end)
  * Description: intializes the filesystem and its operations
  * Input:  start - pointer to start of filesystem
@@ -19,27 +55,68 @@ void file_system_init(void* start, void* end) {
     fs_end = end;
     boot_block = fs_start;
 
+    cached = false;
+    if (((fsz_header_t*)start)->magic == FSZ_MAGIC && bcache_init_image(start, end) == 0) {
+        uint8_t* block = bcache_get(0);
+        if (block != NULL) {
+            cached = true;
+            memcpy(&boot_block_copy, block, sizeof(boot_block_t));
+            bcache_put(block);
+            boot_block = &boot_block_copy;
+        }
+    }
+
+    dcache_init();
+
     filesys_ops.open = filesys_open;
     filesys_ops.close = filesys_close;
     filesys_ops.read = filesys_read;
     filesys_ops.write = filesys_write;
     filesys_ops.stat = filesys_stat;
+    filesys_ops.poll = filesys_poll;
+    filesys_ops.lseek = filesys_lseek;
+    filesys_ops.pread = filesys_pread;
+}
+
+/* int32_t file_system_mount(blkdev_t* dev)
+ * Description: switches the filesystem over to an uncompressed image on a
+ *              block device, read through the block cache
+ * Input:  dev - device holding the image
+ * Output: 0 on success, -1 if the device does not hold a valid image
+ * Side Effects: replaces the module filesystem, nothing may be open yet
+ */
+int32_t file_system_mount(blkdev_t* dev) {
+    if (dev == NULL || blk_read(dev, 0, BLOCK_SIZE / SECTOR_SIZE, mount_block.data) != 0) {
+        return -1;
+    }
+
+    boot_block_t* b = (boot_block_t*)mount_block.data;
+    uint64_t num_blocks = 1 + (uint64_t)b->num_inodes + b->num_data_blocks;
+    if (b->num_dentries == 0 || b->num_dentries > 63 || b->num_inodes == 0 || num_blocks > 0xFFFFFFFF ||
+        bcache_init_blkdev(dev, num_blocks) != 0) {
+        return -1;
+    }
+
+    memcpy(&boot_block_copy, b, sizeof(boot_block_t));
+    boot_block = &boot_block_copy;
+    cached = true;
+    dcache_init();
+    return 0;
 }
 
 /* int32_t filesys_open(const int8_t* filename)
- * Description: opens a file, by returning the inode
- * Input:  filename - file to open
- * Output: inode on success, NULL for directory, -1 for anything else
+ * Description: opens a file or directory, by returning the inode
+ * Input:  filename - path of the file to open
+ * Output: inode on success (ROOT_DIR_INODE for the root directory), -1 for anything else
  * Side Effects: reads from the filesystem
  */
 int32_t filesys_open(const int8_t* filename) {
     dentry_t dentry;
     if (read_dentry_by_name(filename, &dentry) == 0) {
         switch (dentry.type) {
-        case 2:
+        case FD_FILE:
+        case FD_DIR:
             return dentry.inode;
-        case 1:
-            return NULL;
         case 0:
         default:
             return -1;
@@ -57,6 +134,17 @@ int32_t filesys_close(int32_t fd) {
     return 0;
 }
 
+/* int32_t filesys_poll(int32_t fd, wait_queue_t** wait)
+ * Description: Files and directories can always be read without sleeping
+ * Input:  fd - ignored
+ *         wait - ignored
+ * Output: POLLIN
+ * Side Effects: none
+ */
+int32_t filesys_poll(int32_t fd, wait_queue_t** wait){
+    return POLLIN;
+}
+
 /* int32_t filesys_stat(int32_t fd, void* buf, int32_t nbytes)
  * Description: writes file stats to buf
  * Input:  fd- index of file to stat
@@ -73,7 +161,7 @@ int32_t filesys_stat(int32_t fd, void* buf, int32_t nbytes){
         ((fstat_t*)buf)->size = get_size(tasks[cur_task]->file_descs[fd].inode);
         break;
     case FD_DIR:
-        read_dentry_by_index(tasks[cur_task]->file_descs[fd].file_pos - 1, &e);
+        read_dir_entry(tasks[cur_task]->file_descs[fd].inode, tasks[cur_task]->file_descs[fd].file_pos - 1, &e);
         ((fstat_t*)buf)->type = e.type;
         ((fstat_t*)buf)->size = get_size(e.inode);
         break;
@@ -101,7 +189,7 @@ int32_t filesys_read(int32_t fd, void* buf, int32_t nbytes) {
         tasks[cur_task]->file_descs[fd].file_pos += read;
         break;
     case FD_DIR:
-        read = read_dir_data(tasks[cur_task]->file_descs[fd].file_pos, (uint8_t*)buf, nbytes);
+        read = read_dir_data(tasks[cur_task]->file_descs[fd].inode, tasks[cur_task]->file_descs[fd].file_pos, (uint8_t*)buf, nbytes);
         tasks[cur_task]->file_descs[fd].file_pos++;
         break;
     default:
@@ -110,20 +198,72 @@ int32_t filesys_read(int32_t fd, void* buf, int32_t nbytes) {
     return read;
 }
 
-/* int32_t read_dir_data(int32_t index, void* buf, int32_t nbytes)
+/* int32_t filesys_lseek(int32_t fd, int32_t offset, int32_t whence)
+ * Description: moves the position of a file, or the entry index of a directory
+ * Input: fd - index of file to seek
+ *        offset - new position relative to whence
+ *        whence - SEEK_SET, SEEK_CUR or SEEK_END (files only)
+ * Output: -1 on error, the new position on success
+ * Side Effects: changes file_pos of fd
+ */
+int32_t filesys_lseek(int32_t fd, int32_t offset, int32_t whence) {
+    file_desc_t *desc = &tasks[cur_task]->file_descs[fd];
+    int32_t pos;
+    switch (whence) {
+    case SEEK_SET:
+        pos = offset;
+        break;
+    case SEEK_CUR:
+        pos = desc->file_pos + offset;
+        break;
+    case SEEK_END:
+        // Directories have no cheap entry count
+        if (desc->flags != FD_FILE) {
+            return -1;
+        }
+        pos = get_size(desc->inode) + offset;
+        break;
+    default:
+        return -1;
+    }
+    if (pos < 0) {
+        return -1;
+    }
+    desc->file_pos = pos;
+    return pos;
+}
+
+/* int32_t filesys_pread(int32_t fd, void* buf, int32_t nbytes, uint32_t offset)
+ * Description: reads nbytes of a file starting at offset, the block holding
+ *              offset is found directly from the inode's block list
+ * Input: fd - index of file to read from
+ *        buf - buffer to write file to
+ *        nbytes - number of bytes to read
+ *        offset - point in file to start reading
+ * Output: -1 on error, bytes read on success
+ * Side Effects: none, file_pos is left alone
+ */
+int32_t filesys_pread(int32_t fd, void* buf, int32_t nbytes, uint32_t offset) {
+    if (tasks[cur_task]->file_descs[fd].flags != FD_FILE || nbytes < 0) {
+        return -1;
+    }
+    return read_data(tasks[cur_task]->file_descs[fd].inode, offset, (uint8_t*)buf, nbytes);
+}
+
+/* int32_t read_dir_data(uint32_t dir, uint32_t index, void* buf, int32_t nbytes)
  * Description: reads a file name from a directory
- * Input: index - index of file to read
+ * Input: dir - inode of the directory to read
+ *        index - index of file to read
  *        buf - buffer to write file name into
  *        nbytes - number of bytes to read
  * Output: number of bytes read
  * Side Effects: reads from filesystem
  */
-int32_t read_dir_data(uint32_t index, uint8_t* buf, uint32_t nbytes) {
-    if (index >= boot_block->num_dentries)
+int32_t read_dir_data(uint32_t dir, uint32_t index, uint8_t* buf, uint32_t nbytes) {
+    dentry_t d;
+    if (read_dir_entry(dir, index, &d) != 0)
         return 0;
     uint32_t length_to_read = 32 > nbytes ? nbytes : 32;
-    dentry_t d;
-    read_dentry_by_index(index, &d);
 
     uint32_t i;
     for (i = 0; i < length_to_read; i++) {
@@ -132,6 +272,99 @@ int32_t read_dir_data(uint32_t index, uint8_t* buf, uint32_t nbytes) {
     return length_to_read;
 }
 
+/* int32_t filesys_getdents(int32_t fd, void* buf, int32_t nbytes)
+ * Description: fills buf with as many directory records as fit, starting
+ *              at the directory's current position
+ * Input: fd - index of an open directory
+ *        buf - buffer to write dirent_t records into
+ *        nbytes - size of buf
+ * Output: -1 on error, number of bytes written (0 at end of directory)
+ * Side Effects: advances the directory position
+ */
+int32_t filesys_getdents(int32_t fd, void* buf, int32_t nbytes) {
+    file_desc_t *desc = &tasks[cur_task]->file_descs[fd];
+    if (desc->flags != FD_DIR) {
+        return -1;
+    }
+
+    dirent_t *out = (dirent_t*)buf;
+    int32_t written = 0;
+    dentry_t d;
+    while (written + (int32_t)sizeof(dirent_t) <= nbytes &&
+           read_dir_entry(desc->inode, desc->file_pos, &d) == 0) {
+        memcpy(out->name, d.name, 32);
+        out->type = d.type;
+        out->inode = d.inode;
+        out->size = d.type == FD_FILE ? get_size(d.inode) : 0;
+
+        desc->file_pos++;
+        written += sizeof(dirent_t);
+        out++;
+    }
+    return written;
+}
+
+/* int32_t filesys_sendfile(int32_t out_fd, int32_t in_fd, int32_t count)
+ * Description: writes up to count bytes from a file to another fd, handing
+ *              the write op pointers into the filesystem blocks so the data
+ *              never passes through a user buffer
+ * Input: out_fd - fd to write to
+ *        in_fd - file to read from, at its current position
+ *        count - maximum number of bytes to send
+ * Output: number of bytes sent, 0 at end of file, -1 on error
+ * Side Effects: advances in_fd's position by the bytes sent
+ */
+int32_t filesys_sendfile(int32_t out_fd, int32_t in_fd, int32_t count) {
+    file_desc_t* in = &tasks[cur_task]->file_descs[in_fd];
+    file_desc_t* out = &tasks[cur_task]->file_descs[out_fd];
+    if (in->flags != FD_FILE || count < 0 || (uint32_t)in->inode >= boot_block->num_inodes) {
+        return -1;
+    }
+
+    inode_t* inode = (inode_t*)get_block(in->inode + 1);
+    if (inode == NULL) {
+        return -1;
+    }
+
+    int32_t sent = 0;
+    while (sent < count && (uint32_t)in->file_pos < inode->length) {
+        uint32_t block_num = inode->block_nums[in->file_pos / BLOCK_SIZE];
+        uint32_t offset = in->file_pos % BLOCK_SIZE;
+        uint8_t* block;
+        if (block_num >= boot_block->num_data_blocks ||
+            (block = get_block(boot_block->num_inodes + 1 + block_num)) == NULL) {
+            break;
+        }
+
+        uint32_t chunk = BLOCK_SIZE - offset;
+        if (chunk > count - sent) {
+            chunk = count - sent;
+        }
+        if (chunk > inode->length - in->file_pos) {
+            chunk = inode->length - in->file_pos;
+        }
+
+        int32_t written = (*out->ops->write)(out_fd, block + offset, chunk);
+        put_block(block);
+        if (written < 0) {
+            if (sent == 0) {
+                sent = -1;
+            }
+            break;
+        }
+        in->file_pos += written;
+        sent += written;
+        if (written < chunk) {
+            break;
+        }
+        // A big file can take a while, let other tasks in between blocks
+        cond_resched();
+    }
+
+    put_block((uint8_t*)inode);
+    return sent;
+}
+
 /* int32_t filesys_write(int32_t fd, const void* buf, int32_t nbytes)
  * Description: writes to the filesytem which does nothing
  * Input: fd - unused
@@ -160,27 +393,29 @@ int32_t read_data_by_inode(inode_t *inode, uint32_t offset, uint8_t* buf, uint32
     uint32_t length_to_read = (inode->length - offset) > length ? length : (inode->length - offset);
 
     uint32_t block_nums_index = offset / BLOCK_SIZE;
-    uint32_t block_num = inode->block_nums[block_nums_index];
-
-    if (block_num >= boot_block->num_data_blocks) {
-        return 0;
-    }
-    block_t* curr_block =  fs_start + ((boot_block->num_inodes + 1) * BLOCK_SIZE) + (block_num * BLOCK_SIZE);
     uint32_t b = offset % BLOCK_SIZE;
     uint32_t i = 0;
     while (i < length_to_read) {
-        buf[i] = curr_block->data[b];
-        i++;
-        b++;
-        if (b >= BLOCK_SIZE && i < length_to_read) {
-            b -= BLOCK_SIZE;
-            block_nums_index++;
-            block_num = inode->block_nums[block_nums_index];
-            if (block_num >= boot_block->num_data_blocks) {
-                return 0;
-            }
-            curr_block =  fs_start + ((boot_block->num_inodes + 1) * BLOCK_SIZE) + (block_num * BLOCK_SIZE);
+        uint32_t block_num = inode->block_nums[block_nums_index];
+        if (block_num >= boot_block->num_data_blocks) {
+            return 0;
+        }
+        uint8_t* block = get_block(boot_block->num_inodes + 1 + block_num);
+        if (block == NULL) {
+            return 0;
         }
+
+        // Copy the rest of this block in one go
+        uint32_t chunk = BLOCK_SIZE - b;
+        if (chunk > length_to_read - i) {
+            chunk = length_to_read - i;
+        }
+        memcpy(buf + i, block + b, chunk);
+        put_block(block);
+
+        i += chunk;
+        b = 0;
+        block_nums_index++;
     }
 
     return length_to_read;
@@ -199,8 +434,13 @@ int32_t read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length
     if (inode >= boot_block->num_inodes) {
         return -1;
     }
-    inode_t* inode_block = fs_start + ((inode + 1) * BLOCK_SIZE);
-    return read_data_by_inode(inode_block, offset, buf, length);
+    inode_t* inode_block = (inode_t*)get_block(inode + 1);
+    if (inode_block == NULL) {
+        return -1;
+    }
+    int32_t read = read_data_by_inode(inode_block, offset, buf, length);
+    put_block((uint8_t*)inode_block);
+    return read;
 }
 
 /* int32_t read_dentry_by_index(uint32_t index, dentry_t* dentry)
@@ -260,21 +500,200 @@ uint32_t get_size(uint32_t inode_index) {
     if (inode_index >= boot_block->num_inodes) {
         return 0;
     }
-    inode_t* inode_block = fs_start + ((inode_index + 1) * BLOCK_SIZE);
-    return inode_block->length;
+    inode_t* inode_block = (inode_t*)get_block(inode_index + 1);
+    if (inode_block == NULL) {
+        return 0;
+    }
+    uint32_t length = inode_block->length;
+    put_block((uint8_t*)inode_block);
+    return length;
+}
+
+/* int32_t read_dir_entry(uint32_t dir, uint32_t index, dentry_t* dentry)
+ * Description: Copies the index'th entry of a directory to *dentry
+ * Input:  dir - inode of the directory, ROOT_DIR_INODE for the boot block
+ *         index - entry to read
+ *         dentry - dentry_t to store the entry
+ * Output: -1 past the end of the directory, 0 on success
+ * Side Effects: reads from filesystem, writes to *dentry
+ */
+int32_t read_dir_entry(uint32_t dir, uint32_t index, dentry_t* dentry) {
+    if (dir == ROOT_DIR_INODE) {
+        return read_dentry_by_index(index, dentry);
+    }
+    // Subdirectories store an array of dentry_t in their data blocks
+    if (read_data(dir, index * sizeof(dentry_t), (uint8_t*)dentry, sizeof(dentry_t)) != sizeof(dentry_t)) {
+        return -1;
+    }
+    return 0;
+}
+
+/* int32_t compare_name(const int8_t* name, uint32_t len, const dentry_t* dentry)
+ * Description: orders a path component against a dentry name the same way
+ *              buildfs sorts them (unsigned bytes, zero padded to 32)
+ * Input:  name - name to compare (not null terminated)
+ *         len - length of name
+ *         dentry - dentry to compare against
+ * Output: <0, 0 or >0 if name sorts before, equal to or after the dentry
+ * Side Effects: none
+ */
+static int32_t compare_name(const int8_t* name, uint32_t len, const dentry_t* dentry) {
+    uint32_t i;
+    for (i = 0; i < 32; i++) {
+        uint8_t a = i < len ? (uint8_t)name[i] : 0;
+        uint8_t b = (uint8_t)dentry->name[i];
+        if (a != b) {
+            return a - b;
+        }
+        if (a == 0) {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+/* uint32_t name_hash(const int8_t* name, uint32_t len)
+ * Description: FNV-1a hash of a file name, must match buildfs
+ * Input:  name - name to hash
+ *         len - length of name
+ * Output: the hash
+ * Side Effects: none
+ */
+static uint32_t name_hash(const int8_t* name, uint32_t len) {
+    uint32_t hash = 2166136261U;
+    uint32_t i;
+    for (i = 0; i < len; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+/* int32_t search_dir(uint32_t dir, const int8_t* name, uint32_t len, dentry_t* dentry)
+ * Description: finds a name in a directory on the image, using the hash table
+ *              or binary search when the image advertises them
+ * Input:  dir - inode of the directory to search
+ *         name - name to find (not null terminated)
+ *         len - length of name
+ *         dentry - dentry_t to store the result
+ * Output: 0 for success, -1 if the name does not exist
+ * Side Effects: reads from the filesystem
+ */
+static int32_t search_dir(uint32_t dir, const int8_t* name, uint32_t len, dentry_t* dentry) {
+    uint32_t flags = boot_block->layout_magic == FS_LAYOUT_MAGIC ? boot_block->layout_flags : 0;
+    uint32_t index;
+
+    if (dir == ROOT_DIR_INODE && (flags & FS_FLAG_HASH) && boot_block->hash_block < boot_block->num_data_blocks) {
+        uint8_t* slots = get_block(boot_block->num_inodes + 1 + boot_block->hash_block);
+        uint32_t slot = name_hash(name, len) % FS_HASH_SLOTS;
+        uint32_t probes;
+        int32_t found = -1;
+        for (probes = 0; slots != NULL && probes < FS_HASH_SLOTS && slots[slot] != 0; probes++) {
+            if (read_dentry_by_index(slots[slot] - 1, dentry) == 0 && compare_name(name, len, dentry) == 0) {
+                found = 0;
+                break;
+            }
+            slot = (slot + 1) % FS_HASH_SLOTS;
+        }
+        put_block(slots);
+        return found;
+    }
+
+    if (flags & FS_FLAG_SORTED) {
+        uint32_t lo = 0;
+        uint32_t hi = dir == ROOT_DIR_INODE ? boot_block->num_dentries : get_size(dir) / sizeof(dentry_t);
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (read_dir_entry(dir, mid, dentry) != 0) {
+                return -1;
+            }
+            int32_t cmp = compare_name(name, len, dentry);
+            if (cmp == 0) {
+                return 0;
+            }
+            if (cmp < 0) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        return -1;
+    }
+
+    for (index = 0; read_dir_entry(dir, index, dentry) == 0; index++) {
+        if (compare_name(name, len, dentry) == 0) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* int32_t lookup_in_dir(uint32_t dir, const int8_t* name, uint32_t len, dentry_t* dentry)
+ * Description: finds a single path component in a directory, going through the dentry cache
+ * Input:  dir - inode of the directory to search
+ *         name - name to find (not null terminated)
+ *         len - length of name
+ *         dentry - dentry_t to store the result
+ * Output: 0 for success, -1 if the name does not exist
+ * Side Effects: reads from the filesystem, fills the dentry cache
+ */
+static int32_t lookup_in_dir(uint32_t dir, const int8_t* name, uint32_t len, dentry_t* dentry) {
+    if (len == 0 || len > 32) {
+        return -1;
+    }
+    if (dcache_lookup(dir, name, len, dentry) == 0) {
+        return 0;
+    }
+    if (search_dir(dir, name, len, dentry) != 0) {
+        return -1;
+    }
+    dcache_insert(dir, dentry);
+    return 0;
 }
 
 /* int32_t read_dentry_by_name(const int8_t* fname, dentry_t* dentry)
- * Description: copies a files info to *dentry
- * Input: fname - file to read about
+ * Description: copies a files info to *dentry, walking a '/' separated path
+ *              from the root directory
+ * Input: fname - path of the file to read about
  *        dentry - dentry_t to store the file info
  * Output: 0 for success, -1 on error
  * Side Effects: reads from the filesystem
  */
 int32_t read_dentry_by_name(const int8_t* fname, dentry_t* dentry) {
-    uint32_t i;
-    if ((i = get_index(fname)) != (uint32_t)-1)
-        return read_dentry_by_index(i, dentry);
-    else
+    uint32_t dir = ROOT_DIR_INODE;
+    const int8_t* p = fname;
+
+    if (*p == '\0') {
         return -1;
+    }
+    while (*p == '/') p++;
+
+    // The path names the root directory itself
+    if (*p == '\0') {
+        memset(dentry, 0, sizeof(dentry_t));
+        dentry->name[0] = '.';
+        dentry->type = FD_DIR;
+        dentry->inode = ROOT_DIR_INODE;
+        return 0;
+    }
+
+    while (true) {
+        const int8_t* component = p;
+        while (*p != '/' && *p != '\0') p++;
+
+        if (lookup_in_dir(dir, component, p - component, dentry) != 0) {
+            return -1;
+        }
+
+        while (*p == '/') p++;
+        if (*p == '\0') {
+            return 0;
+        }
+
+        // There are more components so this one has to be a directory
+        if (dentry->type != FD_DIR) {
+            return -1;
+        }
+        dir = dentry->inode;
+    }
 }
@@ -2,9 +2,16 @@
 #define FILESYSTEM_H_
 
 #include "types.h"
+#include "blkdev.h"
+#include "schedule.h"
 
 #define BLOCK_SIZE 4096
 
+// Directory dentries pointing at inode 0 refer to the root directory, whose
+// entries live in the boot block. Every other directory is an inode whose
+// data blocks hold an array of dentry_t.
+#define ROOT_DIR_INODE 0
+
 typedef struct dentry {
     int8_t name[32];
     int32_t type;
@@ -12,14 +19,42 @@ typedef struct dentry {
     int8_t reserved[24];
 } dentry_t;
 
+// Layout hints written by buildfs into the boot block's reserved bytes.
+// Images without the magic get the plain linear directory scan.
+#define FS_LAYOUT_MAGIC 0x53463933
+#define FS_FLAG_SORTED 0x1    // every directory's dentries are sorted by name
+#define FS_FLAG_HASH 0x2      // hash_block holds the root name hash table
+#define FS_HASH_SLOTS 256     // uint8_t slots, root dentry index + 1, 0 is empty
+
 typedef struct boot_block {
     uint32_t num_dentries;
     uint32_t num_inodes;
     uint32_t num_data_blocks;
-    int8_t reserved[52];
+    uint32_t layout_magic;
+    uint32_t layout_flags;
+    uint32_t hash_block;
+    int8_t reserved[40];
     dentry_t dentries[63];
 } boot_block_t;
 
+// Compressed images (buildfs -z) start with this header, followed by one
+// fsz_block_t per block of the uncompressed image and then the block data.
+#define FSZ_MAGIC 0x315A5346  // "FSZ1"
+
+typedef struct fsz_header {
+    uint32_t magic;
+    // Number of blocks in the uncompressed image, boot block included
+    uint32_t num_blocks;
+    uint32_t reserved[2];
+} fsz_header_t;
+
+typedef struct fsz_block {
+    // Byte offset of the block data from the start of the image
+    uint32_t offset;
+    // BLOCK_SIZE: stored uncompressed, 0: all zeroes, else LZ4 compressed size
+    uint32_t length;
+} fsz_block_t;
+
 typedef struct inode {
     uint32_t length;
     uint32_t block_nums[BLOCK_SIZE / 4 - 1];
@@ -34,25 +69,39 @@ typedef struct fstat {
     uint32_t size;
 }fstat_t;
 
+// One record written by sys_getdents. Layout is shared with user space.
+typedef struct dirent {
+    int8_t name[32];
+    uint32_t type;
+    uint32_t inode;
+    uint32_t size;
+} dirent_t;
+
 //intializes the filesystem and its operations
 extern void file_system_init(void* start, void* end);
 
-//copies a files info to *dentry
+//switches the filesystem to an image on a block device
+extern int32_t file_system_mount(blkdev_t* dev);
+
+//copies a files info to *dentry, fname is a '/' separated path
 extern int32_t read_dentry_by_name(const int8_t* fname, dentry_t* dentry);
 
-//Copies a file information to *dentry
+//Copies a file information from the root directory to *dentry
 extern int32_t read_dentry_by_index(uint32_t index, dentry_t* dentry);
 
+//Copies the index'th entry of directory dir to *dentry
+extern int32_t read_dir_entry(uint32_t dir, uint32_t index, dentry_t* dentry);
+
 //reads file data into buf
 extern int32_t read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length);
 
 //reads a file name from a directory
-extern int32_t read_dir_data(uint32_t index, uint8_t* buf, uint32_t length);
+extern int32_t read_dir_data(uint32_t dir, uint32_t index, uint8_t* buf, uint32_t length);
 
 // reads data from a file
 extern int32_t read_data_by_inode(inode_t* inode, uint32_t offset, uint8_t* buf, uint32_t length);
 
-// gets index of a file in the directory
+// gets index of a file in the root directory
 extern uint32_t get_index(const int8_t* fname);
 
 //returns size of a file
@@ -72,5 +121,19 @@ extern int32_t filesys_write(int32_t fd, const void* buf, int32_t nbytes);
 
 // writes file stats to buf
 extern int32_t filesys_stat(int32_t fd, void* buf, int32_t nbytes);
+//files are always ready to read
+extern int32_t filesys_poll(int32_t fd, wait_queue_t** wait);
+
+// moves the position of a file or directory
+extern int32_t filesys_lseek(int32_t fd, int32_t offset, int32_t whence);
+
+// reads from a file at an offset without moving its position
+extern int32_t filesys_pread(int32_t fd, void* buf, int32_t nbytes, uint32_t offset);
+
+// fills buf with as many directory records as fit
+extern int32_t filesys_getdents(int32_t fd, void* buf, int32_t nbytes);
+
+// writes up to count bytes of file in_fd to out_fd without a user buffer
+extern int32_t filesys_sendfile(int32_t out_fd, int32_t in_fd, int32_t count);
 
 #endif
@@ -0,0 +1,126 @@
+/* futex.c - Sleeping on user memory words
+ */
+
+#include "futex.h"
+#include "lib.h"
+#include "page.h"
+#include "task.h"
+#include "schedule.h"
+
+static wait_queue_t futex_queues[FUTEX_HASH_SIZE];
+// Physical address each task is waiting on, 0 if none. Several addresses
+// can share a queue, so wakers check this.
+static uint32_t futex_keys[NUM_TASKS];
+
+/* wait_queue_t* futex_queue(uint32_t key)
+ * Description: Picks the queue for a physical address
+ * Input:  key - physical address of the word
+ * Output: the queue
+ * Side Effects: none
+ */
+static wait_queue_t* futex_queue(uint32_t key) {
+    return &futex_queues[((key >> 2) ^ (key >> 12)) % FUTEX_HASH_SIZE];
+}
+
+/* int32_t futex_wait(uint32_t* addr, uint32_t key, int32_t val)
+ * Description: Sleeps until a FUTEX_WAKE on the same word, unless the word
+ *              has already changed from val
+ * Input:  addr - user address of the word
+ *         key - physical address of the word
+ *         val - value the caller last saw in the word
+ * Output: -1 if the word did not hold val, 0 once woken
+ * Side Effects: sleeps
+ */
+static int32_t futex_wait(uint32_t* addr, uint32_t key, int32_t val) {
+    uint32_t flags;
+
+    // The check and the sleep have to happen with interrupts off, or a
+    // wake between them is lost
+    cli_and_save(flags);
+    if (*addr != (uint32_t)val) {
+        restore_flags(flags);
+        return -1;
+    }
+    futex_keys[cur_task] = key;
+    sleep_on(futex_queue(key));
+    futex_keys[cur_task] = 0;
+    restore_flags(flags);
+    return 0;
+}
+
+/* int32_t futex_wake(uint32_t key, int32_t val)
+ * Description: Wakes up to val tasks waiting on a word
+ * Input:  key - physical address of the word
+ *         val - maximum number of tasks to wake
+ * Output: the number of tasks woken
+ * Side Effects: changes task status
+ */
+static int32_t futex_wake(uint32_t key, int32_t val) {
+    wait_queue_t *queue = futex_queue(key);
+    uint32_t flags;
+    int32_t woken = 0;
+    int32_t i;
+
+    cli_and_save(flags);
+    for (i = 0; i < NUM_TASKS && woken < val; i++) {
+        if ((queue->tasks & (1 << i)) && futex_keys[i] == key) {
+            queue->tasks &= ~(1 << i);
+            if (tasks[i]->status == TASK_SLEEPING) {
+                tasks[i]->status = TASK_RUNNING;
+            }
+            woken++;
+        }
+    }
+    restore_flags(flags);
+    return woken;
+}
+
+/* int32_t sys_futex(uint32_t* addr, int32_t op, int32_t val)
+ * Description: FUTEX_WAIT sleeps while *addr == val. FUTEX_WAKE wakes up to
+ *              val tasks sleeping on addr. Waiters are matched by physical
+ *              address, so threads and tasks sharing memory through shm
+ *              both work.
+ * Input:  addr - 4 byte aligned word in user memory
+ *         op - FUTEX_WAIT or FUTEX_WAKE
+ *         val - expected value or number of tasks to wake
+ * Output: -1 on error or if the word changed, 0 after a wait, otherwise the
+ *         number of tasks woken
+ * Side Effects: may sleep or wake tasks
+ */
+int32_t sys_futex(uint32_t* addr, int32_t op, int32_t val) {
+    if ((uint32_t)addr & 3) {
+        return -1;
+    }
+    uint32_t key = user_phys_addr(cur_task, (uint32_t)addr);
+    if (key == 0) {
+        return -1;
+    }
+
+    switch (op) {
+    case FUTEX_WAIT:
+        return futex_wait(addr, key, val);
+    case FUTEX_WAKE:
+        return futex_wake(key, val);
+    default:
+        return -1;
+    }
+}
+
+/* void futex_release(uint32_t task)
+ * Description: Takes a task off every queue, for tasks that end without
+ *              returning from futex_wait
+ * Input:  task - task being killed
+ * Output: none
+ * Side Effects: modifies the futex queues
+ */
+void futex_release(uint32_t task) {
+    uint32_t flags;
+    int32_t i;
+
+    cli_and_save(flags);
+    for (i = 0; i < FUTEX_HASH_SIZE; i++) {
+        futex_queues[i].tasks &= ~(1 << task);
+    }
+    futex_keys[task] = 0;
+    restore_flags(flags);
+}
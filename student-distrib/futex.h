@@ -0,0 +1,21 @@
+/* futex.h - Sleeping on user memory words
+ */
+
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include "types.h"
+
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+
+// Waiters are spread over this many queues by physical address
+#define FUTEX_HASH_SIZE 16
+
+// Waits while *addr == val, or wakes up to val waiters on addr
+extern int32_t sys_futex(uint32_t* addr, int32_t op, int32_t val);
+
+// Forgets a task that was killed while it may have been waiting
+extern void futex_release(uint32_t task);
+
+#endif
@@ -4,6 +4,7 @@
 
 #include "i8259.h"
 #include "lib.h"
+#include "apic.h"
 
 /* Interrupt masks to determine which interrupts
  * are enabled and disabled */
@@ -11,10 +12,12 @@ uint8_t master_mask = 0xFF; /* IRQs 0-7 */
 uint8_t slave_mask = 0xFF; /* IRQs 8-15 */
 
 /* void i8259_init()
- * Decription: Initialize the 8259 PIC
+ * Decription: Initialize the 8259 PIC. If an APIC is found it delivers
+ *             interrupts instead and the PICs stay fully masked. The
+ *             functions below then go to the APIC.
  * input: none
  * output: none
- * Side effects: writes to the PIC
+ * Side effects: writes to the PIC, may enable the APIC
  */
 void
 i8259_init(void)
@@ -35,6 +38,8 @@ i8259_init(void)
     //Reset interrupts to previous state
     outb(master_mask, MASTER_8259_PORT + 1);
     outb(slave_mask, SLAVE_8259_PORT + 1);
+
+    apic_init();
 }
 
 /* void enable_irq(uint32_t irq_num)
@@ -46,7 +51,9 @@ i8259_init(void)
 void
 enable_irq(uint32_t irq_num)
 {
-    if(irq_num < 8){ //Line on master
+    if(apic_active){
+        apic_enable_irq(irq_num);
+    }else if(irq_num < 8){ //Line on master
         //Disable bit #irq_num
         master_mask &= ~(1 << irq_num);
         outb(master_mask, MASTER_8259_PORT + 1);
@@ -66,7 +73,9 @@ enable_irq(uint32_t irq_num)
 void
 disable_irq(uint32_t irq_num)
 {
-    if(irq_num < 8){ //Line on master
+    if(apic_active){
+        apic_disable_irq(irq_num);
+    }else if(irq_num < 8){ //Line on master
         // Enable bit #irq_num
         master_mask |= (1 << irq_num);
         outb(master_mask, MASTER_8259_PORT + 1);
@@ -77,15 +86,19 @@ disable_irq(uint32_t irq_num)
     }
 }
 
-/* void disable_irq(uint32_t irq_num)
+/* void send_eoi(uint32_t irq_num)
  * Decription: Send end-of-interrupt signal for the specified IRQ
  * input: irq_num - line to send eoi for
  * output: none
- * Side effects: writes to the PIC
+ * Side effects: writes to the PIC or the local APIC
  */
 void
 send_eoi(uint32_t irq_num)
 {
+    if(apic_active){ //one write, whichever line it was
+        apic_eoi();
+        return;
+    }
     outb(EOI | irq_num, MASTER_8259_PORT);
     //EOI | irq_num tells the PIC that irq_num was handled
     if(irq_num >= 0x8){ //tell the slave that the interrupt was handled
@@ -93,3 +106,19 @@ send_eoi(uint32_t irq_num)
         outb(EOI | 2, MASTER_8259_PORT);
     }
 }
+
+/* uint32_t irq_vector(uint32_t irq_num)
+ * Decription: Gives the vector the specified IRQ is delivered on, which
+ *             depends on whether the PICs or the APIC are in use
+ * input: irq_num - line to look up
+ * output: the IDT vector
+ * Side effects: none
+ */
+uint32_t
+irq_vector(uint32_t irq_num)
+{
+    if(apic_active){
+        return apic_vector(irq_num);
+    }
+    return ICW2_MASTER + irq_num;
+}
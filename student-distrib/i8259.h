@@ -29,7 +29,7 @@
 
 /* Externally-visible functions */
 
-/* Initialize both PICs */
+/* Initialize both PICs, then switch to the APIC if there is one */
 void i8259_init(void);
 /* Enable (unmask) the specified IRQ */
 void enable_irq(uint32_t irq_num);
@@ -37,5 +37,7 @@ void enable_irq(uint32_t irq_num);
 void disable_irq(uint32_t irq_num);
 /* Send end-of-interrupt signal for the specified IRQ */
 void send_eoi(uint32_t irq_num);
+/* Vector the specified IRQ is delivered on */
+uint32_t irq_vector(uint32_t irq_num);
 
 #endif /* _I8259_H */
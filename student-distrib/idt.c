@@ -1,9 +1,19 @@
 #include "idt.h"
+#include "entry.h"
 #include "i8259.h"
 #include "lib.h"
 #include "task.h"
 #include "system_calls.h"
 #include "page.h"
+#include "x86_desc.h"
+#include "signals.h"
+
+#define SLAVE_CASCADE_IRQ 2
+
+static void (*irq_stubs[NR_IRQS])() = {
+    irq_0x0, irq_0x1, irq_0x2, irq_0x3, irq_0x4, irq_0x5, irq_0x6, irq_0x7,
+    irq_0x8, irq_0x9, irq_0xA, irq_0xB, irq_0xC, irq_0xD, irq_0xE, irq_0xF
+};
 
 
 /* hang
@@ -35,7 +45,7 @@ void handle_exception(int8_t *exc_str, uint32_t err_val) {
     } else {
         printf("\n%s ", exc_str);
         printf("0x%#x\n", err_val);
-        SET_SIGNAL(cur_task, SEGFAULT);
+        send_signal(cur_task, SEGFAULT);
     }
 }
 
@@ -75,7 +85,7 @@ void do_divide_error(hw_context_t* hw_context) {
     } else {
         printf("\ndivide error ");
         printf("0x%#x\n", hw_context->iret_context.eip);
-        SET_SIGNAL(cur_task, DIV_ZERO);
+        send_signal(cur_task, DIV_ZERO);
     }
 }
 void do_page_fault(hw_context_t* hw_context, uint32_t error) {
@@ -116,7 +126,7 @@ void do_page_fault(hw_context_t* hw_context, uint32_t error) {
     if (cur_task == 0) {
         hang();
     } else {
-        SET_SIGNAL(cur_task, SEGFAULT);
+        send_signal(cur_task, SEGFAULT);
     }
 }
 
@@ -135,3 +145,36 @@ __attribute__((fastcall)) void do_IRQ(hw_context_t* hw_context) {
         irq_p = irq_p->next;
     }
 }
+
+/* int32_t request_irq(uint32_t irq, irqaction* action)
+ * Description: appends a handler to an irq line so lines can be shared,
+ *              installs the line's interrupt gate and unmasks it
+ * Input:  irq - PIC line
+ *         action - handler and dev_id, must stay allocated
+ * Output: 0 on success, -1 for an invalid line
+ * Side Effects: modifies irq_desc, the IDT and the PIC masks
+ */
+int32_t request_irq(uint32_t irq, irqaction* action) {
+    if (irq >= NR_IRQS || action == NULL) {
+        return -1;
+    }
+
+    uint32_t flags;
+    cli_and_save(flags);
+
+    action->next = NULL;
+    irqaction **p = &irq_desc[irq];
+    while (*p) {
+        p = &(*p)->next;
+    }
+    *p = action;
+
+    set_intr_gate(irq_vector(irq), irq_stubs[irq]);
+    if (irq >= 8) {
+        enable_irq(SLAVE_CASCADE_IRQ);
+    }
+    enable_irq(irq);
+
+    restore_flags(flags);
+    return 0;
+}
@@ -17,4 +17,7 @@ irqaction *irq_desc[NR_IRQS];
 
 __attribute__((fastcall)) extern void do_IRQ(hw_context_t* hw_context);
 
+// adds a handler to an irq line, installs its gate and unmasks it
+extern int32_t request_irq(uint32_t irq, irqaction* action);
+
 #endif
@@ -0,0 +1,236 @@
+/* irqsoff.c - Measures how long interrupts stay off
+ *
+ * Only built with IRQSOFF_TRACE. Every stretch between a cli that turned
+ * interrupts off and the sti or restore_flags that turned them back on is
+ * timed with the TSC. Interrupt handlers run with interrupts off from the
+ * moment the gate is taken, which is not counted here.
+ */
+
+#ifdef IRQSOFF_TRACE
+
+#include "irqsoff.h"
+#include "lib.h"
+
+file_ops_t irqsoff_ops;
+
+// The section in progress
+static bool in_section;
+static uint32_t begin_tsc;
+static const int8_t* begin_file;
+static uint32_t begin_line;
+
+// Longest first
+static irqsoff_section_t top[IRQSOFF_TOP];
+static uint32_t histogram[IRQSOFF_BUCKETS];
+
+// Report handed out by irqsoff_read, rebuilt on every read
+#define REPORT_SIZE 2048
+static int8_t report[REPORT_SIZE];
+
+/* void irqsoff_begin(const int8_t* file, uint32_t line)
+ * Description: Starts timing a section. Interrupts are already off.
+ * Input:  file, line - where they were turned off
+ * Output: none
+ * Side Effects: none
+ */
+void irqsoff_begin(const int8_t* file, uint32_t line) {
+    begin_file = file;
+    begin_line = line;
+    in_section = true;
+    begin_tsc = rdtsc();
+}
+
+/* void irqsoff_end(const int8_t* file, uint32_t line)
+ * Description: Records the section in progress, if there is one. Interrupts
+ *              are still off.
+ * Input:  file, line - where they are being turned on
+ * Output: none
+ * Side Effects: updates the histogram and the longest sections
+ */
+void irqsoff_end(const int8_t* file, uint32_t line) {
+    uint32_t cycles = rdtsc() - begin_tsc;
+    int32_t i;
+
+    if (!in_section) {
+        return;
+    }
+    in_section = false;
+
+    for (i = IRQSOFF_BUCKETS - 1; i > 0 && !(cycles & (1U << i)); i--);
+    histogram[i]++;
+
+    if (cycles <= top[IRQSOFF_TOP - 1].cycles) {
+        return;
+    }
+    for (i = IRQSOFF_TOP - 1; i > 0 && top[i - 1].cycles < cycles; i--) {
+        top[i] = top[i - 1];
+    }
+    top[i].cycles = cycles;
+    top[i].begin_file = begin_file;
+    top[i].begin_line = begin_line;
+    top[i].end_file = file;
+    top[i].end_line = line;
+}
+
+/* void irqsoff_iret()
+ * Description: Ends the section in progress when a system call irets back
+ *              to user space, which turns interrupts on without sti
+ * Input:  none
+ * Output: none
+ * Side Effects: same as irqsoff_end
+ */
+void irqsoff_iret() {
+    irqsoff_end((const int8_t*)"iret", 0);
+}
+
+/* void append(int8_t* s, uint32_t* len)
+ * Description: Adds a string to the report
+ * Input:  s - string to add
+ *         len - length of the report so far
+ * Output: none
+ * Side Effects: writes to report, cuts s off if it does not fit
+ */
+static void append(const int8_t* s, uint32_t* len) {
+    while (*s != '\0' && *len < REPORT_SIZE - 1) {
+        report[(*len)++] = *s++;
+    }
+    report[*len] = '\0';
+}
+
+/* void append_num(uint32_t value, uint32_t* len)
+ * Description: Adds a number in decimal to the report
+ * Input:  value - number to add
+ *         len - length of the report so far
+ * Output: none
+ * Side Effects: writes to report
+ */
+static void append_num(uint32_t value, uint32_t* len) {
+    int8_t buf[11];
+    append(itoa(value, buf, 10), len);
+}
+
+/* uint32_t build_report()
+ * Description: Writes the longest sections and the histogram to report
+ * Input:  none
+ * Output: length of the report
+ * Side Effects: writes to report
+ */
+static uint32_t build_report() {
+    irqsoff_section_t sections[IRQSOFF_TOP];
+    uint32_t counts[IRQSOFF_BUCKETS];
+    uint32_t flags;
+    uint32_t len = 0;
+    uint32_t i;
+
+    // Copy the stats out first so the report is consistent. This stretch
+    // is not counted itself.
+    raw_cli_and_save(flags);
+    memcpy(sections, top, sizeof(top));
+    memcpy(counts, histogram, sizeof(histogram));
+    raw_restore_flags(flags);
+
+    append((int8_t*)"longest sections with interrupts off, in cycles:\n", &len);
+    for (i = 0; i < IRQSOFF_TOP && sections[i].cycles != 0; i++) {
+        append_num(sections[i].cycles, &len);
+        append((int8_t*)" ", &len);
+        append(sections[i].begin_file, &len);
+        append((int8_t*)":", &len);
+        append_num(sections[i].begin_line, &len);
+        append((int8_t*)" -> ", &len);
+        append(sections[i].end_file, &len);
+        append((int8_t*)":", &len);
+        append_num(sections[i].end_line, &len);
+        append((int8_t*)"\n", &len);
+    }
+
+    append((int8_t*)"histogram, cycles from: count\n", &len);
+    for (i = 0; i < IRQSOFF_BUCKETS; i++) {
+        if (counts[i] != 0) {
+            append_num(1U << i, &len);
+            append((int8_t*)": ", &len);
+            append_num(counts[i], &len);
+            append((int8_t*)"\n", &len);
+        }
+    }
+    return len;
+}
+
+/* int32_t irqsoff_open(const int8_t* filename)
+ * Description: Opens /dev/irqsoff
+ * Input:  filename - unused
+ * Output: 0
+ * Side Effects: none
+ */
+static int32_t irqsoff_open(const int8_t* filename) {
+    return 0;
+}
+
+/* int32_t irqsoff_close(int32_t fd)
+ * Description: Closes /dev/irqsoff
+ * Input:  fd - unused
+ * Output: 0
+ * Side Effects: none
+ */
+static int32_t irqsoff_close(int32_t fd) {
+    return 0;
+}
+
+/* int32_t irqsoff_read(int32_t fd, void* buf, int32_t nbytes)
+ * Description: Reads the report as text from the fd's position on
+ * Input:  fd - index of the open /dev/irqsoff
+ *         buf - buffer to read into
+ *         nbytes - max bytes to read
+ * Output: bytes read, 0 at the end of the report, -1 if buf is bad
+ * Side Effects: advances file_pos
+ */
+static int32_t irqsoff_read(int32_t fd, void* buf, int32_t nbytes) {
+    file_desc_t* desc = &tasks[cur_task]->file_descs[fd];
+    if (buf == NULL || nbytes < 0) {
+        return -1;
+    }
+
+    uint32_t len = build_report();
+    if ((uint32_t)desc->file_pos >= len) {
+        return 0;
+    }
+    if ((uint32_t)nbytes > len - desc->file_pos) {
+        nbytes = len - desc->file_pos;
+    }
+    memcpy(buf, report + desc->file_pos, nbytes);
+    desc->file_pos += nbytes;
+    return nbytes;
+}
+
+/* int32_t irqsoff_write(int32_t fd, const void* buf, int32_t nbytes)
+ * Description: Clears everything recorded so far
+ * Input:  fd - unused
+ *         buf - unused
+ *         nbytes - returned as written
+ * Output: nbytes
+ * Side Effects: clears the histogram and the longest sections
+ */
+static int32_t irqsoff_write(int32_t fd, const void* buf, int32_t nbytes) {
+    uint32_t flags;
+
+    raw_cli_and_save(flags);
+    memset(top, 0, sizeof(top));
+    memset(histogram, 0, sizeof(histogram));
+    raw_restore_flags(flags);
+    return nbytes;
+}
+
+/* void irqsoff_init()
+ * Description: Sets up the file operations of /dev/irqsoff
+ * Input:  none
+ * Output: none
+ * Side Effects: none
+ */
+void irqsoff_init() {
+    irqsoff_ops.open = irqsoff_open;
+    irqsoff_ops.close = irqsoff_close;
+    irqsoff_ops.read = irqsoff_read;
+    irqsoff_ops.write = irqsoff_write;
+    irqsoff_ops.stat = default_stat;
+}
+
+#endif
@@ -0,0 +1,40 @@
+/* irqsoff.h - Measures how long interrupts stay off
+ */
+
+#ifndef IRQSOFF_H
+#define IRQSOFF_H
+
+#include "types.h"
+#include "task.h"
+
+// Longest sections kept
+#define IRQSOFF_TOP 8
+// Bucket i of the histogram counts sections of 2^i to 2^(i+1) - 1 cycles
+#define IRQSOFF_BUCKETS 32
+
+typedef struct irqsoff_section {
+    uint32_t cycles;
+    // Where interrupts were turned off and back on
+    const int8_t* begin_file;
+    uint32_t begin_line;
+    const int8_t* end_file;
+    uint32_t end_line;
+} irqsoff_section_t;
+
+// Read for a report of the longest sections and the histogram, write
+// anything to start over
+extern file_ops_t irqsoff_ops;
+
+// Called by cli and cli_and_save when they turn interrupts off
+extern void irqsoff_begin(const int8_t* file, uint32_t line);
+
+// Called by sti and restore_flags before they turn interrupts on
+extern void irqsoff_end(const int8_t* file, uint32_t line);
+
+// Called on the way out of a system call, which irets with interrupts on
+extern void irqsoff_iret();
+
+// Sets up the file operations of /dev/irqsoff
+extern void irqsoff_init();
+
+#endif
@@ -3,6 +3,8 @@
 #include "i8259.h"
 #include "schedule.h"
 #include "task.h"
+#include "signals.h"
+#include "spinlock.h"
 
 #define SET(s,r,c) case s: kbd_state.row = r; kbd_state.col = c; break
 
@@ -10,11 +12,19 @@ static bool e0_waiting = false;
 static bool kbd_ready = false;
 static bool caps_held = false;
 
-static uint32_t write_index[NUM_TERM];
-static uint32_t read_index[NUM_TERM];
-static bool buffer_full[NUM_TERM];
+// Single producer/single consumer ring of events for each terminal. Only
+// _kbd_do_irq writes head and only the terminal's reader writes tail, so
+// neither side needs a lock. Both indices count up forever and are masked
+// when used.
+typedef struct kbd_ring {
+    kbd_event_t events[KBD_RING_SIZE];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    // Readers sleeping until the ring is not empty
+    wait_queue_t wait;
+} kbd_ring_t;
 
-static kbd_t kbd_buffer[NUM_TERM][KBD_BUFFER_SIZE];
+static kbd_ring_t kbd_rings[NUM_TERM];
 
 // Current kbd state
 kbd_t kbd_state;
@@ -242,51 +252,53 @@ void _kbd_do_irq(int dev_id) {
         break;
     }
 
-    tasks[term_process[active]]->status = TASK_RUNNING;
-    interupt_preempt = true;
+    e0_waiting = false;
+
+    // Shift+PgUp/PgDn page through the scrollback and any other key returns to the bottom
+    if (kbd_state.shift && (kbd_equal(kbd_state, PGUP_KEY) || kbd_equal(kbd_state, PGDN_KEY))) {
+        scrollback_view(active, kbd_equal(kbd_state, PGUP_KEY) ? 1 : -1);
+        return;
+    } else if (kbd_state.state & 0xFF) {
+        scrollback_reset(active);
+    }
 
     int f;
     for (f = 0; f < NUM_TERM; f++) {
         if (kbd_equal(kbd_state, f + F1_KEY)) {
             update_screen(f);
-            break;
+            return;
         }
     }
 
     if (kbd_to_ascii(kbd_state) == 'c' && kbd_state.ctrl) {
-        SET_SIGNAL(term_process[active], INTERRUPT);
+        send_signal(term_process[active], INTERRUPT);
     } else {
-        // If buffer isn't full and a key is pressed
-        if(!buffer_full[active] && kbd_state.state & 0xFF) {
-
-            // Write key to buffer
-            kbd_buffer[active][write_index[active]] = kbd_state;
-            // Increment write_index
-            write_index[active] = (write_index[active] + 1)%KBD_BUFFER_SIZE;
-
-            // If buffer full, disable writing
-            if (write_index[active] == read_index[active])
-                buffer_full[active] = true;
+        // Queue the event unless the reader has fallen a whole ring behind
+        kbd_ring_t *ring = &kbd_rings[active];
+        uint32_t head = ring->head;
+        if (head - ring->tail < KBD_RING_SIZE) {
+            kbd_event_t *event = &ring->events[head & KBD_RING_MASK];
+            event->scancode = scanCode;
+            event->key = kbd_state;
+            event->time = rdtsc();
+            // The event has to be written before the reader can see it
+            barrier();
+            ring->head = head + 1;
         }
+        wake_up(&ring->wait);
+    }
+
+    // Run the foreground task next so it sees the key quickly, on the way
+    // out of this interrupt rather than at the next tick
+    if (tasks[term_process[active]]->status == TASK_RUNNING) {
+        interupt_preempt = true;
+        need_resched = 1;
     }
 
-    e0_waiting = false;
     //Ready to read if key is pressed
     kbd_ready = true;
 }
 
-/* void kbd_clear()
- * Decription: Clears the kbd buffer of the current program
- * input: none
- * output: none
- * Side effects: Writes to the kbd buffer
- */
-void kbd_clear() {
-    write_index[TASK_T] = 0;
-    read_index[TASK_T] = 0;
-    buffer_full[TASK_T] = false;
-}
-
 /* void kbd_init(irqaction* keyboard_handler)
  * Decription: Clears the kbd buffer of the current program
  * input: keyboard_handler - pointer to irqaction struct for the kbd
@@ -302,14 +314,17 @@ void kbd_init(irqaction* keyboard_handler) {
     kbd_ops.close = kbd_close;
     kbd_ops.read = kbd_read;
     kbd_ops.write = kbd_write;
+    kbd_ops.ioctl = kbd_ioctl;
+    kbd_ops.poll = kbd_poll_fd;
 
     irq_desc[0x1] = keyboard_handler;
     enable_irq(1);
 
     int i;
     for (i = 0; i < NUM_TERM; i++) {
-        write_index[i] = 0;
-        read_index[i] = 0;
+        kbd_rings[i].head = 0;
+        kbd_rings[i].tail = 0;
+        kbd_rings[i].wait.tasks = 0;
     }
 }
 
@@ -354,36 +369,108 @@ int32_t kbd_write(int32_t fd, const void* buf, int32_t nbytes) {
 }
 
 /* int32_t kbd_read(int32_t fd, void* buf, int32_t nbytes)
- * Decription: Reads from the keyboard
- * input: fd - ignored
- *        buf - buffer to write kbd_t structs
- *        nbytes - double the number of keys desired
+ * Decription: Reads from the keyboard. Normally fills buf with a kbd_t for
+ *             each key press. With O_RAW every press and release is returned
+ *             as a kbd_event_t. Blocks until at least one key is available
+ *             unless the fd has O_NONBLOCK set, then returns what is queued.
+ * input: fd - file descriptor, its mode is used if it is the keyboard
+ *        buf - buffer to write kbd_t or kbd_event_t structs
+ *        nbytes - size of buf, a multiple of the struct size
  * output: number of bytes written on success, -1 for invalid input
  * Side effects: sleeps for keys
  */
 int32_t kbd_read(int32_t fd, void* buf, int32_t nbytes) {
-    kbd_clear();
-    if(nbytes & 1){ //fail on odd number requested
+    kbd_ring_t *ring = &kbd_rings[TASK_T];
+    uint32_t mode = 0;
+    if (tasks[cur_task]->file_descs[fd].flags == FD_KBD) {
+        mode = tasks[cur_task]->file_descs[fd].mode;
+    }
+    int32_t size = (mode & O_RAW) ? sizeof(kbd_event_t) : sizeof(kbd_t);
+    if (buf == NULL || nbytes < size || nbytes % size != 0) {
         return -1;
     }
-    nbytes = (uint32_t)nbytes > sizeof(kbd_t)*KBD_BUFFER_SIZE ? sizeof(kbd_t)*KBD_BUFFER_SIZE : nbytes;
+
     int32_t i = 0;
-    while(i < nbytes){
-        if(read_index[TASK_T] != write_index[TASK_T] || buffer_full[TASK_T] == true){
-            //read a key from the buffer
-            *((kbd_t*)buf) = kbd_buffer[TASK_T][read_index[TASK_T]];
-            read_index[TASK_T] = (read_index[TASK_T] + 1)%KBD_BUFFER_SIZE;
-            i += sizeof(kbd_t);
-            buffer_full[TASK_T] = false;
-        } else {
-            //Nothing to read, ask to be woken up and reschedule
+    uint32_t flags;
+    while (i < nbytes) {
+        uint32_t tail = ring->tail;
+        if (tail == ring->head) {
+            if (i > 0 || (mode & O_NONBLOCK)) {
+                break;
+            }
+            //Nothing to read, sleep until the interrupt handler queues a key
+            cli_and_save(flags);
             term_process[TASK_T] = cur_task;
-            reschedule();
+            if (ring->tail == ring->head) {
+                sleep_on(&ring->wait);
+            }
+            restore_flags(flags);
+            continue;
+        }
+
+        kbd_event_t *event = &ring->events[tail & KBD_RING_MASK];
+        if (mode & O_RAW) {
+            memcpy((uint8_t *)buf + i, event, size);
+            i += size;
+        } else if (event->key.state & 0xFF) {
+            *(kbd_t *)((uint8_t *)buf + i) = event->key;
+            i += size;
         }
+        // Finish with the slot before handing it back to the interrupt handler
+        barrier();
+        ring->tail = tail + 1;
     }
     return i;
 }
 
+/* int32_t kbd_poll_terminal(uint32_t mode, wait_queue_t** wait)
+ * Decription: Checks whether a keyboard read on the current terminal would
+ *             return without sleeping
+ * input: mode - mode of the reading fd, O_RAW counts releases too
+ *        wait - set to the queue woken when a key is queued
+ * output: POLLIN if a key is waiting, otherwise 0
+ * Side effects: none
+ */
+int32_t kbd_poll_terminal(uint32_t mode, wait_queue_t** wait) {
+    kbd_ring_t *ring = &kbd_rings[TASK_T];
+    uint32_t i;
+
+    *wait = &ring->wait;
+    for (i = ring->tail; i != ring->head; i++) {
+        if ((mode & O_RAW) || (ring->events[i & KBD_RING_MASK].key.state & 0xFF)) {
+            return POLLIN;
+        }
+    }
+    return 0;
+}
+
+/* int32_t kbd_poll_fd(int32_t fd, wait_queue_t** wait)
+ * Decription: poll op for /dev/kbd
+ * input: fd - keyboard fd
+ *        wait - set to the queue woken when a key is queued
+ * output: POLLIN if a read would not sleep, otherwise 0
+ * Side effects: none
+ */
+int32_t kbd_poll_fd(int32_t fd, wait_queue_t** wait) {
+    return kbd_poll_terminal(tasks[cur_task]->file_descs[fd].mode, wait);
+}
+
+/* int32_t kbd_ioctl(int32_t fd, uint32_t request, uint32_t arg)
+ * Decription: Handles keyboard specific ioctl requests
+ * input: fd - ignored
+ *        request - KBD_FLUSH to throw away queued keys
+ *        arg - ignored
+ * output: 0 for success, -1 for an unknown request
+ * Side effects: may empty the terminal's ring
+ */
+int32_t kbd_ioctl(int32_t fd, uint32_t request, uint32_t arg) {
+    if (request != KBD_FLUSH) {
+        return -1;
+    }
+    kbd_rings[TASK_T].tail = kbd_rings[TASK_T].head;
+    return 0;
+}
+
 /* int8_t kbd_to_ascii(kbd_t key)
  * Decription: Converts kbd_t to an ascii char
  * input: key - kbd_t to be translated
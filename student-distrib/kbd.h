@@ -8,6 +8,9 @@
 #include "task.h"
 
 #define KBD_BUFFER_SIZE 128
+// Events kept per terminal, a power of two so the ring indices can be masked
+#define KBD_RING_SIZE 256
+#define KBD_RING_MASK (KBD_RING_SIZE - 1)
 
 enum kbd_layout {
     QWERTY = 0,
@@ -34,6 +37,16 @@ typedef struct kbd {
     };
 } kbd_t;
 
+// One key press or release, returned as is by raw mode reads
+typedef struct kbd_event {
+    // Scancode from the keyboard, 0xE0xx for extended keys. Bit 7 is set on release
+    uint16_t scancode;
+    // Keyboard state after the scancode
+    kbd_t key;
+    // Low 32 bits of the time stamp counter when the interrupt arrived
+    uint32_t time;
+} kbd_event_t;
+
 file_ops_t kbd_ops;
 
 // Initialize the KBD handler
@@ -63,6 +76,16 @@ extern int32_t kbd_close(int32_t fd);
 extern int32_t kbd_read(int32_t fd, void* buf, int32_t nbytes);
 //Write to keyboard - fails
 extern int32_t kbd_write(int32_t fd, const void* buf, int32_t nbytes);
+//Keyboard specific ioctl requests
+extern int32_t kbd_ioctl(int32_t fd, uint32_t request, uint32_t arg);
+
+//Checks for keys waiting on the current terminal
+extern int32_t kbd_poll_terminal(uint32_t mode, wait_queue_t** wait);
+//poll op for the keyboard
+extern int32_t kbd_poll_fd(int32_t fd, wait_queue_t** wait);
+
+// ioctl request that throws away the events waiting on the terminal
+#define KBD_FLUSH 0x100
 
 #define ESC_KEY 0x01
 #define F1_KEY 0x02
@@ -111,6 +134,8 @@ extern int32_t kbd_write(int32_t fd, const void* buf, int32_t nbytes);
 #define UP_KEY 0x8A
 #define DOWN_KEY 0xA2
 #define DEL_KEY 0x4C
+#define PGUP_KEY 0x30
+#define PGDN_KEY 0x50
 
 
 #endif
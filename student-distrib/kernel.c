@@ -3,17 +3,21 @@
  */
 
 #include "entry.h"
+#include "filesystem.h"
 #include "idt.h"
 #include "i8259.h"
 #include "lib.h"
 #include "kbd.h"
 #include "multiboot.h"
 #include "page.h"
+#include "pipe.h"
 #include "rtc.h"
 #include "system_calls.h"
 #include "terminal.h"
 #include "task.h"
 #include "schedule.h"
+#include "virtio_blk.h"
+#include "apic.h"
 #include "x86_desc.h"
 /* Macros. */
 /* Check if the bit BIT in FLAGS is set. */
@@ -23,6 +27,29 @@
 irqaction keyboard_handler;
 irqaction rtc_handler;
 
+// Copy of the multiboot command line, the original is not mapped once paging is on
+#define CMDLINE_LEN 128
+static int8_t cmdline[CMDLINE_LEN];
+
+/* bool cmdline_has(const int8_t* option)
+ * Description: checks the kernel command line for a space separated option
+ * Input:  option - option to look for, eg. "root=virtio"
+ * Output: true if the option was given
+ * Side Effects: none
+ */
+static bool cmdline_has(const int8_t* option) {
+    uint32_t len = strlen(option);
+    int8_t* p = cmdline;
+    while (*p) {
+        if (!strncmp(p, option, len) && (p[len] == ' ' || p[len] == '\0')) {
+            return true;
+        }
+        while (*p && *p != ' ') p++;
+        while (*p == ' ') p++;
+    }
+    return false;
+}
+
 void entry (unsigned long magic, unsigned long addr) {
     multiboot_info_t *mbi;
 
@@ -38,6 +65,10 @@ void entry (unsigned long magic, unsigned long addr) {
     /* Set MBI to the address of the Multiboot information structure. */
     mbi = (multiboot_info_t *) addr;
 
+    if (CHECK_FLAG (mbi->flags, 2)) {
+        strncpy(cmdline, (int8_t*)mbi->cmdline, CMDLINE_LEN - 1);
+    }
+
     // Store pointers to the filesystem
     if (CHECK_FLAG (mbi->flags, 3)) {
         module_t* mod = (module_t*)mbi->mods_addr;
@@ -96,7 +127,7 @@ void entry (unsigned long magic, unsigned long addr) {
     switch_page_directory(INIT);
     init_paging();
 
-    /* Init the PIC */
+    /* Init the PIC, or the APIC if there is one */
     i8259_init();
 
     /* Initialize the IDT */
@@ -130,16 +161,24 @@ void entry (unsigned long magic, unsigned long addr) {
 
     // Initialize RTC, does not enable the interrupt
     rtc_init(&rtc_handler);
-    set_intr_gate(0x28, irq_0x8);
+    set_intr_gate(irq_vector(8), irq_0x8);
     //Initialize keyboard and enable it's interrupts
     kbd_init(&keyboard_handler);
-    set_intr_gate(0x21, irq_0x1);
+    set_intr_gate(irq_vector(1), irq_0x1);
 
     pit_init();
-    set_intr_gate(0x20, irq_0x0);
+    set_intr_gate(irq_vector(0), irq_0x0);
+    // reschedule() enters the timer handler with int $0x20 either way
+    set_intr_gate(ICW2_MASTER, irq_0x0);
+    set_intr_gate(APIC_SPURIOUS_VECTOR, spurious_int);
 
     lidt(idt_desc_ptr);
 
+    // Block devices. Interrupts are still off, so mounting polls the disk.
+    if (virtio_blk_init() == 0 && cmdline_has("root=virtio")) {
+        file_system_mount(blkdev_find("vda"));
+    }
+
     video_init();
     clear();
     set_cursor(0, 0);
@@ -147,6 +186,10 @@ void entry (unsigned long magic, unsigned long addr) {
     sti();
 
     terminal_init();
+    pipe_init();
+#ifdef IRQSOFF_TRACE
+    irqsoff_init();
+#endif
 
     enable_irq(0);
 
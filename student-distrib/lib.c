@@ -6,6 +6,7 @@
 #include "task.h"
 #include "page.h"
 #include "system_calls.h"
+#include "spinlock.h"
 
 #define NUM_COLS 80
 #define NUM_ROWS 25
@@ -14,10 +15,139 @@
 
 #define TAB_SIZE 4
 
+/* Character cells in one terminal page, used for the CRTC start address */
+#define TERM_CELLS (KB4 / 2)
+
+/* Rows kept per terminal, a power of two so ring indices can be masked */
+#define SCROLLBACK_ROWS 2048
+#define SCROLLBACK_MASK (SCROLLBACK_ROWS - 1)
+/* Rows moved by one Shift+PgUp/PgDn */
+#define SCROLL_STEP (NUM_ROWS / 2)
+
+/* VGA CRTC index and data ports */
+#define CRTC_INDEX 0x3D4
+#define CRTC_DATA 0x3D5
+
 static int32_t color[NUM_TERM] = {ATTRIB, ATTRIB, ATTRIB};
 static int32_t term_x[NUM_TERM];
 static int32_t term_y[NUM_TERM];
 
+/* Kernel address of the page each terminal currently draws into */
+static uint8_t *terminal_page[NUM_TERM] = {(uint8_t *)TERM_PAGE(0), (uint8_t *)TERM_PAGE(1), (uint8_t *)TERM_PAGE(2)};
+/* Bitmask of the tasks whose user video page maps each terminal */
+static uint32_t terminal_tasks[NUM_TERM];
+/* Task that has taken over VGA memory with vidmap_all, 0 if none */
+static uint32_t vga_owner;
+
+/* Each terminal's text lives in a ring of rows. The screen is the NUM_ROWS
+ * rows starting at screen_top, so scrolling only advances screen_top and
+ * everything above it is the scrollback. The terminal page is a copy of
+ * the visible window, refreshed from the rows marked dirty. */
+static uint16_t scrollback[NUM_TERM][SCROLLBACK_ROWS][NUM_COLS];
+static uint32_t screen_top[NUM_TERM];
+/* Rows the view is scrolled back from the bottom of the screen */
+static uint32_t view_back[NUM_TERM];
+/* Screen rows changed since the last blit, none if dirty_lo > dirty_hi */
+static uint32_t dirty_lo[NUM_TERM];
+static uint32_t dirty_hi[NUM_TERM];
+
+/*
+ * uint16_t *screen_row(uint32_t terminal, uint32_t y)
+ *   Inputs: terminal - terminal to look in
+ *           y - screen row
+ *   Return Value: pointer to the row's character cells
+ *   Function: Finds a screen row in the terminal's ring
+ */
+static inline uint16_t *screen_row(uint32_t terminal, uint32_t y) {
+    return scrollback[terminal][(screen_top[terminal] + y) & SCROLLBACK_MASK];
+}
+
+/*
+ * void mark_dirty(uint32_t terminal, uint32_t lo, uint32_t hi)
+ *   Inputs: terminal - terminal that changed
+ *           lo, hi - first and last screen rows that changed
+ *   Return Value: none
+ *   Function: Adds rows to the set the next blit copies to video memory
+ */
+static void mark_dirty(uint32_t terminal, uint32_t lo, uint32_t hi) {
+    if (hi >= NUM_ROWS) {
+        hi = NUM_ROWS - 1;
+    }
+    if (lo < dirty_lo[terminal]) {
+        dirty_lo[terminal] = lo;
+    }
+    if (hi > dirty_hi[terminal]) {
+        dirty_hi[terminal] = hi;
+    }
+}
+
+/*
+ * void blank_row(uint16_t *row, uint8_t col)
+ *   Inputs: row - row of character cells
+ *           col - color to clear with
+ *   Return Value: none
+ *   Function: Fills a row with spaces
+ */
+static void blank_row(uint16_t *row, uint8_t col) {
+    uint32_t i;
+    for (i = 0; i < NUM_COLS; i++) {
+        row[i] = (col << 8) | ' ';
+    }
+}
+
+/*
+ * void scroll_screen(uint32_t terminal)
+ *   Inputs: terminal - terminal to scroll
+ *   Return Value: none
+ *   Function: Moves the screen down one row of the ring, leaving the old top
+ *             row in the scrollback and a blank row at the bottom
+ */
+static void scroll_screen(uint32_t terminal) {
+    screen_top[terminal]++;
+    blank_row(screen_row(terminal, NUM_ROWS - 1), color[terminal]);
+    mark_dirty(terminal, 0, NUM_ROWS - 1);
+}
+
+/*
+ * void flush_screen(uint32_t terminal)
+ *   Inputs: terminal - terminal to update
+ *   Return Value: none
+ *   Function: Copies the dirty rows of the screen to the terminal's page.
+ *             Nothing is drawn while the view is scrolled back.
+ */
+static void flush_screen(uint32_t terminal) {
+    uint16_t *video = (uint16_t *)terminal_page[terminal];
+    uint32_t y;
+
+    if (view_back[terminal] != 0 || dirty_lo[terminal] > dirty_hi[terminal]) {
+        return;
+    }
+    for (y = dirty_lo[terminal]; y <= dirty_hi[terminal]; y++) {
+        memcpy(video + y * NUM_COLS, screen_row(terminal, y), NUM_COLS * 2);
+    }
+    dirty_lo[terminal] = NUM_ROWS;
+    dirty_hi[terminal] = 0;
+}
+
+/*
+ * void redraw_screen(uint32_t terminal)
+ *   Inputs: terminal - terminal to redraw
+ *   Return Value: none
+ *   Function: Copies the whole visible window, live or scrolled back, to
+ *             the terminal's page
+ */
+static void redraw_screen(uint32_t terminal) {
+    uint16_t *video = (uint16_t *)terminal_page[terminal];
+    uint32_t top = screen_top[terminal] - view_back[terminal];
+    uint32_t y;
+
+    for (y = 0; y < NUM_ROWS; y++) {
+        memcpy(video + y * NUM_COLS, scrollback[terminal][(top + y) & SCROLLBACK_MASK], NUM_COLS * 2);
+    }
+    dirty_lo[terminal] = NUM_ROWS;
+    dirty_hi[terminal] = 0;
+}
+
 /*
  * void video_init()
  *   Inputs: none
@@ -27,10 +157,10 @@ static int32_t term_y[NUM_TERM];
 void video_init() {
     int i, j;
     for (i = 0; i < NUM_TERM; i++) {
-        for (j = 1; j < NUM_COLS * NUM_ROWS; j++) {
-            *(terminal_video[i] + (j << 1)) = ' ';
-            *(terminal_video[i] + (j << 1) + 1) = color[i];
+        for (j = 0; j < NUM_ROWS; j++) {
+            blank_row(screen_row(i, j), color[i]);
         }
+        redraw_screen(i);
     }
 }
 
@@ -42,7 +172,7 @@ void video_init() {
  */
 uint8_t *get_video_mem() {
     if (cur_task == 0) {
-        return (uint8_t *)VIDEO;
+        return terminal_page[TASK_T];
     } else {
         return (uint8_t *)(TASK_ADDR + MB4);
     }
@@ -50,8 +180,9 @@ uint8_t *get_video_mem() {
 
 void get_video(uint8_t* buf, uint32_t startx, uint32_t starty, uint32_t length){
     uint32_t i;
+    uint32_t pos = starty * NUM_COLS + startx;
     for(i = 0; i < length; i++){
-        buf[i] = *(uint8_t *)(get_video_mem() + startx*2 + i*2 + starty*NUM_COLS*2);
+        buf[i] = screen_row(TASK_T, (pos + i) / NUM_COLS)[(pos + i) % NUM_COLS] & 0xFF;
     }
 }
 
@@ -64,10 +195,11 @@ void get_video(uint8_t* buf, uint32_t startx, uint32_t starty, uint32_t length){
  */
 void clear(void) {
     int32_t i;
-    for(i = 0; i < NUM_COLS * NUM_ROWS; i++) {
-        *(uint8_t *)(get_video_mem() + (i << 1)) = ' ';
-        *(uint8_t *)(get_video_mem() + (i << 1) + 1) = color[TASK_T];
+    for(i = 0; i < NUM_ROWS; i++) {
+        blank_row(screen_row(TASK_T, i), color[TASK_T]);
     }
+    mark_dirty(TASK_T, 0, NUM_ROWS - 1);
+    flush_screen(TASK_T);
 }
 
 void pclear(uint32_t startx, uint32_t starty, uint32_t endx, uint32_t endy){
@@ -76,9 +208,10 @@ void pclear(uint32_t startx, uint32_t starty, uint32_t endx, uint32_t endy){
     }
     int32_t i;
     for(i = startx + NUM_COLS*starty; i < NUM_COLS * endy + endx; i++) {
-        *(uint8_t *)(get_video_mem() + (i << 1)) = ' ';
-        *(uint8_t *)(get_video_mem() + (i << 1) + 1) = color[TASK_T];
+        screen_row(TASK_T, i / NUM_COLS)[i % NUM_COLS] = (color[TASK_T] << 8) | ' ';
     }
+    mark_dirty(TASK_T, starty, endy);
+    flush_screen(TASK_T);
 }
 
 /*
@@ -93,39 +226,180 @@ void blue_screen(void) {
     set_cursor(0, 0);
 }
 
+/*
+ * void set_display_start(uint32_t terminal)
+ *   Inputs: terminal - terminal whose page should be displayed
+ *   Return Value: none
+ *   Function: Points the CRTC start address at a terminal's text page
+ */
+static void set_display_start(uint32_t terminal) {
+    uint32_t start = terminal * TERM_CELLS;
+
+    outb(0x0C, CRTC_INDEX);
+    outb((unsigned char)((start >> 8) & 0xFF), CRTC_DATA);
+    outb(0x0D, CRTC_INDEX);
+    outb((unsigned char)(start & 0xFF), CRTC_DATA);
+}
+
+/*
+ * void retarget_terminal(uint32_t terminal)
+ *   Inputs: terminal - terminal whose page moved
+ *   Return Value: none
+ *   Function: Points the video page of every task on terminal at terminal_page
+ */
+static void retarget_terminal(uint32_t terminal) {
+    uint32_t i;
+    for (i = 0; i < NUM_TASKS; i++) {
+        if (terminal_tasks[terminal] & (1 << i)) {
+            page_table_kb_entry_t *usr_vid_table = (page_table_kb_entry_t *)tasks[i]->usr_vid_table;
+            usr_vid_table->addr = (uint32_t)terminal_page[terminal] >> 12;
+        }
+    }
+}
+
 /*
  * void update_screen(uint32_t terminal)
  *   Inputs: terminal - terminal to switch to
  *   Return Value: none
- *   Function: Switches the active terminal
+ *   Function: Switches the active terminal. Every terminal keeps its own page
+ *             of VGA text memory, so this only moves the CRTC start address.
+ *             While a mode X program owns VGA memory the display stays put.
  */
-
 void update_screen(uint32_t terminal) {
-    cli();
-    if(terminal >= NUM_TERM || terminal == active){
+    uint32_t flags;
+    spin_lock_irqsave(&term_lock, flags);
+    if (terminal >= NUM_TERM || terminal == active || vga_owner) {
+        spin_unlock_irqrestore(&term_lock, flags);
         return;
     }
-    memcpy(terminal_video[active], (void *)VIDEO, KB4);
 
-    int i;
-    for (i = 1; i < NUM_TASKS; i++) { // Switch page tables to video memory
-        if (tasks[i]->terminal == active) {
-            page_table_kb_entry_t *usr_vid_table = (page_table_kb_entry_t *)tasks[i]->usr_vid_table;
-            usr_vid_table->addr = (uint32_t)terminal_video[active] >> 12;
-        } else if (tasks[i]->terminal == terminal) {
-            page_table_kb_entry_t *usr_vid_table = (page_table_kb_entry_t *)tasks[i]->usr_vid_table;
-            usr_vid_table->addr = VIDEO >> 12;
+    active = terminal;
+    set_display_start(active);
+    update_cursor();
+
+    spin_unlock_irqrestore(&term_lock, flags);
+}
+
+/*
+ * void terminal_map_task(uint32_t task)
+ *   Inputs: task - task whose usr_vid_table should be set up
+ *   Return Value: none
+ *   Function: Maps the task's user video page to its terminal's page and
+ *             records it so the page can be moved later
+ */
+void terminal_map_task(uint32_t task) {
+    uint32_t terminal = tasks[task]->terminal;
+    page_table_kb_entry_t *usr_vid_table = (page_table_kb_entry_t *)tasks[task]->usr_vid_table;
+
+    usr_vid_table->addr = (uint32_t)terminal_page[terminal] >> 12;
+    terminal_tasks[terminal] |= 1 << task;
+}
+
+/*
+ * void terminal_unmap_task(uint32_t task)
+ *   Inputs: task - task that is exiting
+ *   Return Value: none
+ *   Function: Drops the task from its terminal's list. If the task owned VGA
+ *             memory, copies every terminal back into it and restores the
+ *             text display.
+ */
+void terminal_unmap_task(uint32_t task) {
+    uint32_t i;
+    terminal_tasks[tasks[task]->terminal] &= ~(1 << task);
+
+    if (vga_owner != task) {
+        return;
+    }
+    vga_owner = 0;
+
+    for (i = 0; i < NUM_TERM; i++) {
+        terminal_page[i] = (uint8_t *)TERM_PAGE(i);
+        retarget_terminal(i);
+        // The owner's terminal was overwritten by the graphics mode, so it is
+        // drawn again from its rows. The others keep what their tasks drew.
+        if (i == tasks[task]->terminal) {
+            redraw_screen(i);
+        } else {
+            memcpy((void *)TERM_PAGE(i), terminal_video[i], KB4);
         }
     }
 
-    switch_page_directory(cur_task);
+    // Mode X programs reset the CRTC when they go back to text mode
+    set_display_start(active);
+    update_cursor();
+}
 
-    active = terminal;
+/*
+ * void terminal_take_vga(uint32_t task)
+ *   Inputs: task - task that is mapping all of VGA memory
+ *   Return Value: none
+ *   Function: Saves every terminal into its backing page and moves the other
+ *             terminals' tasks there so they keep drawing while task owns VGA
+ */
+void terminal_take_vga(uint32_t task) {
+    uint32_t i;
+    if (vga_owner) {
+        return;
+    }
+    vga_owner = task;
 
-    memcpy((void *)VIDEO, terminal_video[active], KB4);
+    for (i = 0; i < NUM_TERM; i++) {
+        memcpy(terminal_video[i], (void *)TERM_PAGE(i), KB4);
+        if (i != tasks[task]->terminal) {
+            terminal_page[i] = (uint8_t *)terminal_video[i];
+            retarget_terminal(i);
+        }
+    }
+}
 
-    update_cursor();
-    sti();
+/*
+ * void scrollback_view(uint32_t terminal, int32_t pages)
+ *   Inputs: terminal - terminal to scroll
+ *           pages - steps to scroll back, negative to scroll forward
+ *   Return Value: none
+ *   Function: Moves the terminal's view through its scrollback and redraws it
+ */
+void scrollback_view(uint32_t terminal, int32_t pages) {
+    uint32_t flags;
+    int32_t history, back;
+
+    cli_and_save(flags);
+    history = screen_top[terminal] < SCROLLBACK_ROWS - NUM_ROWS ? screen_top[terminal] : SCROLLBACK_ROWS - NUM_ROWS;
+    back = (int32_t)view_back[terminal] + pages * SCROLL_STEP;
+    if (back < 0) {
+        back = 0;
+    } else if (back > history) {
+        back = history;
+    }
+
+    if (back != view_back[terminal]) {
+        view_back[terminal] = back;
+        redraw_screen(terminal);
+        if (terminal == active) {
+            update_cursor();
+        }
+    }
+    restore_flags(flags);
+}
+
+/*
+ * void scrollback_reset(uint32_t terminal)
+ *   Inputs: terminal - terminal to reset
+ *   Return Value: none
+ *   Function: Returns the terminal's view to the bottom of its scrollback
+ */
+void scrollback_reset(uint32_t terminal) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if (view_back[terminal] != 0) {
+        view_back[terminal] = 0;
+        redraw_screen(terminal);
+        if (terminal == active) {
+            update_cursor();
+        }
+    }
+    restore_flags(flags);
 }
 
 /*
@@ -135,14 +409,19 @@ void update_screen(uint32_t terminal) {
  *   Function: displays the cursor at the current position
  */
 void update_cursor() {
-    unsigned short position = (term_y[active] * NUM_COLS) + term_x[active];
+    unsigned short position = active * TERM_CELLS + (term_y[active] * NUM_COLS) + term_x[active];
+
+    // Park the cursor past the bottom of the screen while looking at scrollback
+    if (view_back[active] != 0) {
+        position = active * TERM_CELLS + NUM_ROWS * NUM_COLS;
+    }
 
     // cursor LOW port to vga INDEX register
-    outb(0x0F, 0x3D4);
-    outb((unsigned char)(position & 0xFF), 0x3D5);
+    outb(0x0F, CRTC_INDEX);
+    outb((unsigned char)(position & 0xFF), CRTC_DATA);
     // cursor HIGH port to vga INDEX register
-    outb(0x0E, 0x3D4);
-    outb((unsigned char )((position >> 8) & 0xFF), 0x3D5);
+    outb(0x0E, CRTC_INDEX);
+    outb((unsigned char )((position >> 8) & 0xFF), CRTC_DATA);
 }
 /*
  * void set_cursor(uint32_t x, uint32_t y)
@@ -182,20 +461,17 @@ void set_color(uint8_t col) {
  * void move_up()
  *   Inputs: none
  *   Return Value: none
- *   Function: Moves everything in the console up one row
+ *   Function: Moves everything in the console up one row, keeping the
+ *             row that leaves the screen in the scrollback
  */
 void move_up(int32_t dist) {
     int j = 0;
     while(j < dist){
-        int i;
         term_y[TASK_T]--;
-        memmove((void*)get_video_mem(), (void*)(get_video_mem() + NUM_COLS*2), (NUM_COLS * (NUM_ROWS-1))*2);
-        for(i=NUM_COLS*(NUM_ROWS-1); i<NUM_ROWS*NUM_COLS; i++) {
-            *(uint8_t *)(get_video_mem() + (i << 1)) = ' ';
-            *(uint8_t *)(get_video_mem() + (i << 1) + 1) = color[TASK_T];
-        }
+        scroll_screen(TASK_T);
         j++;
     }
+    flush_screen(TASK_T);
     update_cursor();
 }
 
@@ -341,13 +617,9 @@ int32_t printf(int8_t *format, ...) {
  *   Function: Output a string to the console
  */
 int32_t puts(int8_t* s) {
-    register int32_t index = 0;
-    while(s[index] != '\0') {
-        putc(s[index]);
-        index++;
-    }
-
-    return index;
+    int32_t len = strlen(s);
+    putbuf((uint8_t*)s, len);
+    return len;
 }
 
 /*
@@ -370,14 +642,95 @@ void putc(uint8_t c) {
             putc(' ');
         }
     }else {
-        *(uint8_t *)(get_video_mem() + ((NUM_COLS*(term_y[TASK_T]) + term_x[TASK_T]) << 1)) = c;
-        *(uint8_t *)(get_video_mem() + ((NUM_COLS*(term_y[TASK_T]) + term_x[TASK_T]) << 1) + 1) = color[TASK_T];
+        screen_row(TASK_T, term_y[TASK_T])[term_x[TASK_T]] = (color[TASK_T] << 8) | c;
+        mark_dirty(TASK_T, term_y[TASK_T], term_y[TASK_T]);
+        flush_screen(TASK_T);
         move_hor(1);
 
     }
 
 }
 
+/*
+ * void putbuf_chunk(const uint8_t* buf, uint32_t n)
+ *   Inputs: buf - characters to print
+ *           n - number of characters
+ *   Return Value: none
+ *   Function: Prints a chunk of characters exactly like calling putc on each
+ *             of them, but writes whole cells into the ring, blits the
+ *             changed rows once at the end and leaves the hardware cursor
+ *             alone
+ */
+static void putbuf_chunk(const uint8_t* buf, uint32_t n) {
+    uint32_t t = TASK_T;
+    uint16_t attrib = color[t] << 8;
+    uint32_t x = term_x[t];
+    uint32_t y = term_y[t];
+    uint32_t first = y;
+    uint16_t *row = screen_row(t, y);
+    uint32_t i;
+
+    for (i = 0; i < n; i++) {
+        uint8_t c = buf[i];
+        uint32_t count = 1;
+        bool newline = false;
+
+        if (c == '\n' || c == '\r') {
+            x = 0;
+            count = 0;
+            newline = true;
+        } else if (c == '\t') {
+            c = ' ';
+            count = TAB_SIZE;
+        }
+        while (count > 0 || newline) {
+            if (count > 0) {
+                row[x] = attrib | c;
+                count--;
+                if (++x == NUM_COLS) {
+                    x = 0;
+                    newline = true;
+                }
+            }
+            if (newline) {
+                newline = false;
+                if (++y == NUM_ROWS) {
+                    scroll_screen(t);
+                    y = NUM_ROWS - 1;
+                }
+                row = screen_row(t, y);
+            }
+        }
+    }
+
+    term_x[t] = x;
+    term_y[t] = y;
+    mark_dirty(t, first, y);
+    flush_screen(t);
+}
+
+/*
+ * void putbuf(const uint8_t* buf, uint32_t n)
+ *   Inputs: buf - characters to print
+ *           n - number of characters
+ *   Return Value: none
+ *   Function: Bulk version of putc. Each screenful is written with
+ *             interrupts off so keyboard echo can not land in the middle of
+ *             it, and the hardware cursor is programmed once at the end.
+ */
+void putbuf(const uint8_t* buf, uint32_t n) {
+    uint32_t flags;
+    while (n > 0) {
+        uint32_t chunk = n > NUM_ROWS * NUM_COLS ? NUM_ROWS * NUM_COLS : n;
+        cli_and_save(flags);
+        putbuf_chunk(buf, chunk);
+        restore_flags(flags);
+        buf += chunk;
+        n -= chunk;
+    }
+    update_cursor();
+}
+
 /*
  * void removec()
  *   Input: none
@@ -390,8 +743,9 @@ void removec(uint32_t num) {
         if(term_x[TASK_T] == 0 && term_y[TASK_T] == 0)
             return;
         move_hor(-1);
-        *(uint8_t *)(get_video_mem() + ((NUM_COLS*(term_y[TASK_T]) + term_x[TASK_T]) << 1)) = ' ';
-        *(uint8_t *)(get_video_mem() + ((NUM_COLS*(term_y[TASK_T]) + term_x[TASK_T]) << 1) + 1) = color[TASK_T];
+        screen_row(TASK_T, term_y[TASK_T])[term_x[TASK_T]] = (color[TASK_T] << 8) | ' ';
+        mark_dirty(TASK_T, term_y[TASK_T], term_y[TASK_T]);
+        flush_screen(TASK_T);
         i++;
     }
 
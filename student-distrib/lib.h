@@ -16,6 +16,8 @@ extern int32_t printf(int8_t *format, ...);
 
 // Output a character to the console
 void putc(uint8_t c);
+// Output n characters to the console, scrolling and moving the cursor once
+void putbuf(const uint8_t* buf, uint32_t n);
 
 //removes a character from the console
 void removec(uint32_t num);
@@ -62,6 +64,21 @@ void move_up(int32_t dist);
 //Switches the active terminal
 void update_screen(uint32_t terminal);
 
+//Points a task's video page at its terminal's text page
+void terminal_map_task(uint32_t task);
+
+//Forgets a task's video mapping when it exits
+void terminal_unmap_task(uint32_t task);
+
+//Moves every terminal into backing memory so task can own VGA memory
+void terminal_take_vga(uint32_t task);
+
+//Scrolls a terminal's view back through its scrollback, negative pages scroll forward
+void scrollback_view(uint32_t terminal, int32_t pages);
+
+//Returns a terminal's view to the bottom of its scrollback
+void scrollback_reset(uint32_t terminal);
+
 //set n consecutive bytes of pointer s to value c
 void* memset(void* s, int32_t c, uint32_t n);
 
@@ -89,6 +106,10 @@ int8_t* strncpy(int8_t* dest, const int8_t*src, uint32_t n);
 //Increments all of video memory
 void test_interrupts();
 
+// Each terminal owns one page of VGA text memory; switching only moves the CRTC start address
+#define TERM_PAGE(t) (VIDEO + (t) * KB4)
+
+// Backing pages used while a mode X program owns VGA memory
 int8_t terminal_video[NUM_TERM][KB4] __attribute__((aligned (KB4)));
 
 /* Port read functions */
@@ -152,14 +173,14 @@ static inline uint32_t inl(port)
 /* Writes four bytes to four consecutive ports */
 #define outl(data, port)                        \
     do {                                        \
-        asm volatile("outl  %l1, (%w0)"         \
+        asm volatile("outl  %k1, (%w0)"         \
                      :                          \
                      : "d" (port), "a" (data)   \
                      : "memory", "cc" );        \
     } while(0)
 
 /* Clear interrupt flag - disables interrupts on this processor */
-#define cli()                                   \
+#define raw_cli()                               \
     do {                                        \
         asm volatile("cli"                      \
                      :                          \
@@ -171,7 +192,7 @@ static inline uint32_t inl(port)
 /* Save flags and then clear interrupt flag
  * Saves the EFLAGS register into the variable "flags", and then
  * disables interrupts on this processor */
-#define cli_and_save(flags)                     \
+#define raw_cli_and_save(flags)                 \
     do {                                        \
         asm volatile("pushfl        \n      \
             popl %0         \n      \
@@ -183,7 +204,7 @@ static inline uint32_t inl(port)
     } while(0)
 
 /* Set interrupt flag - enable interrupts on this processor */
-#define sti()                                   \
+#define raw_sti()                               \
     do {                                        \
         asm volatile("sti"                      \
                      :                          \
@@ -195,7 +216,7 @@ static inline uint32_t inl(port)
 /* Restore flags
  * Puts the value in "flags" into the EFLAGS register.  Most often used
  * after a cli_and_save_flags(flags) */
-#define restore_flags(flags)                    \
+#define raw_restore_flags(flags)                \
     do {                                        \
         asm volatile("pushl %0      \n      \
             popfl"                              \
@@ -205,4 +226,70 @@ static inline uint32_t inl(port)
             );                                  \
     } while(0)
 
+/* The interrupt flag in EFLAGS */
+#define EFLAGS_IF 0x200
+
+#ifdef IRQSOFF_TRACE
+#include "irqsoff.h"
+
+/* With IRQSOFF_TRACE every stretch with interrupts off is timed from the
+ * call that turned them off to the one that turned them back on, see
+ * irqsoff.c. Calls that leave the flag as it was record nothing. */
+#define cli()                                   \
+    do {                                        \
+        uint32_t _irqsoff_flags;                \
+        raw_cli_and_save(_irqsoff_flags);       \
+        if (_irqsoff_flags & EFLAGS_IF) {       \
+            irqsoff_begin(__FILE__, __LINE__);  \
+        }                                       \
+    } while(0)
+
+#define cli_and_save(flags)                     \
+    do {                                        \
+        raw_cli_and_save(flags);                \
+        if ((flags) & EFLAGS_IF) {              \
+            irqsoff_begin(__FILE__, __LINE__);  \
+        }                                       \
+    } while(0)
+
+#define sti()                                   \
+    do {                                        \
+        irqsoff_end(__FILE__, __LINE__);        \
+        raw_sti();                              \
+    } while(0)
+
+#define restore_flags(flags)                    \
+    do {                                        \
+        if ((flags) & EFLAGS_IF) {              \
+            irqsoff_end(__FILE__, __LINE__);    \
+        }                                       \
+        raw_restore_flags(flags);               \
+    } while(0)
+
+/* For an iret that turns interrupts back on */
+#define trace_irqs_on() irqsoff_end(__FILE__, __LINE__)
+
+#else
+
+#define cli() raw_cli()
+#define cli_and_save(flags) raw_cli_and_save(flags)
+#define sti() raw_sti()
+#define restore_flags(flags) raw_restore_flags(flags)
+#define trace_irqs_on() do { } while(0)
+
+#endif
+
+/* Stops the compiler from moving memory accesses across this point.
+ * x86 does not reorder stores with other stores or loads with other loads,
+ * which is all a single producer/consumer ring needs. */
+#define barrier() asm volatile("" : : : "memory")
+
+/* Returns the low 32 bits of the time stamp counter */
+static inline uint32_t rdtsc(void)
+{
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
 #endif /* _LIB_H */
@@ -0,0 +1,83 @@
+#include "lz4.h"
+#include "lib.h"
+
+/* uint32_t read_length(const uint8_t** ip, const uint8_t* iend, uint32_t len)
+ * Description: finishes reading an LZ4 length whose 4 bit field was 15
+ * Input:  ip - pointer to the input cursor, advanced past the extra bytes
+ *         iend - end of the input
+ *         len - value of the 4 bit field
+ * Output: the full length, or -1 if the input ran out
+ * Side Effects: advances *ip
+ */
+static int32_t read_length(const uint8_t** ip, const uint8_t* iend, uint32_t len) {
+    uint8_t b;
+    if (len != 15) {
+        return len;
+    }
+    do {
+        if (*ip >= iend) {
+            return -1;
+        }
+        b = *(*ip)++;
+        len += b;
+    } while (b == 255);
+    return len;
+}
+
+/* int32_t lz4_decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_len)
+ * Description: decompresses one LZ4 block (no frame header). Every sequence is
+ *              bounds checked, so a corrupt image can not write past dst.
+ * Input:  src - compressed data
+ *         src_len - number of compressed bytes
+ *         dst - buffer to decompress into
+ *         dst_len - size of dst
+ * Output: number of bytes written to dst, -1 on corrupt input
+ * Side Effects: writes to dst
+ */
+int32_t lz4_decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_len) {
+    const uint8_t* ip = src;
+    const uint8_t* iend = src + src_len;
+    uint8_t* op = dst;
+    uint8_t* oend = dst + dst_len;
+
+    while (ip < iend) {
+        uint32_t token = *ip++;
+
+        // Literals
+        int32_t len = read_length(&ip, iend, token >> 4);
+        if (len < 0 || len > iend - ip || len > oend - op) {
+            return -1;
+        }
+        memcpy(op, ip, len);
+        op += len;
+        ip += len;
+
+        // The last sequence is literals only
+        if (ip == iend) {
+            break;
+        }
+
+        // Match
+        if (iend - ip < 2) {
+            return -1;
+        }
+        uint32_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op - dst) {
+            return -1;
+        }
+        len = read_length(&ip, iend, token & 0xF);
+        if (len < 0 || len + 4 > oend - op) {
+            return -1;
+        }
+        len += 4;
+
+        // Matches may overlap their own output, so copy forwards a byte at a time
+        const uint8_t* match = op - offset;
+        while (len--) {
+            *op++ = *match++;
+        }
+    }
+
+    return op - dst;
+}
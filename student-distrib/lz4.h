@@ -0,0 +1,9 @@
+#ifndef LZ4_H_
+#define LZ4_H_
+
+#include "types.h"
+
+// decompresses one LZ4 block, returns the decompressed size or -1 on corrupt input
+extern int32_t lz4_decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_len);
+
+#endif
@@ -4,7 +4,8 @@ cd ../mazegame
 make
 cd ..
 cp mazegame/mazegame fsdir
-./createfs -i fsdir -o student-distrib/filesys_img
+make -C buildfs
+./buildfs/buildfs -i fsdir -o student-distrib/filesys_img -H
 cd student-distrib
 make clean
 make
@@ -37,3 +37,29 @@ void switch_page_directory(int task) {
                  : "a"(tasks[task]->page_directory)
         );
 }
+
+/* uint32_t user_phys_addr(int task, uint32_t addr)
+ * Description: walks the page directory of task to find where a user
+ *              address is mapped
+ * Inputs:      task - task index whose mappings to use
+ *              addr - virtual address
+ * Outputs:     the physical address, 0 if addr is not mapped for the user
+ * Side Effect: None
+ */
+uint32_t user_phys_addr(int task, uint32_t addr) {
+    page_dir_kb_entry_t *dir = (page_dir_kb_entry_t *)&tasks[task]->page_directory[addr >> 22];
+    if (!dir->present || !dir->userSupervisor) {
+        return 0;
+    }
+    if (dir->pageSize) {
+        return (((page_dir_mb_entry_t *)dir)->addr << 22) | (addr & (MB4 - 1));
+    }
+
+    // Kernel memory is identity mapped, so the table can be read in place
+    page_table_kb_entry_t *table = (page_table_kb_entry_t *)(dir->addr << 12);
+    page_table_kb_entry_t *entry = &table[(addr >> 12) & (DIR_SIZE - 1)];
+    if (!entry->present || !entry->userSupervisor) {
+        return 0;
+    }
+    return (entry->addr << 12) | (addr & (KB4 - 1));
+}
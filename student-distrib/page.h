@@ -60,8 +60,9 @@ typedef struct __attribute__((packed)) page_table_kb_entry{
     uint32_t addr : 20;
 } page_table_kb_entry_t;
 
-uint32_t page_directory_tables[NUM_TASKS][DIR_SIZE] __attribute__((aligned (KB4)));
-uint32_t page_tables[NUM_TASKS][2][DIR_SIZE] __attribute__((aligned (KB4)));
+uint32_t page_directory_tables[NUM_PROCS][DIR_SIZE] __attribute__((aligned (KB4)));
+// Kernel video, user video and thread stack tables of each process
+uint32_t page_tables[NUM_PROCS][3][DIR_SIZE] __attribute__((aligned (KB4)));
 
 // Sets PG, PSE, and PE flags
 extern void init_paging();
@@ -69,4 +70,7 @@ extern void init_paging();
 //moves directory address to CR3
 extern void switch_page_directory(int pd);
 
+// finds the physical address a user address of task is mapped to
+extern uint32_t user_phys_addr(int task, uint32_t addr);
+
 #endif // PAGE_H
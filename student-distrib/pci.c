@@ -0,0 +1,133 @@
+#include "pci.h"
+#include "lib.h"
+
+/* uint32_t pci_address(pci_dev_t* dev, uint8_t offset)
+ * Description: builds the CONFIG_ADDRESS value for a register
+ * Input:  dev - function to address
+ *         offset - register offset
+ * Output: value to write to PCI_CONFIG_ADDRESS
+ * Side Effects: none
+ */
+static uint32_t pci_address(pci_dev_t* dev, uint8_t offset) {
+    return 0x80000000 | (dev->bus << 16) | (dev->slot << 11) | (dev->func << 8) | (offset & 0xFC);
+}
+
+/* uint32_t pci_read32(pci_dev_t* dev, uint8_t offset)
+ * Description: reads a 32 bit configuration register
+ * Input:  dev - function to read from
+ *         offset - register offset, 4 byte aligned
+ * Output: register value
+ * Side Effects: writes PCI_CONFIG_ADDRESS
+ */
+uint32_t pci_read32(pci_dev_t* dev, uint8_t offset) {
+    uint32_t flags;
+    uint32_t value;
+    cli_and_save(flags);
+    outl(pci_address(dev, offset), PCI_CONFIG_ADDRESS);
+    value = inl(PCI_CONFIG_DATA);
+    restore_flags(flags);
+    return value;
+}
+
+/* uint16_t pci_read16(pci_dev_t* dev, uint8_t offset)
+ * Description: reads a 16 bit configuration register
+ * Input:  dev - function to read from
+ *         offset - register offset, 2 byte aligned
+ * Output: register value
+ * Side Effects: writes PCI_CONFIG_ADDRESS
+ */
+uint16_t pci_read16(pci_dev_t* dev, uint8_t offset) {
+    return pci_read32(dev, offset) >> ((offset & 2) * 8);
+}
+
+/* uint8_t pci_read8(pci_dev_t* dev, uint8_t offset)
+ * Description: reads an 8 bit configuration register
+ * Input:  dev - function to read from
+ *         offset - register offset
+ * Output: register value
+ * Side Effects: writes PCI_CONFIG_ADDRESS
+ */
+uint8_t pci_read8(pci_dev_t* dev, uint8_t offset) {
+    return pci_read32(dev, offset) >> ((offset & 3) * 8);
+}
+
+/* void pci_write32(pci_dev_t* dev, uint8_t offset, uint32_t value)
+ * Description: writes a 32 bit configuration register
+ * Input:  dev - function to write to
+ *         offset - register offset, 4 byte aligned
+ *         value - value to write
+ * Output: none
+ * Side Effects: writes to the device's configuration space
+ */
+void pci_write32(pci_dev_t* dev, uint8_t offset, uint32_t value) {
+    uint32_t flags;
+    cli_and_save(flags);
+    outl(pci_address(dev, offset), PCI_CONFIG_ADDRESS);
+    outl(value, PCI_CONFIG_DATA);
+    restore_flags(flags);
+}
+
+/* void pci_write16(pci_dev_t* dev, uint8_t offset, uint16_t value)
+ * Description: writes a 16 bit configuration register
+ * Input:  dev - function to write to
+ *         offset - register offset, 2 byte aligned
+ *         value - value to write
+ * Output: none
+ * Side Effects: writes to the device's configuration space
+ */
+void pci_write16(pci_dev_t* dev, uint8_t offset, uint16_t value) {
+    uint32_t shift = (offset & 2) * 8;
+    uint32_t old = pci_read32(dev, offset);
+    pci_write32(dev, offset, (old & ~(0xFFFF << shift)) | ((uint32_t)value << shift));
+}
+
+/* int32_t pci_find_device(uint16_t vendor, uint16_t device, uint32_t index, pci_dev_t* dev)
+ * Description: scans every bus for a function with the given ids
+ * Input:  vendor - vendor id to match
+ *         device - device id to match
+ *         index - number of earlier matches to skip
+ *         dev - filled in with the location of the match
+ * Output: 0 if a match was found, -1 otherwise
+ * Side Effects: reads configuration space
+ */
+int32_t pci_find_device(uint16_t vendor, uint16_t device, uint32_t index, pci_dev_t* dev) {
+    uint32_t bus, slot, func;
+    for (bus = 0; bus < PCI_MAX_BUS; bus++) {
+        for (slot = 0; slot < PCI_MAX_SLOT; slot++) {
+            for (func = 0; func < PCI_MAX_FUNC; func++) {
+                dev->bus = bus;
+                dev->slot = slot;
+                dev->func = func;
+                dev->vendor = pci_read16(dev, PCI_VENDOR_ID);
+                if (dev->vendor == 0xFFFF) {
+                    // Nothing here, and no other functions if function 0 is missing
+                    if (func == 0) {
+                        break;
+                    }
+                    continue;
+                }
+                dev->device = pci_read16(dev, PCI_DEVICE_ID);
+                if (dev->vendor == vendor && dev->device == device && index-- == 0) {
+                    return 0;
+                }
+                // Single function devices only decode function 0
+                if (func == 0 && !(pci_read8(dev, PCI_HEADER_TYPE) & 0x80)) {
+                    break;
+                }
+            }
+        }
+    }
+    return -1;
+}
+
+/* void pci_enable_device(pci_dev_t* dev)
+ * Description: turns on I/O, memory and bus master decoding so the
+ *              device can be programmed and can DMA
+ * Input:  dev - function to enable
+ * Output: none
+ * Side Effects: writes the command register
+ */
+void pci_enable_device(pci_dev_t* dev) {
+    uint16_t command = pci_read16(dev, PCI_COMMAND);
+    pci_write16(dev, PCI_COMMAND, command | PCI_COMMAND_IO | PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER);
+}
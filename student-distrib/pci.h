@@ -0,0 +1,57 @@
+/* pci.h - PCI configuration space access through the 0xCF8/0xCFC mechanism
+ */
+
+#ifndef PCI_H
+#define PCI_H
+
+#include "types.h"
+
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA 0xCFC
+
+#define PCI_MAX_BUS 256
+#define PCI_MAX_SLOT 32
+#define PCI_MAX_FUNC 8
+
+// Configuration space registers
+#define PCI_VENDOR_ID 0x00
+#define PCI_DEVICE_ID 0x02
+#define PCI_COMMAND 0x04
+#define PCI_HEADER_TYPE 0x0E
+#define PCI_BAR0 0x10
+#define PCI_SUBSYSTEM_ID 0x2E
+#define PCI_INTERRUPT_LINE 0x3C
+
+#define PCI_COMMAND_IO 0x1
+#define PCI_COMMAND_MEMORY 0x2
+#define PCI_COMMAND_MASTER 0x4
+
+// Set in a BAR that maps I/O ports rather than memory
+#define PCI_BAR_IO 0x1
+
+typedef struct pci_dev {
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t func;
+    uint16_t vendor;
+    uint16_t device;
+} pci_dev_t;
+
+// reads a 32 bit configuration register, offset must be 4 byte aligned
+extern uint32_t pci_read32(pci_dev_t* dev, uint8_t offset);
+// reads a 16 bit configuration register
+extern uint16_t pci_read16(pci_dev_t* dev, uint8_t offset);
+// reads an 8 bit configuration register
+extern uint8_t pci_read8(pci_dev_t* dev, uint8_t offset);
+// writes a 32 bit configuration register
+extern void pci_write32(pci_dev_t* dev, uint8_t offset, uint32_t value);
+// writes a 16 bit configuration register
+extern void pci_write16(pci_dev_t* dev, uint8_t offset, uint16_t value);
+
+// finds the index'th function matching vendor and device, 0 on success
+extern int32_t pci_find_device(uint16_t vendor, uint16_t device, uint32_t index, pci_dev_t* dev);
+
+// turns on I/O, memory and bus master decoding for dev
+extern void pci_enable_device(pci_dev_t* dev);
+
+#endif
@@ -0,0 +1,267 @@
+/* pipe.c - Anonymous pipes between tasks
+ */
+
+#include "pipe.h"
+#include "lib.h"
+#include "task.h"
+#include "filesystem.h"
+
+static pipe_t pipes[NUM_PIPES];
+static uint8_t pipe_bufs[NUM_PIPES][PIPE_SIZE] __attribute__((aligned (PIPE_SIZE)));
+
+static file_ops_t pipe_read_ops;
+static file_ops_t pipe_write_ops;
+
+/* pipe_t* fd_pipe(int32_t fd)
+ * Description: Finds the pipe behind an fd of the current task
+ * Input:  fd - index of a pipe end
+ * Output: the pipe
+ * Side Effects: none
+ */
+static pipe_t* fd_pipe(int32_t fd) {
+    return &pipes[tasks[cur_task]->file_descs[fd].inode];
+}
+
+/* int32_t pipe_read(int32_t fd, void* buf, int32_t nbytes)
+ * Description: Reads whatever is buffered, up to nbytes. Sleeps while the
+ *              pipe is empty and a writer is still open.
+ * Input:  fd - index of the read end
+ *         buf - buffer to read into
+ *         nbytes - max bytes to read
+ * Output: bytes read, 0 once every writer has closed, -1 if the pipe is
+ *         empty and fd is O_NONBLOCK
+ * Side Effects: may sleep, wakes writers
+ */
+static int32_t pipe_read(int32_t fd, void* buf, int32_t nbytes) {
+    pipe_t *p = fd_pipe(fd);
+    uint32_t flags;
+
+    if (buf == NULL || nbytes < 0) {
+        return -1;
+    }
+
+    cli_and_save(flags);
+    while (p->head == p->tail) {
+        if (p->writers == 0) {
+            restore_flags(flags);
+            return 0;
+        }
+        if (tasks[cur_task]->file_descs[fd].mode & O_NONBLOCK) {
+            restore_flags(flags);
+            return -1;
+        }
+        sleep_on(&p->readable);
+        cli();
+    }
+
+    uint32_t count = p->head - p->tail;
+    if (count > (uint32_t)nbytes) {
+        count = nbytes;
+    }
+    // Copy out in at most two pieces, around the end of the buffer
+    uint32_t start = p->tail & PIPE_MASK;
+    uint32_t first = PIPE_SIZE - start < count ? PIPE_SIZE - start : count;
+    memcpy(buf, p->buf + start, first);
+    memcpy((uint8_t *)buf + first, p->buf, count - first);
+    p->tail += count;
+    restore_flags(flags);
+
+    wake_up(&p->writable);
+    return count;
+}
+
+/* int32_t pipe_write(int32_t fd, const void* buf, int32_t nbytes)
+ * Description: Writes all of buf, sleeping whenever the pipe is full
+ * Input:  fd - index of the write end
+ *         buf - buffer to write from
+ *         nbytes - bytes to write
+ * Output: bytes written, which is short if every reader closes or fd is
+ *         O_NONBLOCK and the pipe fills. -1 if nothing could be written.
+ * Side Effects: may sleep, wakes readers
+ */
+static int32_t pipe_write(int32_t fd, const void* buf, int32_t nbytes) {
+    pipe_t *p = fd_pipe(fd);
+    uint32_t flags;
+    int32_t written = 0;
+
+    if (buf == NULL || nbytes < 0) {
+        return -1;
+    }
+
+    cli_and_save(flags);
+    while (written < nbytes) {
+        if (p->readers == 0) {
+            break;
+        }
+        uint32_t space = PIPE_SIZE - (p->head - p->tail);
+        if (space == 0) {
+            if (tasks[cur_task]->file_descs[fd].mode & O_NONBLOCK) {
+                break;
+            }
+            sleep_on(&p->writable);
+            cli();
+            continue;
+        }
+
+        uint32_t count = (uint32_t)(nbytes - written) < space ? (uint32_t)(nbytes - written) : space;
+        uint32_t start = p->head & PIPE_MASK;
+        uint32_t first = PIPE_SIZE - start < count ? PIPE_SIZE - start : count;
+        memcpy(p->buf + start, (const uint8_t *)buf + written, first);
+        memcpy(p->buf, (const uint8_t *)buf + written + first, count - first);
+        p->head += count;
+        written += count;
+
+        wake_up(&p->readable);
+    }
+    restore_flags(flags);
+
+    if (written == 0 && nbytes > 0) {
+        return -1;
+    }
+    return written;
+}
+
+/* int32_t pipe_close(int32_t fd)
+ * Description: Drops one end of a pipe and wakes the other side so it can
+ *              notice
+ * Input:  fd - index of either end
+ * Output: 0
+ * Side Effects: frees the pipe once both ends are closed
+ */
+static int32_t pipe_close(int32_t fd) {
+    pipe_t *p = fd_pipe(fd);
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if (tasks[cur_task]->file_descs[fd].ops == &pipe_read_ops) {
+        p->readers--;
+        wake_up(&p->writable);
+    } else {
+        p->writers--;
+        wake_up(&p->readable);
+    }
+    restore_flags(flags);
+    return 0;
+}
+
+/* int32_t pipe_stat(int32_t fd, void* buf, int32_t nbytes)
+ * Description: Reports a pipe and how many bytes it is holding
+ * Input:  fd - index of either end
+ *         buf - fstat_t to fill
+ *         nbytes - size of buf
+ * Output: -1 if buf is too small, 0 on success
+ * Side Effects: writes to buf
+ */
+static int32_t pipe_stat(int32_t fd, void* buf, int32_t nbytes) {
+    if (nbytes < (int32_t)sizeof(fstat_t)) {
+        return -1;
+    }
+    pipe_t *p = fd_pipe(fd);
+    ((fstat_t*)buf)->type = FD_PIPE;
+    ((fstat_t*)buf)->size = p->head - p->tail;
+    return 0;
+}
+
+/* int32_t pipe_read_poll(int32_t fd, wait_queue_t** wait)
+ * Description: The read end is ready when data is buffered or no writer is left
+ * Input:  fd - index of the read end
+ *         wait - set to the queue woken when that may change
+ * Output: POLLIN when ready, otherwise 0
+ * Side Effects: none
+ */
+static int32_t pipe_read_poll(int32_t fd, wait_queue_t** wait) {
+    pipe_t *p = fd_pipe(fd);
+    *wait = &p->readable;
+    return (p->head != p->tail || p->writers == 0) ? POLLIN : 0;
+}
+
+/* int32_t pipe_write_poll(int32_t fd, wait_queue_t** wait)
+ * Description: The write end is ready when there is space or no reader is left
+ * Input:  fd - index of the write end
+ *         wait - set to the queue woken when that may change
+ * Output: POLLOUT when ready, otherwise 0
+ * Side Effects: none
+ */
+static int32_t pipe_write_poll(int32_t fd, wait_queue_t** wait) {
+    pipe_t *p = fd_pipe(fd);
+    *wait = &p->writable;
+    return (p->head - p->tail < PIPE_SIZE || p->readers == 0) ? POLLOUT : 0;
+}
+
+/* void pipe_init()
+ * Description: Sets up the file operations of both pipe ends
+ * Input:  none
+ * Output: none
+ * Side Effects: none
+ */
+void pipe_init() {
+    pipe_read_ops.open = default_open;
+    pipe_read_ops.close = pipe_close;
+    pipe_read_ops.read = pipe_read;
+    pipe_read_ops.write = default_write;
+    pipe_read_ops.stat = pipe_stat;
+    pipe_read_ops.poll = pipe_read_poll;
+
+    pipe_write_ops.open = default_open;
+    pipe_write_ops.close = pipe_close;
+    pipe_write_ops.read = default_read;
+    pipe_write_ops.write = pipe_write;
+    pipe_write_ops.stat = pipe_stat;
+    pipe_write_ops.poll = pipe_write_poll;
+}
+
+/* int32_t sys_pipe(int32_t* fds)
+ * Description: Creates a pipe and opens both of its ends in the current task
+ * Input:  fds - gets the read end in fds[0] and the write end in fds[1]
+ * Output: -1 if no pipe or fds are free, 0 on success
+ * Side Effects: writes to fds and tasks[cur_task]->file_descs
+ */
+int32_t sys_pipe(int32_t* fds) {
+    if ((uint32_t)fds < TASK_ADDR || (uint32_t)(fds + 2) > (TASK_ADDR + MB4)) {
+        return -1;
+    }
+
+    uint32_t flags;
+    cli_and_save(flags);
+
+    int32_t pipe_i;
+    for (pipe_i = 0; pipe_i < NUM_PIPES; pipe_i++) {
+        if (pipes[pipe_i].readers == 0 && pipes[pipe_i].writers == 0) {
+            break;
+        }
+    }
+
+    int32_t ends[2];
+    int32_t n = 0;
+    int32_t i;
+    for (i = 2; i < FILE_DESCS_LENGTH && n < 2; i++) {
+        if (tasks[cur_task]->file_descs[i].flags == FD_CLEAR) {
+            ends[n++] = i;
+        }
+    }
+
+    if (pipe_i >= NUM_PIPES || n < 2) {
+        restore_flags(flags);
+        return -1;
+    }
+
+    pipe_t *p = &pipes[pipe_i];
+    memset(p, 0, sizeof(pipe_t));
+    p->buf = pipe_bufs[pipe_i];
+    p->readers = 1;
+    p->writers = 1;
+
+    for (i = 0; i < 2; i++) {
+        file_desc_t *desc = &tasks[cur_task]->file_descs[ends[i]];
+        desc->ops = i == 0 ? &pipe_read_ops : &pipe_write_ops;
+        desc->inode = pipe_i;
+        desc->file_pos = 0;
+        desc->flags = FD_PIPE;
+        desc->mode = 0;
+    }
+    restore_flags(flags);
+
+    fds[0] = ends[0];
+    fds[1] = ends[1];
+    return 0;
+}
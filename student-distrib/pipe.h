@@ -0,0 +1,36 @@
+/* pipe.h - Anonymous pipes between tasks
+ */
+
+#ifndef PIPE_H
+#define PIPE_H
+
+#include "types.h"
+#include "page.h"
+#include "schedule.h"
+
+// Each pipe buffers one page, a power of two so the ring indices can be masked
+#define PIPE_SIZE KB4
+#define PIPE_MASK (PIPE_SIZE - 1)
+#define NUM_PIPES 8
+
+typedef struct pipe {
+    uint8_t *buf;
+    // Free running counts of bytes written and read, head - tail are buffered
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    // Open read and write ends. The pipe is free when both are 0.
+    uint32_t readers;
+    uint32_t writers;
+    // Woken when data arrives or the last writer closes
+    wait_queue_t readable;
+    // Woken when space frees up or the last reader closes
+    wait_queue_t writable;
+} pipe_t;
+
+// Sets up the file operations of both pipe ends
+extern void pipe_init();
+
+// Creates a pipe, fds[0] is the read end and fds[1] the write end
+extern int32_t sys_pipe(int32_t* fds);
+
+#endif
@@ -2,10 +2,21 @@
 #include "idt.h"
 #include "lib.h"
 #include "i8259.h"
+#include "signals.h"
+#include "softirq.h"
 static void do_rtc_irq(int dev_id);
+static void rtc_tasklet_func(uint32_t data);
 static uint8_t num_open;
 static uint32_t rtc_freq;
 static uint32_t sys_time = 0;
+// Time since boot in 1/MAX_RTC_FREQ second ticks
+static uint32_t ticks = 0;
+// Readers whose period may have run out
+static wait_queue_t rtc_wait;
+wait_queue_t rtc_tick_wait;
+// Ticks the interrupt handler counted that rtc_tasklet has not handed out
+static volatile uint32_t unhandled_ticks = 0;
+static tasklet_t rtc_tasklet = TASKLET_INIT(rtc_tasklet_func, 0);
 
 /* void rtc_init(irqaction* rtc_handler)
  * Decription: Initialzes the rtc and it's irqaction struct for use
@@ -46,6 +57,7 @@ void rtc_init(irqaction* rtc_handler){
     rtc_ops.read = rtc_read;
     rtc_ops.write = rtc_write;
     rtc_ops.stat = rtc_stat;
+    rtc_ops.poll = rtc_poll;
 
     //enable the interrupt
     enable_irq(2);
@@ -82,6 +94,7 @@ int32_t rtc_write(int32_t fd, const void* buf, int32_t nbytes){
         return -1;
     }
     tasks[cur_task]->rtc_base = MAX_RTC_FREQ >> logf;
+    tasks[cur_task]->rtc_counter = tasks[cur_task]->rtc_base;
     if(tasks[cur_task]->rtc_base < rtc_freq){
         rtc_freq = tasks[cur_task]->rtc_base;
         // disable interrupts while writing to the rtc
@@ -99,9 +112,11 @@ int32_t rtc_write(int32_t fd, const void* buf, int32_t nbytes){
 }
 
 /* int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes)
- * Decription: Gives RTC frequency and stalls for interrupt
+ * Decription: Sleeps until the end of the task's current period. Periods
+ *             run back to back from open or the last write, so a task that
+ *             reads late does not drift.
  * input: fd - ignored
- *        buf - pointer to number of RTC interrupts since function call
+ *        buf - pointer to number of periods that ended since the last read
  *        nbytes - size of buf, should be at least 4
  * output: -1 for invalid input, 0 for success
  * Side effects: Writes to buf, sleeps until RTC interrupt
@@ -110,16 +125,32 @@ int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes){
     if(nbytes < 4) {
         return -1;
     }
-    // loop until RTC interrupt
-    tasks[cur_task]->rtc_counter = tasks[cur_task]->rtc_base;
-
+    // The interrupt handler wakes us once the counter runs out
     while (tasks[cur_task]->rtc_counter > 0) {
-        reschedule();
+        sleep_on(&rtc_wait);
     }
-    *((uint32_t*)buf) = 1 + (-tasks[cur_task]->rtc_counter)/tasks[cur_task]->rtc_base;
+    // The tasklet counts rtc_counter down, so keep it out while we add to it
+    uint32_t flags;
+    cli_and_save(flags);
+    uint32_t periods = 1 + (-tasks[cur_task]->rtc_counter)/tasks[cur_task]->rtc_base;
+    tasks[cur_task]->rtc_counter += periods * tasks[cur_task]->rtc_base;
+    restore_flags(flags);
+    *((uint32_t*)buf) = periods;
     return 0;
 }
 
+/* int32_t rtc_poll(int32_t fd, wait_queue_t** wait)
+ * Decription: Checks whether a read would return without sleeping
+ * input: fd - ignored
+ *        wait - set to the queue woken when a period ends
+ * output: POLLIN if the current period is over, otherwise 0
+ * Side effects: none
+ */
+int32_t rtc_poll(int32_t fd, wait_queue_t** wait){
+    *wait = &rtc_wait;
+    return tasks[cur_task]->rtc_counter <= 0 ? POLLIN : 0;
+}
+
 /* int32_t rtc_open(const int8_t* filename)
  * Decription: Opens the rtc, which currently does nothing
  * input: filename - unused, as it should be the rtc
@@ -128,6 +159,7 @@ int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes){
  */
 int32_t rtc_open(const int8_t* filename){
     num_open++;
+    tasks[cur_task]->rtc_counter = tasks[cur_task]->rtc_base;
     return 0;
 }
 
@@ -155,7 +187,7 @@ int32_t rtc_stat(int32_t fd, void* buf, int32_t nbytes) {
 }
 
 /* void update_time(bool reset)
- * Decription: Updates the system time
+ * Decription: Updates the system time by one INIT period
  * input: reset - Whether to reset the hardware RTC frequency to the base rate
  * output: none
  * Side effects: Updates internal system time
@@ -165,7 +197,7 @@ void update_time(bool reset){
     if(sys_time%10 == 0){
         uint32_t task;
         for (task = 1; task < NUM_TASKS; task++) {
-            SET_SIGNAL(task, ALARM);
+            send_signal(task, ALARM);
         }
     }
     if(reset){ //reset the rtc to the default rate if possible
@@ -178,30 +210,78 @@ void update_time(bool reset){
 
         restore_flags(flags);
     }
-    tasks[INIT]->rtc_counter = tasks[INIT]->rtc_base;
+    // Keep any overshoot so a late tasklet does not lose time
+    tasks[INIT]->rtc_counter += tasks[INIT]->rtc_base;
 }
 
 uint32_t get_time(){
     return sys_time;
 }
 
-/* void do_rtc_irq(int dev_id)
- * Decription: Standard rtc handler
- * input: dev_id - currently unused
- * output: none
- * Side effects: Writes to the RTC and updates time counters
+/* uint32_t get_ticks()
+ * Decription: Gives the time since boot with RTC resolution
+ * input: none
+ * output: time since boot in 1/MAX_RTC_FREQ second ticks
+ * Side effects: none
  */
-void do_rtc_irq(int dev_id) {
+uint32_t get_ticks(){
+    return ticks;
+}
 
-    // Reset rtc_flag
+/* void rtc_tasklet_func(uint32_t data)
+ * Decription: The work of an RTC interrupt that can wait for interrupts to
+ *             be on. Counts down every task's period, wakes the sleepers
+ *             and keeps the system time.
+ * input: data - unused
+ * output: none
+ * Side effects: wakes tasks, may send ALARM signals and write to the RTC
+ */
+static void rtc_tasklet_func(uint32_t data) {
+    uint32_t flags;
     uint8_t task;
+    bool expired = false;
+
+    // Take every tick since the last run, however many interrupts that was
+    cli_and_save(flags);
+    int32_t elapsed = unhandled_ticks;
+    unhandled_ticks = 0;
+    restore_flags(flags);
+
     for (task = 0; task < NUM_TASKS; task++) {
-        tasks[task]->rtc_counter-= rtc_freq;
+        // Tasks that never read stop counting before the counter can wrap
+        if (tasks[task]->rtc_counter > -RTC_COUNTER_FLOOR) {
+            tasks[task]->rtc_counter -= elapsed;
+        }
+        if (tasks[task]->rtc_counter <= 0 && (rtc_wait.tasks & (1 << task))) {
+            expired = true;
+        }
+    }
+    if (expired) {
+        wake_up(&rtc_wait);
+    }
+
+    if (rtc_tick_wait.tasks) {
+        wake_up(&rtc_tick_wait);
     }
 
-    if(!tasks[INIT]->rtc_counter){
+    // elapsed may cover several seconds if the tasklet ran late
+    while (tasks[INIT]->rtc_counter <= 0) {
         update_time(!num_open && rtc_freq != (MAX_RTC_FREQ >> BASE_RTC_LOG));
     }
+}
+
+/* void do_rtc_irq(int dev_id)
+ * Decription: Standard rtc handler. Only counts the tick and acknowledges
+ *             it, rtc_tasklet does the rest.
+ * input: dev_id - currently unused
+ * output: none
+ * Side effects: Writes to the RTC and updates time counters
+ */
+void do_rtc_irq(int dev_id) {
+    ticks += rtc_freq;
+    unhandled_ticks += rtc_freq;
+    tasklet_schedule(&rtc_tasklet);
+
     // read port C to acknowledge the interrupt
     outb(CHOOSE_RTC_C, RTC_PORT);
     inb(RTC_PORT + 1);
@@ -15,6 +15,8 @@
 #define DEFAULT_RTC_FREQ (MAX_RTC_FREQ/2)
 #define RTC_CMD_A 0x20
 #define RTC_CMD_B 0x40
+// rtc_counter never goes below minus this, about 17 minutes
+#define RTC_COUNTER_FLOOR (MAX_RTC_FREQ * 1024)
 
 /*Call to initialize RTC*/
 extern void rtc_init();
@@ -28,8 +30,15 @@ extern int32_t rtc_write(int32_t fd, const void* buf, int32_t nbytes);
 extern int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes);
 //system call to get stats from rtc
 extern int32_t rtc_stat(int32_t fd, void* buf, int32_t nbytes);
+//checks whether an rtc read would sleep
+extern int32_t rtc_poll(int32_t fd, wait_queue_t** wait);
 /*Get system time, in seconds since boot*/
 extern uint32_t get_time();
+/*Get system time, in 1/MAX_RTC_FREQ second ticks since boot*/
+extern uint32_t get_ticks();
+
+// Woken on every RTC interrupt, for sleeping with a timeout
+extern wait_queue_t rtc_tick_wait;
 
 //struct to store system call function pointers
 file_ops_t rtc_ops;
@@ -7,6 +7,8 @@
 #include "x86_desc.h"
 #include "i8259.h"
 #include "signals.h"
+#include "spinlock.h"
+#include "softirq.h"
 
 uint32_t term_process[NUM_TERM] = {0, 0, 0};
 
@@ -14,8 +16,18 @@ uint32_t active = 0;
 
 bool interupt_preempt = false;
 
+volatile uint32_t preempt_count = 0;
+volatile uint32_t need_resched = 0;
+
+spinlock_t tasks_lock = SPIN_LOCK_UNLOCKED;
+spinlock_t term_lock = SPIN_LOCK_UNLOCKED;
+
 static int cur_p = 0;
 
+// Set while reschedule raises the timer vector in software. No irq is in
+// service then, and a non-specific EOI would acknowledge some other one.
+static volatile bool soft_tick = false;
+
 #define PIT_PORT_COMMAND 0x43
 #define PIT_PORT_CHANNEL_0 0x40
 #define LOW_FREQ_BYTE 0
@@ -26,7 +38,7 @@ static int cur_p = 0;
  * Decription: Switches the active process
  * input: none
  * output: none
- * Side effects: writes to the PIT, changes the current task
+ * Side effects: writes to the PIT, changes the current task, enables interrupts
  */
 void reschedule() {
     cli();
@@ -34,9 +46,75 @@ void reschedule() {
     outb(LOW_FREQ_BYTE, PIT_PORT_CHANNEL_0);
     outb(HIGH_FREQ_BYTE, PIT_PORT_CHANNEL_0);
 
+    // Interrupts stay off until the int so a real tick can't see the flag
+    soft_tick = true;
+    asm volatile("int $0x20;");
+
     sti();
+}
 
-    asm volatile("int $0x20;");
+/* void sleep_on(wait_queue_t *queue)
+ * Decription: Puts the current task to sleep until wake_up is called on queue.
+ *             Callers check their condition with interrupts off and call this
+ *             in a loop, so a wake up between the check and the sleep is not lost.
+ * input: queue - queue to sleep on
+ * output: none
+ * Side effects: reschedules, enables interrupts
+ */
+void sleep_on(wait_queue_t *queue) {
+    cli();
+    wait_add(queue);
+    tasks[cur_task]->status = TASK_SLEEPING;
+
+    reschedule();
+
+    // Something other than wake_up may have made us runnable
+    cli();
+    wait_remove(queue);
+    sti();
+}
+
+/* void wait_add(wait_queue_t *queue)
+ * Decription: Adds the current task to queue so the next wake_up on it
+ *             makes the task runnable. Interrupts must be off.
+ * input: queue - queue to wait on
+ * output: none
+ * Side effects: modifies queue
+ */
+void wait_add(wait_queue_t *queue) {
+    queue->tasks |= 1 << cur_task;
+}
+
+/* void wait_remove(wait_queue_t *queue)
+ * Decription: Takes the current task off queue. Interrupts must be off.
+ * input: queue - queue to stop waiting on
+ * output: none
+ * Side effects: modifies queue
+ */
+void wait_remove(wait_queue_t *queue) {
+    queue->tasks &= ~(1 << cur_task);
+}
+
+/* void wake_up(wait_queue_t *queue)
+ * Decription: Wakes every task sleeping on queue
+ * input: queue - queue to wake
+ * output: none
+ * Side effects: changes task status
+ */
+void wake_up(wait_queue_t *queue) {
+    uint32_t flags;
+    uint32_t woken;
+    int i;
+
+    cli_and_save(flags);
+    woken = queue->tasks;
+    queue->tasks = 0;
+    for (i = 0; woken != 0; i++, woken >>= 1) {
+        if ((woken & 1) && tasks[i]->status == TASK_SLEEPING) {
+            tasks[i]->status = TASK_RUNNING;
+        }
+    }
+    restore_flags(flags);
 }
 
 /* void backup_uesp(hw_context_t *hw_context)
@@ -51,8 +129,34 @@ void backup_uesp(hw_context_t *hw_context) {
     }
 }
 
+/* void timer_tick()
+ * Decription: PIT irq handler, also raised in software by reschedule.
+ *             Runs deferred work, then switches the active process unless
+ *             the running code has preemption disabled, in which case the
+ *             switch waits for preempt_enable.
+ * input: none
+ * output: none
+ * Side effects: may switch the active process
+ */
+void timer_tick() {
+    if (soft_tick) {
+        soft_tick = false;
+    } else {
+        send_eoi(0);
+    }
+    if (softirq_pending) {
+        do_softirq();
+    }
+    if (preempt_count != 0) {
+        need_resched = 1;
+        return;
+    }
+    schedule();
+}
+
 /* void schedule()
- * Decription: PIT irq handler, switches the active process
+ * Decription: switches the active process. Called from the timer and on
+ *             return from an interrupt that set need_resched.
  * input: none
  * output: none
  * Side effects: switches the active process
@@ -62,7 +166,7 @@ void schedule() {
     asm volatile("movl %%ebp, %0;" : "=r"(ebp) : );
     tasks[cur_task]->ebp = ebp;
 
-    send_eoi(0);
+    need_resched = 0;
 
     if (backup_init_ebp) {
         cur_task = INIT;
@@ -87,9 +191,16 @@ void schedule() {
         }
     }
 
-    switch_page_directory(cur_task);
+    // Sibling threads share a page directory, so switching between them
+    // leaves CR3 and the TLB alone
+    uint32_t cr3;
+    asm volatile("movl %%cr3, %0;" : "=r"(cr3) : );
+    if (cr3 != (uint32_t)tasks[cur_task]->page_directory) {
+        switch_page_directory(cur_task);
+    }
 
     tss.esp0 = tasks[cur_task]->kernel_esp;
+    tls_load(cur_task);
 
     ebp = tasks[cur_task]->ebp;
     asm volatile("movl %0, %%ebp;" : : "r"(ebp));
@@ -37,13 +37,31 @@ typedef struct {
     iret_context_t iret_context;
 } hw_context_t;
 
+// Tasks sleeping on something, one bit per index into tasks
+typedef struct wait_queue {
+    volatile uint32_t tasks;
+} wait_queue_t;
+
+// Puts the current task to sleep until wake_up is called on queue
+extern void sleep_on(wait_queue_t *queue);
+
+// Wakes every task sleeping on queue
+extern void wake_up(wait_queue_t *queue);
+
+// Adds or removes the current task on a queue, for waiting on several at once
+extern void wait_add(wait_queue_t *queue);
+extern void wait_remove(wait_queue_t *queue);
+
 // Back up the user stack pointer
 extern void backup_uesp(hw_context_t *hw_contex);
 
 // Switches the active process
 extern void reschedule();
 
-// PIT irq handler, switches the active process
+// PIT irq handler, switches the active process unless preemption is off
+extern void timer_tick();
+
+// Switches the active process
 extern void schedule();
 
 // Initialzes the PIT
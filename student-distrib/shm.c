@@ -0,0 +1,240 @@
+/* shm.c - Named shared memory segments
+ */
+
+#include "shm.h"
+#include "lib.h"
+#include "page.h"
+#include "task.h"
+#include "spinlock.h"
+
+static shm_t segments[NUM_SHM];
+
+// Kernel memory is identity mapped, so these are also the physical pages
+// mapped for the user
+static uint8_t shm_pool[SHM_POOL_PAGES][KB4] __attribute__((aligned (KB4)));
+static bool shm_pool_used[SHM_POOL_PAGES];
+
+// Interrupt handlers never touch segments, so holding this only keeps
+// other tasks out
+static spinlock_t shm_lock = SPIN_LOCK_UNLOCKED;
+
+/* int32_t copy_name(const uint8_t* name, int8_t* buf)
+ * Description: Copies a segment name out of user memory
+ * Input:  name - user pointer to a NUL terminated name
+ *         buf - SHM_NAME_LEN bytes to copy into
+ * Output: -1 if name is outside the task, empty or too long, 0 on success
+ * Side Effects: writes to buf
+ */
+static int32_t copy_name(const uint8_t* name, int8_t* buf) {
+    uint32_t i;
+    for (i = 0; i < SHM_NAME_LEN; i++) {
+        if ((uint32_t)(name + i) < TASK_ADDR || (uint32_t)(name + i) >= (TASK_ADDR + MB4)) {
+            return -1;
+        }
+        buf[i] = name[i];
+        if (buf[i] == '\0') {
+            return i == 0 ? -1 : 0;
+        }
+    }
+    return -1;
+}
+
+/* int32_t find_segment(const int8_t* name)
+ * Description: Looks up a segment by name
+ * Input:  name - name copied by copy_name
+ * Output: index into segments, -1 if there is none
+ * Side Effects: none
+ */
+static int32_t find_segment(const int8_t* name) {
+    int32_t i;
+    for (i = 0; i < NUM_SHM; i++) {
+        if (segments[i].users != 0 && !strncmp(segments[i].name, name, SHM_NAME_LEN)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* void set_pages(uint32_t task, int32_t seg, bool present)
+ * Description: Maps or unmaps a segment's pages in a task
+ * Input:  task - task to change
+ *         seg - index into segments
+ *         present - whether to map or unmap
+ * Output: none
+ * Side Effects: changes the task's user video table
+ */
+static void set_pages(uint32_t task, int32_t seg, bool present) {
+    uint32_t i;
+    for (i = 0; i < segments[seg].num_pages; i++) {
+        page_table_kb_entry_t *entry = (page_table_kb_entry_t *)&tasks[task]->usr_vid_table[SHM_PTE_BASE + seg * SHM_MAX_PAGES + i];
+        entry->addr = (uint32_t)shm_pool[segments[seg].pages[i]] >> 12;
+        entry->avail = 0;
+        entry->global = 0;
+        entry->pgTblAttIdx = 0;
+        entry->dirty = 0;
+        entry->accessed = 0;
+        entry->cacheDisabled = 0;
+        entry->writeThrough = 0;
+        entry->userSupervisor = 1;
+        entry->readWrite = 1;
+        entry->present = present;
+    }
+
+    if (present) {
+        // The video table's directory entry has to allow user access. Its
+        // other entries keep their own permissions.
+        ((page_dir_kb_entry_t*)tasks[task]->page_directory + TASK_VIDEO_OFFSET)->userSupervisor = 1;
+    }
+}
+
+/* void drop_user(uint32_t task, int32_t seg)
+ * Description: Takes a task off a segment, freeing it if it was the last user
+ * Input:  task - task that has seg mapped
+ *         seg - index into segments
+ * Output: none
+ * Side Effects: unmaps the pages, may free them
+ */
+static void drop_user(uint32_t task, int32_t seg) {
+    set_pages(task, seg, false);
+    segments[seg].users &= ~(1 << task);
+    if (segments[seg].users == 0) {
+        uint32_t i;
+        for (i = 0; i < segments[seg].num_pages; i++) {
+            shm_pool_used[segments[seg].pages[i]] = false;
+        }
+        segments[seg].num_pages = 0;
+    }
+}
+
+/* int32_t sys_shm_create(const uint8_t* name, uint32_t size, uint8_t** addr)
+ * Description: Creates a zeroed segment and maps it into the current task
+ * Input:  name - name other tasks map the segment by
+ *         size - bytes, rounded up to whole pages, at most SHM_MAX_PAGES
+ *         addr - pointer to what becomes a pointer to the segment
+ * Output: -1 if the name is taken or there is no room, 0 on success
+ * Side Effects: writes to *addr, changes the task's page tables
+ */
+int32_t sys_shm_create(const uint8_t* name, uint32_t size, uint8_t** addr) {
+    int8_t buf[SHM_NAME_LEN];
+    uint32_t num_pages = (size + KB4 - 1) / KB4;
+    if ((uint32_t)addr < TASK_ADDR || (uint32_t)addr >= (TASK_ADDR + MB4) ||
+        copy_name(name, buf) != 0 || num_pages == 0 || num_pages > SHM_MAX_PAGES) {
+        return -1;
+    }
+
+    spin_lock(&shm_lock);
+
+    int32_t seg;
+    for (seg = 0; seg < NUM_SHM; seg++) {
+        if (segments[seg].users == 0) {
+            break;
+        }
+    }
+    if (seg >= NUM_SHM || find_segment(buf) != -1) {
+        spin_unlock(&shm_lock);
+        return -1;
+    }
+
+    uint32_t i;
+    uint32_t n = 0;
+    for (i = 0; i < SHM_POOL_PAGES && n < num_pages; i++) {
+        if (!shm_pool_used[i]) {
+            segments[seg].pages[n++] = i;
+        }
+    }
+    if (n < num_pages) {
+        spin_unlock(&shm_lock);
+        return -1;
+    }
+
+    for (i = 0; i < num_pages; i++) {
+        shm_pool_used[segments[seg].pages[i]] = true;
+        memset(shm_pool[segments[seg].pages[i]], 0, KB4);
+    }
+    memcpy(segments[seg].name, buf, SHM_NAME_LEN);
+    segments[seg].num_pages = num_pages;
+    segments[seg].users = 1 << TASK_PROC(cur_task);
+    set_pages(TASK_PROC(cur_task), seg, true);
+    spin_unlock(&shm_lock);
+
+    // Flush the TLB
+    switch_page_directory(cur_task);
+
+    *addr = (uint8_t *)SHM_ADDR(seg);
+    return 0;
+}
+
+/* int32_t sys_shm_map(const uint8_t* name, uint8_t** addr)
+ * Description: Maps a segment created by any task into the current task
+ * Input:  name - name given to sys_shm_create
+ *         addr - pointer to what becomes a pointer to the segment
+ * Output: -1 if there is no such segment, otherwise its size in bytes
+ * Side Effects: writes to *addr, changes the task's page tables
+ */
+int32_t sys_shm_map(const uint8_t* name, uint8_t** addr) {
+    int8_t buf[SHM_NAME_LEN];
+    if ((uint32_t)addr < TASK_ADDR || (uint32_t)addr >= (TASK_ADDR + MB4) || copy_name(name, buf) != 0) {
+        return -1;
+    }
+
+    spin_lock(&shm_lock);
+    int32_t seg = find_segment(buf);
+    if (seg == -1) {
+        spin_unlock(&shm_lock);
+        return -1;
+    }
+    segments[seg].users |= 1 << TASK_PROC(cur_task);
+    set_pages(TASK_PROC(cur_task), seg, true);
+    spin_unlock(&shm_lock);
+
+    // Flush the TLB
+    switch_page_directory(cur_task);
+
+    *addr = (uint8_t *)SHM_ADDR(seg);
+    return segments[seg].num_pages * KB4;
+}
+
+/* int32_t sys_shm_unmap(const uint8_t* name)
+ * Description: Unmaps a segment from the current task
+ * Input:  name - name of a segment the task has mapped
+ * Output: -1 if the task does not have it mapped, 0 on success
+ * Side Effects: changes the task's page tables, frees the segment if no
+ *               other task has it
+ */
+int32_t sys_shm_unmap(const uint8_t* name) {
+    int8_t buf[SHM_NAME_LEN];
+    if (copy_name(name, buf) != 0) {
+        return -1;
+    }
+
+    spin_lock(&shm_lock);
+    int32_t seg = find_segment(buf);
+    if (seg == -1 || !(segments[seg].users & (1 << TASK_PROC(cur_task)))) {
+        spin_unlock(&shm_lock);
+        return -1;
+    }
+    drop_user(TASK_PROC(cur_task), seg);
+    spin_unlock(&shm_lock);
+
+    // Flush the TLB
+    switch_page_directory(cur_task);
+    return 0;
+}
+
+/* void shm_release(uint32_t task)
+ * Description: Drops every segment a halting process still has mapped
+ * Input:  task - the halting process
+ * Output: none
+ * Side Effects: may free segments
+ */
+void shm_release(uint32_t task) {
+    int32_t seg;
+
+    spin_lock(&shm_lock);
+    for (seg = 0; seg < NUM_SHM; seg++) {
+        if (segments[seg].users & (1 << task)) {
+            drop_user(task, seg);
+        }
+    }
+    spin_unlock(&shm_lock);
+}
@@ -0,0 +1,45 @@
+/* shm.h - Named shared memory segments
+ */
+
+#ifndef SHM_H
+#define SHM_H
+
+#include "types.h"
+#include "page.h"
+
+#define NUM_SHM 8
+#define SHM_NAME_LEN 32
+// Largest segment, in pages
+#define SHM_MAX_PAGES 16
+// Pages shared by every segment
+#define SHM_POOL_PAGES 64
+
+// Segment i is mapped at the same address in every task, in the user video
+// table between vidmap_all's entries and the uring page
+#define SHM_PTE_BASE 512
+#define SHM_ADDR(i) (TASK_ADDR + MB4 + (SHM_PTE_BASE + (i) * SHM_MAX_PAGES) * KB4)
+
+typedef struct shm {
+    int8_t name[SHM_NAME_LEN];
+    uint32_t num_pages;
+    // Indices into the page pool
+    uint8_t pages[SHM_MAX_PAGES];
+    // One bit for each process that has the segment mapped. Threads map it
+    // for their whole process. The segment is freed when the last process
+    // unmaps it or halts.
+    uint32_t users;
+} shm_t;
+
+// Creates a segment and maps it into the current task
+extern int32_t sys_shm_create(const uint8_t* name, uint32_t size, uint8_t** addr);
+
+// Maps an existing segment into the current task
+extern int32_t sys_shm_map(const uint8_t* name, uint8_t** addr);
+
+// Unmaps a segment from the current task
+extern int32_t sys_shm_unmap(const uint8_t* name);
+
+// Drops every segment a halting process still has mapped
+extern void shm_release(uint32_t task);
+
+#endif
@@ -4,15 +4,72 @@
 #include "lib.h"
 #include "x86_desc.h"
 #include "page.h"
+#include "entry.h"
+#include "spinlock.h"
+
+/* void update_work(uint32_t task)
+ * Description: recomputes the WORK_SIGNAL bit of a task after its pending
+ *              or blocked signals change. Interrupts must be off.
+ * Input:  task - task to update
+ * Output: none
+ * Side Effects: changes work_pending
+ */
+void update_work(uint32_t task) {
+    if (tasks[task]->pending_signals & ~tasks[task]->blocked) {
+        tasks[task]->work_pending |= WORK_SIGNAL;
+    } else {
+        tasks[task]->work_pending &= ~WORK_SIGNAL;
+    }
+}
+
+/* bool signal_ignored(uint32_t task, int32_t signal)
+ * Description: checks whether delivering a signal would do nothing
+ * Input:  task - task the signal is for
+ *         signal - which signal
+ * Output: true if the task has no handler and the default is to ignore it
+ * Side Effects: none
+ */
+static bool signal_ignored(uint32_t task, int32_t signal) {
+    if (signal_handlers[task][signal] != NULL) {
+        return false;
+    }
+    return signal != DIV_ZERO && signal != SEGFAULT && signal != INTERRUPT;
+}
+
+/* void send_signal(uint32_t task, int32_t signal)
+ * Description: marks a signal pending for a task. Signals the task would
+ *              ignore are dropped here so they never cost a delivery.
+ * Input:  task - task to signal
+ *         signal - any signal below RT_MIN
+ * Output: none
+ * Side Effects: changes pending_signals and work_pending
+ */
+void send_signal(uint32_t task, int32_t signal) {
+    uint32_t flags;
+
+    if (tasks[task]->status == TASK_EMPTY || signal_ignored(task, signal)) {
+        return;
+    }
+    cli_and_save(flags);
+    SET_SIGNAL(task, signal);
+    update_work(task);
+    restore_flags(flags);
+}
 
 /* void check_for_signals(hw_context_t *hw_context)
- * Description: check for signals for the current task
+ * Description: check for signals for the current task. The return path only
+ *              calls this when the task has work pending.
  * Input:  hw_context - pointer to hw_context to return to
  * Output: none
  * Side Effects: runs signal handlers
  */
 void check_for_signals(hw_context_t *hw_context) {
-    if (tasks[cur_task]->pending_signals != 0) {
+    // Not from inside a softirq pass or a spinlock, the handler would run
+    // with preemption still off. The signal stays pending until later.
+    if (preempt_count != 0) {
+        return;
+    }
+    if (tasks[cur_task]->work_pending & WORK_SIGNAL) {
         if (hw_context->iret_context.cs == KERNEL_CS) {
             uint32_t ebp;
             asm volatile("movl %%ebp, %0;" : "=r"(ebp) : );
@@ -42,74 +99,203 @@ void handle_default_signal(int32_t signal) {
     }
 }
 
+/* int32_t take_signal(int32_t signal)
+ * Description: clears a signal that is about to be delivered. A real-time
+ *              signal comes off the queue and stays pending if more of it
+ *              are queued. Interrupts must be off.
+ * Input:  signal - a pending signal of the current task
+ * Output: the value sent with a real-time signal, otherwise 0
+ * Side Effects: changes pending_signals and the signal queue
+ */
+static int32_t take_signal(int32_t signal) {
+    pcb_t *task = tasks[cur_task];
+    int32_t value = 0;
+    bool more = false;
+    uint32_t i;
+
+    if (signal < RT_MIN) {
+        CLEAR_SIGNAL(cur_task, signal);
+        return 0;
+    }
+
+    for (i = 0; i < task->sigqueue_len; i++) {
+        if (task->sigqueue[i].signal == signal) {
+            value = task->sigqueue[i].value;
+            break;
+        }
+    }
+    for (; i + 1 < task->sigqueue_len; i++) {
+        task->sigqueue[i] = task->sigqueue[i + 1];
+        more |= task->sigqueue[i].signal == signal;
+    }
+    task->sigqueue_len--;
+
+    if (!more) {
+        CLEAR_SIGNAL(cur_task, signal);
+    }
+    return value;
+}
+
 /* void handle_signals(hw_context_t *hw_context)
- * Description: executes signal handlers
+ * Description: delivers the lowest unblocked pending signal. A handler is
+ *              called with the signal number and the value it was sent
+ *              with, and every signal but SIG_UNBLOCKABLE is blocked
+ *              until it returns. The old mask and the previous handler's
+ *              context go in the signal frame, so handlers can nest.
  * Input:  hw_context - pointer to hw_context to return to
  * Output: none
  * Side Effects: changes hw context to run signal handlers
  */
 void handle_signals(hw_context_t *hw_context) {
-    uint8_t signal;
-    if (tasks[cur_task]->signal_mask == false) {
-        for (signal = 0; signal < NUM_SIGNALS; signal++) {
-            if (SIGNAL_SET(cur_task, signal)) {
-                CLEAR_SIGNAL(cur_task, signal);
-                if (signal_handlers[cur_task][signal] == NULL) {
-                    handle_default_signal(signal);
-                } else {
-                    tasks[cur_task]->signal_mask = true;
-                    uint8_t *uesp = (uint8_t *)tasks[cur_task]->user_esp - 4;
-                    // Put the following assembly on the user stack:
-                    // pushl $0xA, %eax
-                    // int $0x80
-                    *uesp = 0x00; uesp--;
-                    *uesp = 0x80; uesp--;
-                    *uesp = 0xCD; uesp--;
-                    *uesp = 0x00; uesp--;
-
-                    *uesp = 0x00; uesp--;
-                    *uesp = 0x00; uesp--;
-                    *uesp = 0x0A; uesp--;
-                    *uesp = 0xB8;
-
-                    uint32_t return_addr = (uint32_t)uesp;
-                    uesp -= 1;
-
-                    if (hw_context->iret_context.cs == KERNEL_CS) {
-                        uesp -= sizeof(hw_context_t) - 8;
-                        memcpy(uesp, hw_context, sizeof(hw_context_t) - 8);
-                    } else {
-                        uesp -= sizeof(hw_context_t);
-                        memcpy(uesp, hw_context, sizeof(hw_context_t));
-                    }
-                    tasks[cur_task]->sig_hw_context = (hw_context_t *)uesp;
-
-                    uesp -= 4;
-                    *(uint32_t *)uesp = signal;
-                    uesp -= 4;
-                    *(uint32_t *)uesp = return_addr;
-
-                    asm volatile("                             \n\
-                    movw $" str(USER_DS) ", %%ax               \n\
-                    movw %%ax, %%ds                            \n\
-                    movw %%ax, %%es                            \n\
-                    movw %%ax, %%fs                            \n\
-                    movw %%ax, %%gs                            \n\
-                                                               \n\
-                    pushl $" str(USER_DS) "                    \n\
-                    pushl %1                                   \n\
-                    pushf                                      \n\
-                    popl %%eax                                 \n\
-                    orl $0x200, %%eax                          \n\
-                    pushl %%eax                                \n\
-                    pushl $" str(USER_CS) "                    \n\
-                    pushl %0                                   \n\
-                    iret                                       \n\
-                    "
-                                 :
-                                 : "b"(signal_handlers[cur_task][signal]), "c"(uesp));
-                }
-            }
+    uint32_t ready;
+
+    cli();
+    while ((ready = tasks[cur_task]->pending_signals & ~tasks[cur_task]->blocked) != 0) {
+        int32_t signal = 0;
+        while (!(ready & (1 << signal))) {
+            signal++;
+        }
+        int32_t value = take_signal(signal);
+        update_work(cur_task);
+
+        if (signal_handlers[cur_task][signal] == NULL) {
+            handle_default_signal(signal);
+            continue;
+        }
+
+        uint32_t old_blocked = tasks[cur_task]->blocked;
+        // Faults stay deliverable, or a fault in the handler would retry forever
+        tasks[cur_task]->blocked = ~SIG_UNBLOCKABLE & ((1 << NUM_SIGNALS) - 1);
+        update_work(cur_task);
+
+        uint8_t *uesp = (uint8_t *)tasks[cur_task]->user_esp;
+
+        if (hw_context->iret_context.cs == KERNEL_CS) {
+            uesp -= sizeof(hw_context_t) - 8;
+            memcpy(uesp, hw_context, sizeof(hw_context_t) - 8);
+        } else {
+            uesp -= sizeof(hw_context_t);
+            memcpy(uesp, hw_context, sizeof(hw_context_t));
         }
+
+        // A fault in a handler nests another handler, so what sys_sigreturn
+        // puts back lives in this frame rather than in the pcb
+        uesp -= 4;
+        *(uint32_t *)uesp = old_blocked;
+        uesp -= 4;
+        *(hw_context_t **)uesp = tasks[cur_task]->sig_hw_context;
+        tasks[cur_task]->sig_hw_context = (hw_context_t *)(uesp + 8);
+
+        uesp -= 4;
+        *(int32_t *)uesp = value;
+        uesp -= 4;
+        *(uint32_t *)uesp = signal;
+        // The handler returns into the trampoline, which calls sys_sigreturn
+        uesp -= 4;
+        *(uint32_t *)uesp = TRAMPOLINE(sigreturn_trampoline);
+
+        trace_irqs_on();
+        asm volatile("                             \n\
+        movw $" str(USER_DS) ", %%ax               \n\
+        movw %%ax, %%ds                            \n\
+        movw %%ax, %%es                            \n\
+        movw %%ax, %%fs                            \n\
+                                                   \n\
+        pushl $" str(USER_DS) "                    \n\
+        pushl %1                                   \n\
+        pushf                                      \n\
+        popl %%eax                                 \n\
+        orl $0x200, %%eax                          \n\
+        pushl %%eax                                \n\
+        pushl $" str(USER_CS) "                    \n\
+        pushl %0                                   \n\
+        iret                                       \n\
+        "
+                     :
+                     : "b"(signal_handlers[cur_task][signal]), "c"(uesp));
+    }
+    sti();
+}
+
+/* int32_t sys_sigprocmask(int32_t how, uint32_t set, uint32_t* oldset)
+ * Description: changes which signals the current task blocks. Blocked
+ *              signals stay pending until they are unblocked.
+ * Input:  how - SIG_BLOCK, SIG_UNBLOCK or SIG_SETMASK
+ *         set - signals to change, (1 << signum)
+ *         oldset - gets the mask from before the call, may be NULL
+ * Output: -1 if how or oldset is bad, 0 on success
+ * Side Effects: changes blocked, may deliver signals on the way out
+ */
+int32_t sys_sigprocmask(int32_t how, uint32_t set, uint32_t* oldset) {
+    if (oldset != NULL && ((uint32_t)oldset < TASK_ADDR || (uint32_t)(oldset + 1) > TASK_ADDR + MB4)) {
+        return -1;
+    }
+
+    uint32_t flags;
+    cli_and_save(flags);
+    uint32_t old = tasks[cur_task]->blocked;
+    switch (how) {
+    case SIG_BLOCK:
+        tasks[cur_task]->blocked |= set;
+        break;
+    case SIG_UNBLOCK:
+        tasks[cur_task]->blocked &= ~set;
+        break;
+    case SIG_SETMASK:
+        tasks[cur_task]->blocked = set;
+        break;
+    default:
+        restore_flags(flags);
+        return -1;
+    }
+    tasks[cur_task]->blocked &= ~SIG_UNBLOCKABLE & ((1 << NUM_SIGNALS) - 1);
+    update_work(cur_task);
+    restore_flags(flags);
+
+    if (oldset != NULL) {
+        *oldset = old;
+    }
+    return 0;
+}
+
+/* int32_t sys_sigqueue(uint32_t task, int32_t signum, int32_t value)
+ * Description: sends a signal to a task. Real-time signals are queued and
+ *              each one is delivered with its value, other signals are
+ *              only marked pending and the value is dropped.
+ * Input:  task - index of the task to signal, 0 for the current task
+ *         signum - USER1 or a real-time signal
+ *         value - passed to the handler of a real-time signal
+ * Output: -1 if the task or signal is bad or the task's queue is full,
+ *         0 on success, including when the task ignores the signal
+ * Side Effects: changes the task's pending signals
+ */
+int32_t sys_sigqueue(uint32_t task, int32_t signum, int32_t value) {
+    if (task == 0) {
+        task = cur_task;
+    }
+    if (task >= NUM_TASKS || signum < USER1 || signum >= NUM_SIGNALS ||
+        tasks[task]->status == TASK_EMPTY || tasks[task]->status == TASK_ZOMBIE) {
+        return -1;
+    }
+    if (signum < RT_MIN) {
+        send_signal(task, signum);
+        return 0;
+    }
+    if (signal_ignored(task, signum)) {
+        return 0;
+    }
+
+    uint32_t flags;
+    cli_and_save(flags);
+    if (tasks[task]->sigqueue_len >= SIGQUEUE_LEN) {
+        restore_flags(flags);
+        return -1;
     }
+    sigqueue_entry_t *entry = &tasks[task]->sigqueue[tasks[task]->sigqueue_len++];
+    entry->signal = signum;
+    entry->value = value;
+    SET_SIGNAL(task, signum);
+    update_work(task);
+    restore_flags(flags);
+    return 0;
 }
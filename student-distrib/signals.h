@@ -4,6 +4,12 @@
 #include "types.h"
 #include "schedule.h"
 
+//recomputes work_pending after a task's pending or blocked signals change
+void update_work(uint32_t task);
+
+//marks a signal pending for a task unless the task would ignore it
+void send_signal(uint32_t task, int32_t signal);
+
 //check for signals for the current task
 void check_for_signals(hw_context_t *hw_context);
 
@@ -13,4 +19,10 @@ void handle_default_signal(int32_t signal);
 //executes signal handlers
 void handle_signals(hw_context_t *hw_context);
 
+//changes which signals the current task blocks
+int32_t sys_sigprocmask(int32_t how, uint32_t set, uint32_t* oldset);
+
+//sends a signal, queued with a value if it is a real-time signal
+int32_t sys_sigqueue(uint32_t task, int32_t signum, int32_t value);
+
 #endif
@@ -0,0 +1,82 @@
+/* softirq.c - Work deferred out of interrupt handlers
+ *
+ * The pass runs on the way out of an interrupt, on the stack of whatever
+ * was interrupted, with interrupts on and preemption off. An interrupt
+ * taken during the pass only queues more tasklets, which the running pass
+ * picks up.
+ */
+
+#include "softirq.h"
+#include "lib.h"
+#include "spinlock.h"
+
+volatile uint32_t softirq_pending = 0;
+
+static tasklet_t* tasklet_head = NULL;
+static tasklet_t** tasklet_tail = &tasklet_head;
+
+// Set while a pass runs so a nested interrupt does not start another one
+static bool in_softirq = false;
+
+/* void tasklet_schedule(tasklet_t* t)
+ * Description: Queues a tasklet for the next softirq pass, unless it is
+ *              already queued
+ * Input:  t - tasklet to run, must stay allocated
+ * Output: none
+ * Side Effects: sets softirq_pending
+ */
+void tasklet_schedule(tasklet_t* t) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if (!t->scheduled) {
+        t->scheduled = 1;
+        t->next = NULL;
+        *tasklet_tail = t;
+        tasklet_tail = &t->next;
+        softirq_pending = 1;
+    }
+    restore_flags(flags);
+}
+
+/* void do_softirq()
+ * Description: Runs queued tasklets with interrupts on. Interrupts must be
+ *              off and the interrupt's EOI sent. The pass is bounded, so a
+ *              tasklet that keeps scheduling itself cannot hold up the
+ *              interrupted task.
+ * Input:  none
+ * Output: none
+ * Side Effects: runs tasklets, returns with interrupts off
+ */
+void do_softirq() {
+    uint32_t round;
+
+    if (in_softirq) {
+        return;
+    }
+    in_softirq = true;
+    preempt_disable();
+
+    // raw_ versions, this all still counts as interrupt handler time,
+    // which irqsoff does not trace
+    for (round = 0; round < SOFTIRQ_ROUNDS && softirq_pending; round++) {
+        tasklet_t* t = tasklet_head;
+        tasklet_head = NULL;
+        tasklet_tail = &tasklet_head;
+        softirq_pending = 0;
+        raw_sti();
+
+        while (t != NULL) {
+            tasklet_t* next = t->next;
+            // Cleared first so the tasklet can be queued again while it runs
+            t->scheduled = 0;
+            (*t->func)(t->data);
+            t = next;
+        }
+
+        raw_cli();
+    }
+
+    preempt_enable_no_resched();
+    in_softirq = false;
+}
@@ -0,0 +1,36 @@
+/* softirq.h - Work deferred out of interrupt handlers
+ */
+
+#ifndef SOFTIRQ_H
+#define SOFTIRQ_H
+
+#include "types.h"
+
+// A function an interrupt handler wants run soon, but not with interrupts
+// off. Handlers acknowledge the device, record what happened and schedule
+// a tasklet for the rest.
+typedef struct tasklet {
+    struct tasklet* next;
+    // Set while queued, so scheduling it again before it runs runs it once
+    volatile uint32_t scheduled;
+    void (*func)(uint32_t);
+    uint32_t data;
+} tasklet_t;
+
+#define TASKLET_INIT(func, data) {NULL, 0, (func), (data)}
+
+// Rounds of queued tasklets one softirq pass runs. Anything scheduled
+// during the last round waits for the next interrupt.
+#define SOFTIRQ_ROUNDS 4
+
+// Nonzero while a tasklet is queued
+extern volatile uint32_t softirq_pending;
+
+// Queues a tasklet for the next softirq pass
+extern void tasklet_schedule(tasklet_t* t);
+
+// Runs queued tasklets with interrupts on. Called with interrupts off on
+// the way out of an interrupt, after its EOI.
+extern void do_softirq();
+
+#endif
@@ -0,0 +1,137 @@
+/* spinlock.h - Spinlocks and the preempt count
+ */
+
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include "types.h"
+#include "lib.h"
+#include "schedule.h"
+
+// Nonzero while the running code must not be switched away from. The timer
+// only sets need_resched then, and the switch happens once the count drops
+// back to 0. Nothing may sleep while it is nonzero.
+extern volatile uint32_t preempt_count;
+
+// Set when something more important than the running task is ready. Checked
+// on return from interrupts and by preempt_enable.
+extern volatile uint32_t need_resched;
+
+typedef struct spinlock {
+    volatile uint32_t locked;
+} spinlock_t;
+
+#define SPIN_LOCK_UNLOCKED {0}
+
+// Taken while claiming a slot in tasks[] and switching cur_task to it
+extern spinlock_t tasks_lock;
+
+// Taken while changing which task shows on a terminal
+extern spinlock_t term_lock;
+
+/* bool irqs_enabled()
+ * Description: Checks the interrupt flag
+ * Input:  none
+ * Output: true if interrupts are on
+ * Side Effects: none
+ */
+static inline bool irqs_enabled(void) {
+    uint32_t flags;
+    asm volatile("pushfl; popl %0" : "=r"(flags));
+    return (flags & 0x200) != 0;
+}
+
+/* void preempt_disable()
+ * Description: Keeps the scheduler from switching away until preempt_enable
+ * Input:  none
+ * Output: none
+ * Side Effects: increments preempt_count
+ */
+static inline void preempt_disable(void) {
+    preempt_count++;
+    barrier();
+}
+
+/* void preempt_enable_no_resched()
+ * Description: Undoes preempt_disable without switching tasks here
+ * Input:  none
+ * Output: none
+ * Side Effects: decrements preempt_count
+ */
+static inline void preempt_enable_no_resched(void) {
+    barrier();
+    preempt_count--;
+}
+
+/* void cond_resched()
+ * Description: A preemption point for long loops in the kernel. Does
+ *              nothing with interrupts off, since switching would turn them on.
+ * Input:  none
+ * Output: none
+ * Side Effects: may reschedule
+ */
+static inline void cond_resched(void) {
+    if (preempt_count == 0 && need_resched && irqs_enabled()) {
+        reschedule();
+    }
+}
+
+/* void preempt_enable()
+ * Description: Undoes preempt_disable and switches tasks if a timer tick
+ *              came in while preemption was off
+ * Input:  none
+ * Output: none
+ * Side Effects: decrements preempt_count, may reschedule
+ */
+static inline void preempt_enable(void) {
+    preempt_enable_no_resched();
+    cond_resched();
+}
+
+/* void spin_lock(spinlock_t *lock)
+ * Description: Takes a lock that interrupt handlers never take. There is
+ *              one CPU, so with preemption off the lock can only be held
+ *              here already, which is a bug.
+ * Input:  lock - lock to take
+ * Output: none
+ * Side Effects: disables preemption
+ */
+static inline void spin_lock(spinlock_t *lock) {
+    uint32_t old = 1;
+    preempt_disable();
+    do {
+        asm volatile("xchgl %0, %1" : "+r"(old), "+m"(lock->locked) : : "memory");
+    } while (old != 0);
+}
+
+/* void spin_unlock(spinlock_t *lock)
+ * Description: Releases a lock taken with spin_lock
+ * Input:  lock - lock to release
+ * Output: none
+ * Side Effects: enables preemption, may reschedule
+ */
+static inline void spin_unlock(spinlock_t *lock) {
+    barrier();
+    lock->locked = 0;
+    preempt_enable();
+}
+
+// Takes a lock that interrupt handlers also take, with interrupts off
+#define spin_lock_irqsave(lock, flags)          \
+    do {                                        \
+        cli_and_save(flags);                    \
+        spin_lock(lock);                        \
+    } while(0)
+
+// Releases a lock taken with spin_lock_irqsave. A tick that came in while
+// it was held is handled once interrupts are back on.
+#define spin_unlock_irqrestore(lock, flags)     \
+    do {                                        \
+        barrier();                              \
+        (lock)->locked = 0;                     \
+        preempt_enable_no_resched();            \
+        restore_flags(flags);                   \
+        cond_resched();                         \
+    } while(0)
+
+#endif
@@ -9,9 +9,110 @@
 #include "x86_desc.h"
 #include "task.h"
 #include "schedule.h"
+#include "pipe.h"
+#include "shm.h"
+#include "futex.h"
+#include "signals.h"
+#include "spinlock.h"
+#include "apic.h"
+
+// execute clears and loads user memory this much at a time between
+// chances to reschedule
+#define EXEC_CHUNK 0x10000
 
 bool backup_init_ebp = true;
 
+/* int32_t close_fd(int32_t fd)
+ * Description: closes any open fd of cur_task, stdin and stdout included
+ * Input:  fd - index of an open file
+ * Output: the result of the file's close
+ * Side Effects: writes to tasks[cur_task]->file_descs
+ */
+static int32_t close_fd(int32_t fd) {
+    int32_t ret = (*tasks[cur_task]->file_descs[fd].ops->close)(fd);
+
+    tasks[cur_task]->file_descs[fd].flags = FD_CLEAR;
+    tasks[cur_task]->file_descs[fd].mode = 0;
+    tasks[cur_task]->file_descs[fd].inode = 0;
+    tasks[cur_task]->file_descs[fd].file_pos = 0;
+    tasks[cur_task]->file_descs[fd].ops = &default_ops;
+
+    return ret;
+}
+
+/* void release_children(uint8_t proc)
+ * Description: lets go of the spawned children of a halting process. Its
+ *              zombies are freed and the rest will free themselves.
+ * Input:  proc - the halting process
+ * Output: none
+ * Side Effects: changes the status of zombie children
+ */
+static void release_children(uint8_t proc) {
+    uint8_t i;
+    for (i = 1; i < NUM_PROCS; i++) {
+        if (tasks[i]->status == TASK_EMPTY || tasks[i]->spawned != SPAWN_CHILD || tasks[i]->parent != proc) {
+            continue;
+        }
+        if (tasks[i]->status == TASK_ZOMBIE) {
+            tasks[i]->status = TASK_EMPTY;
+        } else {
+            tasks[i]->spawned = SPAWN_ORPHAN;
+        }
+    }
+}
+
+/* uint8_t foreground_child(uint8_t proc, uint8_t skip)
+ * Description: finds a running process that proc started with sys_execute,
+ *              from proc itself or from one of its threads, on skip's terminal
+ * Input:  proc - the process whose children are searched
+ *         skip - a task that may not be returned
+ * Output: the child, or 0 if there is none
+ * Side Effects: none
+ */
+static uint8_t foreground_child(uint8_t proc, uint8_t skip) {
+    uint8_t i;
+    for (i = 1; i < NUM_PROCS; i++) {
+        if (i == skip || tasks[i]->status == TASK_EMPTY || tasks[i]->status == TASK_ZOMBIE ||
+            tasks[i]->spawned != 0 || tasks[i]->terminal != tasks[skip]->terminal) {
+            continue;
+        }
+        if (tasks[i]->parent != proc && TASK_PROC(tasks[i]->parent) != proc) {
+            continue;
+        }
+        return i;
+    }
+    return 0;
+}
+
+/* void hand_off_terminal(uint8_t task)
+ * Description: gives the foreground of a halting task's terminal to whoever
+ *              should get Ctrl-C next. The stages of a pipeline are all
+ *              started by one shell, so the foreground goes to a stage that
+ *              is still running before it goes back to the parent.
+ * Input:  task - the halting task
+ * Output: none
+ * Side Effects: may change term_process
+ */
+static void hand_off_terminal(uint8_t task) {
+    uint32_t term = tasks[task]->terminal;
+    uint8_t parent = tasks[task]->parent;
+    uint8_t next;
+
+    if (term_process[term] != task) {
+        return;
+    }
+
+    next = foreground_child(TASK_PROC(parent), task);
+    if (next == 0) {
+        term_process[term] = parent;
+        return;
+    }
+    // The stage may itself be waiting on a program it ran
+    while ((parent = foreground_child(next, task)) != 0) {
+        next = parent;
+    }
+    term_process[term] = next;
+}
 
 uint32_t halt_status;
 /* int32_t sys_halt(uint32_t status)
@@ -24,24 +125,33 @@ int32_t sys_halt(uint32_t status) {
     cli();
     int i;
 
-    if (tasks[cur_task]->thread_status == 1 && tasks[tasks[cur_task]->parent]->thread_waiting == cur_task) {
+    if (tasks[cur_task]->thread_status == 1 && tasks[tasks[cur_task]->parent]->status == TASK_WAITING_FOR_THREAD &&
+        tasks[tasks[cur_task]->parent]->thread_waiting == cur_task) {
         tasks[tasks[cur_task]->parent]->status = TASK_RUNNING;
         CLEAR_THREAD(tasks[cur_task]->parent, cur_task);
         tasks[cur_task]->status = TASK_EMPTY;
+        // Switching back to the parent flushes the TLB
+        thread_stack_unmap(cur_task);
         goto sys_halt_return;
     } else if (tasks[cur_task]->thread_status == 1) {
+        // Nobody is joining yet, and the parent may be asleep (in
+        // sys_execute, say), so leave it alone. sys_thread_join reaps us.
         tasks[cur_task]->status = TASK_ZOMBIE;
-        goto sys_halt_return;
+        terminal_unmap_task(cur_task);
+        hand_off_terminal(cur_task);
+        reschedule();
     } else if (tasks[cur_task]->thread_status > 1) {
         i = 0;
         while (tasks[cur_task]->thread_status != 0) {
             if (tasks[cur_task]->thread_status & 1) {
                 tasks[i]->status = TASK_EMPTY;
-                tasks[i]->page_directory[34] = 2;
+                futex_release(i);
+                terminal_unmap_task(i);
             }
             tasks[cur_task]->thread_status >>= 1;
             i++;
         }
+        tasks[cur_task]->status = TASK_EMPTY;
         goto sys_halt_cleanup_files;
     } else {
         tasks[cur_task]->status = TASK_EMPTY;
@@ -49,20 +159,44 @@ int32_t sys_halt(uint32_t status) {
     }
 
 sys_halt_cleanup_files:
+    shm_release(cur_task);
+    release_children(cur_task);
+
+    // stdin and stdout too, they may be pipes
     for (i = 0; i < FILE_DESCS_LENGTH; i++) {
         if (tasks[cur_task]->file_descs[i].flags != FD_CLEAR) {
-            sys_close(i);
+            close_fd(i);
         }
     }
 
+    if (tasks[cur_task]->spawned != 0) {
+        // Nobody is blocked in execute for a spawned process. It stays a
+        // zombie until its parent collects the status with sys_waitpid.
+        uint8_t parent = tasks[cur_task]->parent;
+        terminal_unmap_task(cur_task);
+        tasks[cur_task]->exit_status = status;
+        if (tasks[cur_task]->spawned == SPAWN_ORPHAN) {
+            tasks[cur_task]->status = TASK_EMPTY;
+        } else {
+            tasks[cur_task]->status = TASK_ZOMBIE;
+            hand_off_terminal(cur_task);
+            wake_up(&tasks[parent]->child_exit);
+        }
+        reschedule();
+    }
+
 sys_halt_return:
     tasks[cur_task]->kernel_esp = (uint32_t)&task_stacks[cur_task].stack_start;
     uint32_t term = tasks[cur_task]->terminal;
+    terminal_unmap_task(cur_task);
+    // The other stage of a pipeline may still be running
+    hand_off_terminal(cur_task);
 
     cur_task = tasks[cur_task]->parent;
     tasks[cur_task]->status = TASK_RUNNING;
 
     switch_page_directory(cur_task);
+    tls_load(cur_task);
 
     memset(signal_handlers[cur_task], 0, sizeof(signal_handlers[cur_task]));
 
@@ -72,7 +206,9 @@ sys_halt_return:
     }
 
     uint32_t ebp = tasks[cur_task]->ebp;
-    term_process[tasks[cur_task]->terminal] = cur_task;
+
+    // The parent's kernel stack is empty again once it is back in user space
+    tasks[cur_task]->kernel_esp = (uint32_t)&task_stacks[cur_task].stack_start;
 
     // Save the return value before moving the stack.
     // halt_status has to be static memory, it cannot be on the stack.
@@ -87,20 +223,107 @@ sys_halt_return:
     return halt_status;
 }
 
-/* int32_t sys_execute(const uint8_t* command)
- * Description: Starts a new process specified by command
- * Input:  command - the process to start and any args to send to it
- * Output: -1 on error, 0 on success
- * Side Effects: modifies tasks
+/* bool stdio_fd_ok(int32_t fd)
+ * Description: checks an fd given to execute to become a child's stdin or stdout
+ * Input:  fd - index of an open file of cur_task other than 0 or 1, or -1
+ * Output: true if fd can be used
+ * Side Effects: none
  */
-int32_t sys_execute(const uint8_t* command) {
+static bool stdio_fd_ok(int32_t fd) {
+    if (fd == -1) {
+        return true;
+    }
+    return fd >= 2 && fd < FILE_DESCS_LENGTH && tasks[cur_task]->file_descs[fd].flags != FD_CLEAR;
+}
+
+/* void move_fd(file_desc_t* from, file_desc_t* to)
+ * Description: moves an open file from one fd to another without closing it
+ * Input:  from - fd to take the file from, left clear
+ *         to - fd to put it in, overwritten without being closed
+ * Output: none
+ * Side Effects: writes to both fds
+ */
+static void move_fd(file_desc_t* from, file_desc_t* to) {
+    *to = *from;
+    from->flags = FD_CLEAR;
+    from->mode = 0;
+    from->inode = 0;
+    from->file_pos = 0;
+    from->ops = &default_ops;
+}
+
+/* void drop_stdio(int32_t in_fd, int32_t out_fd)
+ * Description: closes the fds execute would have handed over when it fails,
+ *              so a pipe does not stay open in the caller
+ * Input:  in_fd, out_fd - fds of cur_task or -1
+ * Output: none
+ * Side Effects: closes files
+ */
+static void drop_stdio(int32_t in_fd, int32_t out_fd) {
+    if (in_fd != -1) {
+        close_fd(in_fd);
+    }
+    if (out_fd != -1) {
+        close_fd(out_fd);
+    }
+}
+
+/* int32_t abort_execute(int32_t in_fd, int32_t out_fd)
+ * Description: gives up on the child execute is building in cur_task and
+ *              switches back to the caller
+ * Input:  in_fd, out_fd - fds of the caller or -1
+ * Output: -1
+ * Side Effects: frees the child's slot, closes files, leaves interrupts off
+ */
+static int32_t abort_execute(int32_t in_fd, int32_t out_fd) {
     cli();
+    if (backup_init_ebp) {
+        preempt_enable_no_resched();
+    }
+    terminal_unmap_task(cur_task);
+    tasks[cur_task]->status = TASK_EMPTY;
+    cur_task = tasks[cur_task]->parent;
+    tasks[cur_task]->status = TASK_RUNNING;
+    // A tick during the setup pointed esp0 at the child's stack. The
+    // parent goes straight back to user space, so its kernel stack is empty.
+    tasks[cur_task]->kernel_esp = (uint32_t)&task_stacks[cur_task].stack_start;
+    tss.esp0 = tasks[cur_task]->kernel_esp;
+    switch_page_directory(cur_task);
+    drop_stdio(in_fd, out_fd);
+    return -1;
+}
+
+/* int32_t execute(const uint8_t* command, int32_t in_fd, int32_t out_fd, bool wait)
+ * Description: Starts a new process specified by command and switches to it.
+ *              If wait is set the caller sleeps and sys_halt returns from
+ *              this function once the process is done. Otherwise the caller
+ *              stays runnable and the scheduler returns from this function
+ *              when it is the caller's turn, with the pid in spawn_pid.
+ * Input:  command - the process to start and any args to send to it
+ *         in_fd - fd moved to the new process as stdin, -1 for the terminal
+ *         out_fd - fd moved to the new process as stdout, -1 for the terminal
+ *         wait - whether to block until the process halts
+ * Output: -1 on error, otherwise the status the process halted with if wait
+ *         is set and nothing useful if it is not
+ * Side Effects: modifies tasks, moves or closes in_fd and out_fd
+ */
+static int32_t execute(const uint8_t* command, int32_t in_fd, int32_t out_fd, bool wait) {
+    uint32_t flags;
+
+    if (!stdio_fd_ok(in_fd) || !stdio_fd_ok(out_fd) || (in_fd != -1 && in_fd == out_fd)) {
+        // The caller loses both fds even now, or a pipe end would stay open
+        drop_stdio(stdio_fd_ok(in_fd) ? in_fd : -1,
+                   stdio_fd_ok(out_fd) && out_fd != in_fd ? out_fd : -1);
+        return -1;
+    }
 
     // Copy the command string for parsing later
     uint32_t command_length = strlen((int8_t*)command);
     uint8_t com_str[command_length];
     strcpy((int8_t*)com_str, (int8_t*)command);
 
+    spin_lock_irqsave(&tasks_lock, flags);
+
     // Once INIT starts the initial shells, don't move it's base pointer or
     // sys_halt won't be able to restart an exited shell. This is because
     // if we do INIT won't return to it's hlt loop and instead will jump
@@ -115,16 +338,18 @@ int32_t sys_execute(const uint8_t* command) {
         tasks[cur_task]->kernel_esp = ebp - 4;
     }
 
-    // Find the first empty task to place the new one in.
+    // Find the first empty process slot to place the new one in.
     int32_t fd;
     uint8_t task_num;
-    for (task_num = 1; task_num < NUM_TASKS; task_num++) {
+    for (task_num = 1; task_num < NUM_PROCS; task_num++) {
         if (tasks[task_num]->status == TASK_EMPTY) {
             break;
         }
     }
 
-    if (task_num >= NUM_TASKS) {
+    if (task_num >= NUM_PROCS) {
+        spin_unlock_irqrestore(&tasks_lock, flags);
+        drop_stdio(in_fd, out_fd);
         return -1;
     }
 
@@ -132,7 +357,12 @@ int32_t sys_execute(const uint8_t* command) {
     memset(tasks[task_num], 0, sizeof(pcb_t));
     tasks[task_num]->kernel_esp = (uint32_t)&task_stacks[task_num].stack_start;
 
+    // From here on the child is the running task and the caller sleeps, so
+    // a tick during the rest of the setup resumes the child and never
+    // switches back into the caller's half built call
     tasks[task_num]->parent = cur_task;
+    tasks[task_num]->status = TASK_RUNNING;
+    tasks[cur_task]->status = TASK_SLEEPING;
     cur_task = task_num;
 
     tasks[cur_task]->thread_status = 0;
@@ -140,13 +370,14 @@ int32_t sys_execute(const uint8_t* command) {
     tasks[cur_task]->rtc_counter = 0;
     tasks[cur_task]->rtc_base = DEFAULT_RTC_FREQ;
     tasks[cur_task]->pending_signals = 0;
-    tasks[cur_task]->signal_mask = false;
+    tasks[cur_task]->blocked = 0;
 
     memset(signal_handlers[cur_task], 0, sizeof(signal_handlers[cur_task]));
 
     tasks[cur_task]->page_directory = page_directory_tables[cur_task];
     tasks[cur_task]->kernel_vid_table = page_tables[cur_task][0];
     tasks[cur_task]->usr_vid_table = page_tables[cur_task][1];
+    tasks[cur_task]->thread_stack_table = page_tables[cur_task][2];
 
     memset(tasks[cur_task]->page_directory, PAGE_RW, TABLE_SIZE);
     memset(tasks[cur_task]->kernel_vid_table, PAGE_RW, TABLE_SIZE);
@@ -154,31 +385,37 @@ int32_t sys_execute(const uint8_t* command) {
 
     setup_vid(tasks[cur_task]->page_directory, tasks[cur_task]->kernel_vid_table, 0);
     setup_vid(tasks[cur_task]->page_directory + TASK_VIDEO_OFFSET, tasks[cur_task]->usr_vid_table, 1);
+    setup_trampoline(tasks[cur_task]->usr_vid_table);
+    // Each entry in the table keeps its own permissions
+    ((page_dir_kb_entry_t*)tasks[cur_task]->page_directory + TASK_VIDEO_OFFSET)->userSupervisor = 1;
 
     // 1 * 4MB for virtual address of 4MB
     setup_kernel_mem(tasks[cur_task]->page_directory + 1);
+    setup_apic_mem(tasks[cur_task]->page_directory + APIC_MMIO_PDE);
 
     // 32 * 4MB for virtual address of 128MB
     setup_task_mem(tasks[cur_task]->page_directory + TASK_OFFSET, cur_task);
 
-    // Inherit the terminal from parent. Also sets the usr_vid_table page up depending
-    // on whether terminal is focused.
+    setup_thread_stacks(tasks[cur_task]->page_directory + THREAD_STACK_OFFSET, tasks[cur_task]->thread_stack_table);
+
+    // Inherit the terminal from parent and map its text page at the user video address.
     tasks[cur_task]->terminal = tasks[tasks[cur_task]->parent]->terminal;
-    term_process[tasks[cur_task]->terminal] = cur_task;
-    if (tasks[cur_task]->terminal == active) {
-        page_table_kb_entry_t *usr_vid_table = (page_table_kb_entry_t *)tasks[cur_task]->usr_vid_table;
-        usr_vid_table->addr = VIDEO >> 12;
-    } else {
-        page_table_kb_entry_t *usr_vid_table = (page_table_kb_entry_t *)tasks[cur_task]->usr_vid_table;
-        usr_vid_table->addr = (uint32_t)terminal_video[tasks[cur_task]->terminal] >> 12;
-    }
+    terminal_map_task(cur_task);
 
     switch_page_directory(cur_task);
 
+    // Until INIT has started every shell the scheduler always picks it, so
+    // the boot time shells only let interrupts in, not other tasks
+    if (backup_init_ebp) {
+        preempt_disable();
+    }
+    spin_unlock_irqrestore(&tasks_lock, flags);
+
     tasks[cur_task]->file_descs = file_desc_arrays[cur_task];
     uint32_t file_i;
     for (file_i = 0; file_i < FILE_DESCS_LENGTH; file_i++) {
         tasks[cur_task]->file_descs[file_i].flags = FD_CLEAR;
+        tasks[cur_task]->file_descs[file_i].mode = 0;
         tasks[cur_task]->file_descs[file_i].inode = 0;
         tasks[cur_task]->file_descs[file_i].file_pos = 0;
         tasks[cur_task]->file_descs[file_i].ops = &default_ops;
@@ -194,59 +431,91 @@ int32_t sys_execute(const uint8_t* command) {
     com_str[i] = '\0';
     i++;
     while(i < command_length && com_str[i] == ' ') i++;
+    // Copied into the pcb, a spawned process outlives this stack frame
     if (i >= command_length) {
         tasks[cur_task]->arg_str = NULL;
     } else {
-        tasks[cur_task]->arg_str = com_str + i;
+        strncpy((int8_t*)tasks[cur_task]->args, (int8_t*)com_str + i, ARGS_LEN - 1);
+        tasks[cur_task]->arg_str = tasks[cur_task]->args;
     }
 
     // If the file cannot be found error
     if ((fd = sys_open(com_str)) == -1) {
-        cur_task = tasks[cur_task]->parent;
-        switch_page_directory(cur_task);
-        return -1;
+        return abort_execute(in_fd, out_fd);
     }
 
     // Clear user memory (we don't want to leave data from previous processes
-    // as that could be a huge vulnerability)
-    memset((void*)TASK_ADDR, 0, MB4);
+    // as that could be a huge vulnerability). Clearing and loading can take
+    // a while, so both go in chunks with a chance to reschedule in between.
+    uint32_t off;
+    for (off = 0; off < MB4; off += EXEC_CHUNK) {
+        memset((void*)(TASK_ADDR + off), 0, EXEC_CHUNK);
+        cond_resched();
+    }
 
     int8_t *buf = (int8_t*)(TASK_ADDR + USR_CODE_OFFSET);
 
     fstat_t stats;
     sys_stat(fd, &stats, sizeof(fstat_t));
 
-    sys_read(fd, (void*)buf, stats.size);
+    for (off = 0; off < stats.size; off += EXEC_CHUNK) {
+        uint32_t chunk = stats.size - off < EXEC_CHUNK ? stats.size - off : EXEC_CHUNK;
+        if (sys_read(fd, (void*)(buf + off), chunk) <= 0) {
+            break;
+        }
+        cond_resched();
+    }
     sys_close(fd);
 
     // Magic executable bytes
     if (buf[0] != 0x7F || buf[1] != 0x45 || buf[2] != 0x4C || buf[3] != 0x46) {
         // File is not executable
-        cur_task = tasks[cur_task]->parent;
-        switch_page_directory(cur_task);
-        return -1;
+        return abort_execute(in_fd, out_fd);
     }
 
-    tasks[cur_task]->status = TASK_RUNNING;
-    tasks[tasks[cur_task]->parent]->status = TASK_SLEEPING;
+    // Nothing may run between here and the iret into the child
+    cli();
+    if (backup_init_ebp) {
+        preempt_enable_no_resched();
+    }
+
+    // Hand the redirected files over in place of the terminal
+    if (in_fd != -1) {
+        move_fd(&tasks[tasks[cur_task]->parent]->file_descs[in_fd], &tasks[cur_task]->file_descs[0]);
+    }
+    if (out_fd != -1) {
+        move_fd(&tasks[tasks[cur_task]->parent]->file_descs[out_fd], &tasks[cur_task]->file_descs[1]);
+    }
+
+    if (wait) {
+        term_process[tasks[cur_task]->terminal] = cur_task;
+    } else {
+        // Runs in the background, so it does not take the terminal's
+        // foreground. The caller's process is the one that reaps it.
+        tasks[tasks[cur_task]->parent]->status = TASK_RUNNING;
+        tasks[tasks[cur_task]->parent]->spawn_pid = cur_task;
+        tasks[cur_task]->spawned = SPAWN_CHILD;
+        tasks[cur_task]->parent = TASK_PROC(tasks[cur_task]->parent);
+    }
 
     // A pointer to the first instruction is stored in bytes 24-27
     uint32_t start = ((uint32_t *)buf)[6];
 
     tss.esp0 = tasks[cur_task]->kernel_esp;
 
-    tasks[cur_task]->user_esp = TASK_ADDR + MB4;
+    tasks[cur_task]->user_esp = tls_setup(cur_task, TASK_ADDR + MB4);
+    tls_load(cur_task);
 
     // Setup an iret context on the stack with user CS and DS,
     // an EIP of start and an ESP of user_stack_addr
     // NOTE: in order to enable interrupts we OR the
     // sti flag (0x200) on EFLAGS so that iret will sti for us.
+    trace_irqs_on();
     asm volatile("                             \n\
     movw $" str(USER_DS) ", %%ax               \n\
     movw %%ax, %%ds                            \n\
     movw %%ax, %%es                            \n\
     movw %%ax, %%fs                            \n\
-    movw %%ax, %%gs                            \n\
                                                \n\
     pushl $" str(USER_DS) "                    \n\
     pushl %1                                   \n\
@@ -263,6 +532,98 @@ int32_t sys_execute(const uint8_t* command) {
     return 0;
 }
 
+/* int32_t sys_execute(const uint8_t* command)
+ * Description: Starts a new process specified by command
+ * Input:  command - the process to start and any args to send to it
+ * Output: -1 on error, 0 on success
+ * Side Effects: modifies tasks
+ */
+int32_t sys_execute(const uint8_t* command) {
+    return execute(command, -1, -1, true);
+}
+
+/* int32_t sys_execute_fds(const uint8_t* command, int32_t in_fd, int32_t out_fd)
+ * Description: Starts a new process with files of the caller as its stdin
+ *              and stdout, which is how the shell connects a pipeline
+ * Input:  command - the process to start and any args to send to it
+ *         in_fd - fd moved to the new process as stdin, -1 for the terminal
+ *         out_fd - fd moved to the new process as stdout, -1 for the terminal
+ * Output: -1 on error, otherwise the status the process halted with
+ * Side Effects: modifies tasks. in_fd and out_fd are gone from the caller
+ *               afterwards, even if command could not be run.
+ */
+int32_t sys_execute_fds(const uint8_t* command, int32_t in_fd, int32_t out_fd) {
+    return execute(command, in_fd, out_fd, true);
+}
+
+/* int32_t sys_spawn(const uint8_t* command)
+ * Description: Starts a new process without waiting for it. The caller's
+ *              process collects its status with sys_waitpid.
+ * Input:  command - the process to start and any args to send to it
+ * Output: -1 on error, otherwise the pid of the new process
+ * Side Effects: modifies tasks, runs the new process before returning
+ */
+int32_t sys_spawn(const uint8_t* command) {
+    tasks[cur_task]->spawn_pid = -1;
+    execute(command, -1, -1, false);
+
+    // execute left kernel_esp inside its frame, which is gone now
+    tasks[cur_task]->kernel_esp = (uint32_t)&task_stacks[cur_task].stack_start;
+    tss.esp0 = tasks[cur_task]->kernel_esp;
+    return tasks[cur_task]->spawn_pid;
+}
+
+/* int32_t sys_waitpid(int32_t pid, uint32_t* status, int32_t flags)
+ * Description: Waits for a spawned child of the caller's process to halt
+ *              and frees its slot
+ * Input:  pid - the child to wait for, -1 for any
+ *         status - gets the status the child halted with, may be NULL
+ *         flags - WNOHANG to return at once if no child has halted
+ * Output: -1 if there is no such child, 0 if WNOHANG is set and no child
+ *         has halted, otherwise the pid of the child
+ * Side Effects: may sleep, writes to *status
+ */
+int32_t sys_waitpid(int32_t pid, uint32_t* status, int32_t flags) {
+    if (status != NULL && ((uint32_t)status < TASK_ADDR || (uint32_t)(status + 1) > TASK_ADDR + MB4)) {
+        return -1;
+    }
+
+    uint8_t proc = TASK_PROC(cur_task);
+    uint32_t intr_flags;
+    cli_and_save(intr_flags);
+    while (1) {
+        bool found = false;
+        int32_t i;
+        for (i = 1; i < NUM_PROCS; i++) {
+            if (tasks[i]->status == TASK_EMPTY || tasks[i]->spawned != SPAWN_CHILD || tasks[i]->parent != proc ||
+                (pid != -1 && pid != i)) {
+                continue;
+            }
+            found = true;
+            if (tasks[i]->status == TASK_ZOMBIE) {
+                uint32_t exit_status = tasks[i]->exit_status;
+                tasks[i]->status = TASK_EMPTY;
+                restore_flags(intr_flags);
+                if (status != NULL) {
+                    *status = exit_status;
+                }
+                return i;
+            }
+        }
+
+        if (!found) {
+            restore_flags(intr_flags);
+            return -1;
+        }
+        if (flags & WNOHANG) {
+            restore_flags(intr_flags);
+            return 0;
+        }
+        sleep_on(&tasks[proc]->child_exit);
+        cli();
+    }
+}
+
 /* int32_t sys_read(int32_t fd, void* buf, int32_t nbytes)
  * Description: reads nbytes from the file pointed to by fd into buf
  * Input:  fd - the file descriptor to read from
@@ -272,7 +633,7 @@ int32_t sys_execute(const uint8_t* command) {
  * Side Effects: none
  */
 int32_t sys_read(int32_t fd, void* buf, int32_t nbytes) {
-    if (fd < 0 || fd > FILE_DESCS_LENGTH) {
+    if (fd < 0 || fd >= FILE_DESCS_LENGTH) {
         return -1;
     }
     return (*tasks[cur_task]->file_descs[fd].ops->read)(fd, buf, nbytes);
@@ -287,7 +648,7 @@ int32_t sys_read(int32_t fd, void* buf, int32_t nbytes) {
  * Side Effects: writes to fd
  */
 int32_t sys_write(int32_t fd, const void* buf, int32_t nbytes) {
-    if (fd < 0 || fd > FILE_DESCS_LENGTH) {
+    if (fd < 0 || fd >= FILE_DESCS_LENGTH) {
         return -1;
     }
     return (*tasks[cur_task]->file_descs[fd].ops->write)(fd, buf, nbytes);
@@ -304,6 +665,7 @@ int32_t sys_open(const uint8_t* filename) {
         tasks[cur_task]->file_descs[0].ops = &stdin_ops;
         tasks[cur_task]->file_descs[0].inode = NULL;
         tasks[cur_task]->file_descs[0].flags = FD_STDIN;
+        tasks[cur_task]->file_descs[0].mode = 0;
         tasks[cur_task]->file_descs[0].ops->open((int8_t*)filename);
         return 0;
     }
@@ -311,6 +673,7 @@ int32_t sys_open(const uint8_t* filename) {
         tasks[cur_task]->file_descs[1].ops  = &stdout_ops;
         tasks[cur_task]->file_descs[1].inode = NULL;
         tasks[cur_task]->file_descs[1].flags = FD_STDOUT;
+        tasks[cur_task]->file_descs[1].mode = 0;
         tasks[cur_task]->file_descs[1].ops->open((int8_t*)filename);
         return 1;
     }
@@ -321,6 +684,7 @@ int32_t sys_open(const uint8_t* filename) {
         }
     }
     if (i < FILE_DESCS_LENGTH) {
+        tasks[cur_task]->file_descs[i].mode = 0;
         if (!strncmp((int8_t*)filename, "/dev/kbd", strlen("/dev/kbd"))) {
             tasks[cur_task]->file_descs[i].ops = &kbd_ops;
             tasks[cur_task]->file_descs[i].inode = NULL;
@@ -329,6 +693,17 @@ int32_t sys_open(const uint8_t* filename) {
             tasks[cur_task]->file_descs[i].ops->open((int8_t*)filename);
             return i;
         }
+#ifdef IRQSOFF_TRACE
+        if (!strncmp((int8_t*)filename, "/dev/irqsoff", strlen("/dev/irqsoff"))) {
+            tasks[cur_task]->file_descs[i].ops = &irqsoff_ops;
+            tasks[cur_task]->file_descs[i].inode = NULL;
+            tasks[cur_task]->file_descs[i].file_pos = 0;
+            tasks[cur_task]->file_descs[i].flags = FD_IRQSOFF;
+
+            tasks[cur_task]->file_descs[i].ops->open((int8_t*)filename);
+            return i;
+        }
+#endif
 
         dentry_t d;
         if (read_dentry_by_name((int8_t*)filename, &d) != 0) {
@@ -350,9 +725,7 @@ int32_t sys_open(const uint8_t* filename) {
 
         switch (d.type) {
         case FD_DIR:
-            if (-1 == (tasks[cur_task]->file_descs[i].file_pos = get_index((int8_t*)filename))) {
-                return -1;
-            }
+            tasks[cur_task]->file_descs[i].file_pos = 0;
             tasks[cur_task]->file_descs[i].ops = &filesys_ops;
             tasks[cur_task]->file_descs[i].flags = FD_DIR;
             break;
@@ -386,14 +759,7 @@ int32_t sys_close(int32_t fd) {
         return -1;
     }
 
-    int32_t ret = (*tasks[cur_task]->file_descs[fd].ops->close)(fd);
-
-    tasks[cur_task]->file_descs[fd].flags = FD_CLEAR;
-    tasks[cur_task]->file_descs[fd].inode = 0;
-    tasks[cur_task]->file_descs[fd].file_pos = 0;
-    tasks[cur_task]->file_descs[fd].ops = &default_ops;
-
-    return ret;
+    return close_fd(fd);
 }
 
 /* int32_t sys_getargs(uint8_t* buf, int32_t nbytes)
@@ -450,7 +816,8 @@ int32_t sys_vidmap(uint8_t** screen_start) {
  * Side Effects: changes the signal handler
  */
 int32_t sys_set_handler(int32_t signum, void* handler_address) {
-    if ((uint32_t)handler_address < TASK_ADDR || (uint32_t)handler_address >= (TASK_ADDR + MB4)) {
+    if (signum < 0 || signum >= NUM_SIGNALS ||
+        (uint32_t)handler_address < TASK_ADDR || (uint32_t)handler_address >= (TASK_ADDR + MB4)) {
         return -1;
     }
     signal_handlers[cur_task][signum] = handler_address;
@@ -458,18 +825,35 @@ int32_t sys_set_handler(int32_t signum, void* handler_address) {
 }
 
 /* int32_t sys_sigreturn(void))
- * Description: returns from a user signal handler
+ * Description: returns from a user signal handler, putting back the mask
+ *              and outer handler context saved in its signal frame
  * Input: none
- * Output: expected old return value
+ * Output: -1 outside a handler, otherwise expected old return value
  * Side Effects: remaps the program to normal execution
  */
 int32_t sys_sigreturn(void) {
-    tasks[cur_task]->signal_mask = false;
+    hw_context_t *sig_hw_context = tasks[cur_task]->sig_hw_context;
+    uint32_t *frame = (uint32_t *)sig_hw_context;
+    if (frame == NULL) {
+        return -1;
+    }
 
-    if (tasks[cur_task]->sig_hw_context->iret_context.cs == KERNEL_CS) {
+    // handle_signals left the old mask and the context of an outer handler
+    // just below this one. Both are in user memory, so check them.
+    hw_context_t *outer = (hw_context_t *)frame[-2];
+    if ((uint32_t)outer < TASK_ADDR || (uint32_t)outer >= TASK_ADDR + MB4) {
+        outer = NULL;
+    }
+    cli();
+    tasks[cur_task]->blocked = frame[-1] & ~SIG_UNBLOCKABLE & ((1 << NUM_SIGNALS) - 1);
+    tasks[cur_task]->sig_hw_context = outer;
+    update_work(cur_task);
+    sti();
+
+    if (sig_hw_context->iret_context.cs == KERNEL_CS) {
         hw_context_t *hw_context = (hw_context_t *)(tasks[cur_task]->ebp + 12);
         tss.esp0 = tasks[cur_task]->kernel_esp;
-        memcpy(hw_context, (void*)tasks[cur_task]->sig_hw_context, sizeof(hw_context_t) - 8);
+        memcpy(hw_context, (void*)sig_hw_context, sizeof(hw_context_t) - 8);
         uint32_t ebp = tasks[cur_task]->ebp;
         asm volatile("movl %0, %%ebp; leave; ret;"
                      : : "b"(ebp));
@@ -477,7 +861,7 @@ int32_t sys_sigreturn(void) {
         uint32_t ebp;
         asm volatile("movl %%ebp, %0;" : "=r"(ebp) :);
         hw_context_t *hw_context = (hw_context_t *)(ebp + 20);
-        memcpy(hw_context, (void*)tasks[cur_task]->sig_hw_context, sizeof(hw_context_t));
+        memcpy(hw_context, (void*)sig_hw_context, sizeof(hw_context_t));
         return hw_context->eax;
     }
 
@@ -518,6 +902,9 @@ int32_t sys_vidmap_all(uint8_t** screen_start) {
         vid_mem += KB4;
     }
 
+    // Move the other terminals out of VGA memory while this task draws to it
+    terminal_take_vga(cur_task);
+
     switch_page_directory(cur_task);
 
     *screen_start = (uint8_t *)(TASK_ADDR + MB4);
@@ -543,7 +930,9 @@ int32_t sys_ioperm(uint32_t from, uint32_t num, int32_t turn_on) {
 }
 
 /* int32_t sys_thread_create(uint32_t *tid, void (*thread_start)())
- * Description: starts a new thread at function thread_start and stores its id in td
+ * Description: starts a new thread at function thread_start and stores its id in td.
+ *              The thread shares the process's page directory and gets a small
+ *              stack of its own in the thread stack area.
  * Input:  tid - pointer to thread id
  *         thread_start - function to run
  * Output: -1 on error, 0 on success
@@ -556,8 +945,10 @@ int32_t sys_thread_create(uint32_t *tid, void (*thread_start)()) {
     tasks[cur_task]->ebp = ebp;
     tasks[cur_task]->kernel_esp = ebp-4;
 
+    // Threads of threads belong to the process too
+    uint8_t proc = TASK_PROC(cur_task);
     uint8_t task_num;
-    for (task_num = 1; task_num < NUM_TASKS; task_num++) {
+    for (task_num = NUM_PROCS; task_num < NUM_TASKS; task_num++) {
         if (tasks[task_num]->status == TASK_EMPTY) {
             break;
         }
@@ -568,56 +959,48 @@ int32_t sys_thread_create(uint32_t *tid, void (*thread_start)()) {
     }
 
     tasks[task_num]->status = TASK_RUNNING;
-    tasks[task_num]->file_descs = tasks[cur_task]->file_descs;
-    memcpy(tasks[task_num]->page_directory, tasks[cur_task]->page_directory, DIR_SIZE * 4);
-    // Add a page directory entry mapping 136MB virtual to the physical space this task would have taken up.
-    // This will be used for the user level stack.
-    setup_task_mem(tasks[task_num]->page_directory + 34, task_num);
-    memcpy(tasks[task_num]->usr_vid_table, tasks[cur_task]->usr_vid_table, DIR_SIZE * 4);
-    memcpy(tasks[task_num]->kernel_vid_table, tasks[cur_task]->kernel_vid_table, DIR_SIZE * 4);
+    tasks[task_num]->file_descs = tasks[proc]->file_descs;
+    // The thread runs in its process's address space. Only its stack is its own.
+    tasks[task_num]->page_directory = tasks[proc]->page_directory;
+    tasks[task_num]->kernel_vid_table = tasks[proc]->kernel_vid_table;
+    tasks[task_num]->usr_vid_table = tasks[proc]->usr_vid_table;
+    tasks[task_num]->thread_stack_table = tasks[proc]->thread_stack_table;
+    uint32_t stack_top = tls_setup(task_num, thread_stack_map(task_num));
     tasks[task_num]->arg_str = NULL;
-    tasks[task_num]->terminal = tasks[cur_task]->terminal;
+    tasks[task_num]->terminal = tasks[proc]->terminal;
+    terminal_map_task(task_num);
     tasks[task_num]->rtc_counter = 0;
     tasks[task_num]->rtc_base = tasks[cur_task]->rtc_base;
-    tasks[task_num]->parent = cur_task;
+    tasks[task_num]->work_pending = 0;
+    tasks[task_num]->pending_signals = 0;
+    tasks[task_num]->blocked = 0;
+    tasks[task_num]->sigqueue_len = 0;
+    tasks[task_num]->sig_hw_context = NULL;
+    tasks[task_num]->parent = proc;
     *tid = task_num;
-    SET_THREAD(cur_task, task_num);
+    SET_THREAD(proc, task_num);
     tasks[task_num]->thread_status = 1;
+    tasks[task_num]->thread_waiting = 0;
     tasks[task_num]->kernel_esp = (uint32_t)&task_stacks[task_num].stack_start;
 
+    // Same page directory, so no CR3 reload
     cur_task = task_num;
-    switch_page_directory(cur_task);
     tss.esp0 = tasks[cur_task]->kernel_esp;
+    tls_load(cur_task);
 
-    uint8_t *uesp = (uint8_t *)(MB4 * 35 - 4);
-
-    // Put the following assembly on the user stack:
-    // pushl $0x1, %eax
-    // int $0x80
-    *uesp = 0x00; uesp--;
-    *uesp = 0x80; uesp--;
-    *uesp = 0xCD; uesp--;
-    *uesp = 0x00; uesp--;
-
-    *uesp = 0x00; uesp--;
-    *uesp = 0x00; uesp--;
-    *uesp = 0x01; uesp--;
-    *uesp = 0xB8;
-
-    // Put a pointer to the assembly on the stack so that
-    // when the thread returns it starts executing the assembly
-    uint32_t return_addr = (uint32_t)uesp;
-    uesp -= 5;
-    *(uint32_t *)uesp = return_addr;
+    // The thread function returns into the trampoline, which halts
+    uint32_t *uesp = (uint32_t *)stack_top;
+    uesp--;
+    *uesp = TRAMPOLINE(thread_exit_trampoline);
 
     tasks[cur_task]->user_esp = (uint32_t)uesp;
 
+    trace_irqs_on();
     asm volatile("                             \n\
     movw $" str(USER_DS) ", %%ax               \n\
     movw %%ax, %%ds                            \n\
     movw %%ax, %%es                            \n\
     movw %%ax, %%fs                            \n\
-    movw %%ax, %%gs                            \n\
                                                \n\
     pushl $" str(USER_DS) "                    \n\
     pushl %1                                   \n\
@@ -637,20 +1020,52 @@ int32_t sys_thread_create(uint32_t *tid, void (*thread_start)()) {
 /* int32_t sys_thread_join(uint32_t tid)
  * Description: waits for a child thread to exit
  * Input:  tid - thread id of child
- * Output: 0 on success
+ * Output: -1 if tid is not a thread of the calling process, 0 on success
  * Side Effects: changes task status, sleeps
  */
 int32_t sys_thread_join(uint32_t tid) {
+    if (tid < NUM_PROCS || tid >= NUM_TASKS || !(tasks[cur_task]->thread_status & (1 << tid))) {
+        return -1;
+    }
+
+    cli();
     if (tasks[tid]->status == TASK_ZOMBIE) {
         tasks[tid]->status = TASK_EMPTY;
         CLEAR_THREAD(cur_task, tid);
+        thread_stack_unmap(tid);
+        // Flush the TLB
+        switch_page_directory(cur_task);
     } else {
+        // sys_halt unmaps the stack and wakes us
         tasks[cur_task]->thread_waiting = tid;
         tasks[cur_task]->status = TASK_WAITING_FOR_THREAD;
 
         reschedule();
+        tasks[cur_task]->thread_waiting = 0;
     }
-    tasks[tid]->page_directory[34] = PAGE_RW;
+    return 0;
+}
+
+/* int32_t sys_set_tls(void *base)
+ * Description: points the calling thread's %gs at a TLS block of its own
+ *              instead of the one it was started with. The block's first word
+ *              should point to the block, as user code reads it through %gs:0.
+ * Input:  base - start of the block, in the program image or a thread stack
+ * Output: -1 if base is outside user memory, 0 on success
+ * Side Effects: changes the GDT and %gs
+ */
+int32_t sys_set_tls(void *base) {
+    uint32_t addr = (uint32_t)base;
+    if ((addr < TASK_ADDR || addr > TASK_ADDR + MB4 - TLS_SIZE) &&
+        (addr < THREAD_STACK_ADDR || addr > THREAD_STACK_ADDR + MB4 - TLS_SIZE)) {
+        return -1;
+    }
+
+    uint32_t flags;
+    cli_and_save(flags);
+    tasks[cur_task]->tls_base = addr;
+    tls_load(cur_task);
+    restore_flags(flags);
     return 0;
 }
 
@@ -663,7 +1078,7 @@ int32_t sys_thread_join(uint32_t tid) {
  * Side Effects: calls file stat
  */
 int32_t sys_stat(int32_t fd, void* buf, int32_t nbytes) {
-    if (fd < 0 || fd > FILE_DESCS_LENGTH) {
+    if (fd < 0 || fd >= FILE_DESCS_LENGTH || tasks[cur_task]->file_descs[fd].ops->stat == NULL) {
         return -1;
     }
     return (*tasks[cur_task]->file_descs[fd].ops->stat)(fd, buf, nbytes);
@@ -678,3 +1093,276 @@ int32_t sys_stat(int32_t fd, void* buf, int32_t nbytes) {
 uint32_t sys_time(){
     return get_time();
 }
+
+/* int32_t sys_getdents(int32_t fd, void* buf, int32_t nbytes)
+ * Description: reads many directory entries from fd into buf in one call
+ * Input:  fd - index of an open directory
+ *         buf - buffer to fill with dirent_t records
+ *         nbytes - size of buf
+ * Output: -1 on error, number of bytes written otherwise (0 at end)
+ * Side Effects: advances the directory position of fd
+ */
+int32_t sys_getdents(int32_t fd, void* buf, int32_t nbytes) {
+    if (fd < 0 || fd >= FILE_DESCS_LENGTH) {
+        return -1;
+    }
+    if ((uint32_t)buf < TASK_ADDR || (uint32_t)buf + nbytes > (TASK_ADDR + MB4)) {
+        return -1;
+    }
+    return filesys_getdents(fd, buf, nbytes);
+}
+
+/* int32_t sys_sendfile(int32_t out_fd, int32_t in_fd, int32_t count)
+ * Description: copies up to count bytes from a file to any writable fd
+ *              without bouncing them through a user buffer
+ * Input:  out_fd - fd to write to, eg. stdout
+ *         in_fd - open file to read from
+ *         count - maximum number of bytes to copy
+ * Output: -1 on error, number of bytes copied otherwise (0 at end of file)
+ * Side Effects: advances the file position of in_fd
+ */
+int32_t sys_sendfile(int32_t out_fd, int32_t in_fd, int32_t count) {
+    if (out_fd < 0 || out_fd >= FILE_DESCS_LENGTH || in_fd < 0 || in_fd >= FILE_DESCS_LENGTH) {
+        return -1;
+    }
+    if (tasks[cur_task]->file_descs[out_fd].flags == FD_CLEAR) {
+        return -1;
+    }
+    return filesys_sendfile(out_fd, in_fd, count);
+}
+
+/* int32_t sys_ioctl(int32_t fd, uint32_t request, uint32_t arg)
+ * Description: gets or sets the mode of an open file, or hands a device
+ *              specific request to the file's ioctl
+ * Input:  fd - index of the file
+ *         request - IOCTL_GETFL, IOCTL_SETFL or a request for the device
+ *         arg - new mode for IOCTL_SETFL, otherwise passed to the device
+ * Output: -1 on error, the mode for IOCTL_GETFL, otherwise the device's result
+ * Side Effects: may change the mode of fd
+ */
+int32_t sys_ioctl(int32_t fd, uint32_t request, uint32_t arg) {
+    if (fd < 0 || fd >= FILE_DESCS_LENGTH) {
+        return -1;
+    }
+    file_desc_t *desc = &tasks[cur_task]->file_descs[fd];
+    if (desc->flags == FD_CLEAR) {
+        return -1;
+    }
+
+    switch (request) {
+    case IOCTL_GETFL:
+        return desc->mode;
+    case IOCTL_SETFL:
+        desc->mode = arg;
+        return 0;
+    default:
+        if (desc->ops->ioctl == NULL) {
+            return -1;
+        }
+        return (*desc->ops->ioctl)(fd, request, arg);
+    }
+}
+
+/* int32_t sys_poll(pollfd_t* fds, uint32_t nfds, int32_t timeout)
+ * Description: waits until at least one of several files is ready
+ * Input:  fds - files to check, with the events wanted for each
+ *         nfds - number of entries in fds, at most POLL_MAX
+ *         timeout - milliseconds to wait, 0 to just check, negative to wait forever,
+ *                   at most POLL_TIMEOUT_MAX
+ * Output: -1 on error, otherwise the number of entries with revents set (0 on timeout)
+ * Side Effects: writes revents in fds, sleeps
+ */
+int32_t sys_poll(pollfd_t* fds, uint32_t nfds, int32_t timeout) {
+    if (nfds > POLL_MAX || (uint32_t)fds < TASK_ADDR || (uint32_t)(fds + nfds) > (TASK_ADDR + MB4)) {
+        return -1;
+    }
+
+    if (timeout > POLL_TIMEOUT_MAX) {
+        timeout = POLL_TIMEOUT_MAX;
+    }
+
+    wait_queue_t *queues[POLL_MAX];
+    uint32_t deadline = get_ticks() + (timeout / 1000) * MAX_RTC_FREQ + (timeout % 1000) * MAX_RTC_FREQ / 1000;
+    uint32_t flags;
+    uint32_t i;
+
+    while (1) {
+        int32_t ready = 0;
+        uint32_t num_queues = 0;
+
+        cli_and_save(flags);
+        for (i = 0; i < nfds; i++) {
+            int32_t fd = fds[i].fd;
+            wait_queue_t *wait = NULL;
+
+            if (fd < 0 || fd >= FILE_DESCS_LENGTH || tasks[cur_task]->file_descs[fd].flags == FD_CLEAR) {
+                fds[i].revents = POLLNVAL;
+            } else if (tasks[cur_task]->file_descs[fd].ops->poll == NULL) {
+                fds[i].revents = fds[i].events & (POLLIN | POLLOUT);
+            } else {
+                fds[i].revents = (*tasks[cur_task]->file_descs[fd].ops->poll)(fd, &wait) & fds[i].events;
+                if (fds[i].revents == 0 && wait != NULL) {
+                    queues[num_queues++] = wait;
+                }
+            }
+            if (fds[i].revents != 0) {
+                ready++;
+            }
+        }
+
+        if (ready > 0 || timeout == 0 || (timeout > 0 && (int32_t)(get_ticks() - deadline) >= 0)) {
+            restore_flags(flags);
+            return ready;
+        }
+
+        // Sleep until any of the files or the timer might have changed
+        for (i = 0; i < num_queues; i++) {
+            wait_add(queues[i]);
+        }
+        if (timeout > 0) {
+            wait_add(&rtc_tick_wait);
+        }
+        tasks[cur_task]->status = TASK_SLEEPING;
+        reschedule();
+
+        cli();
+        for (i = 0; i < num_queues; i++) {
+            wait_remove(queues[i]);
+        }
+        wait_remove(&rtc_tick_wait);
+        restore_flags(flags);
+    }
+}
+
+/* int32_t sys_lseek(int32_t fd, int32_t offset, int32_t whence)
+ * Description: moves the position the next read of fd starts from
+ * Input:  fd - index of the file
+ *         offset - new position relative to whence
+ *         whence - SEEK_SET, SEEK_CUR or SEEK_END
+ * Output: -1 on error or if fd can't seek, the new position otherwise
+ * Side Effects: changes the position of fd
+ */
+int32_t sys_lseek(int32_t fd, int32_t offset, int32_t whence) {
+    if (fd < 0 || fd >= FILE_DESCS_LENGTH || tasks[cur_task]->file_descs[fd].ops->lseek == NULL) {
+        return -1;
+    }
+    return (*tasks[cur_task]->file_descs[fd].ops->lseek)(fd, offset, whence);
+}
+
+/* int32_t sys_pread(int32_t fd, void* buf, int32_t nbytes, uint32_t offset)
+ * Description: reads nbytes of fd starting at offset
+ * Input:  fd - index of the file
+ *         buf - buffer to read into
+ *         nbytes - number of bytes to read
+ *         offset - position in the file to start at
+ * Output: -1 on error or if fd can't seek, number of bytes read otherwise
+ * Side Effects: none, the position of fd is left alone
+ */
+int32_t sys_pread(int32_t fd, void* buf, int32_t nbytes, uint32_t offset) {
+    if (fd < 0 || fd >= FILE_DESCS_LENGTH || tasks[cur_task]->file_descs[fd].ops->pread == NULL) {
+        return -1;
+    }
+    if (nbytes < 0 || (uint32_t)buf < TASK_ADDR || (uint32_t)buf > TASK_ADDR + MB4 ||
+        (uint32_t)nbytes > TASK_ADDR + MB4 - (uint32_t)buf) {
+        return -1;
+    }
+    return (*tasks[cur_task]->file_descs[fd].ops->pread)(fd, buf, nbytes, offset);
+}
+
+/* int32_t sys_pwrite(int32_t fd, const void* buf, int32_t nbytes, uint32_t offset)
+ * Description: writes nbytes of buf to fd starting at offset
+ * Input:  fd - index of the file
+ *         buf - buffer to write from
+ *         nbytes - number of bytes to write
+ *         offset - position in the file to start at
+ * Output: -1 on error or if fd can't seek, number of bytes written otherwise
+ * Side Effects: none, the position of fd is left alone
+ */
+int32_t sys_pwrite(int32_t fd, const void* buf, int32_t nbytes, uint32_t offset) {
+    if (fd < 0 || fd >= FILE_DESCS_LENGTH || tasks[cur_task]->file_descs[fd].ops->pwrite == NULL) {
+        return -1;
+    }
+    if (nbytes < 0 || (uint32_t)buf < TASK_ADDR || (uint32_t)buf > TASK_ADDR + MB4 ||
+        (uint32_t)nbytes > TASK_ADDR + MB4 - (uint32_t)buf) {
+        return -1;
+    }
+    return (*tasks[cur_task]->file_descs[fd].ops->pwrite)(fd, buf, nbytes, offset);
+}
+
+/* int32_t check_iovec(const iovec_t* iov, int32_t iovcnt)
+ * Description: checks that an iovec array and every buffer it names are in
+ *              the task's memory
+ * Input:  iov - array from user space
+ *         iovcnt - number of entries, at most IOV_MAX
+ * Output: -1 if anything is out of range, 0 otherwise
+ * Side Effects: none
+ */
+static int32_t check_iovec(const iovec_t* iov, int32_t iovcnt) {
+    if (iovcnt < 0 || iovcnt > IOV_MAX || (uint32_t)iov < TASK_ADDR || (uint32_t)(iov + iovcnt) > (TASK_ADDR + MB4)) {
+        return -1;
+    }
+    int32_t i;
+    for (i = 0; i < iovcnt; i++) {
+        uint32_t base = (uint32_t)iov[i].base;
+        if (base < TASK_ADDR || iov[i].len > TASK_ADDR + MB4 - base) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* int32_t sys_readv(int32_t fd, const iovec_t* iov, int32_t iovcnt)
+ * Description: reads from fd into each buffer of iov in turn, stopping at
+ *              the first short read
+ * Input:  fd - index of the file
+ *         iov - buffers to fill
+ *         iovcnt - number of buffers, at most IOV_MAX
+ * Output: -1 on error, total number of bytes read otherwise
+ * Side Effects: reads from fd
+ */
+int32_t sys_readv(int32_t fd, const iovec_t* iov, int32_t iovcnt) {
+    if (fd < 0 || fd >= FILE_DESCS_LENGTH || check_iovec(iov, iovcnt) != 0) {
+        return -1;
+    }
+    int32_t total = 0;
+    int32_t i;
+    for (i = 0; i < iovcnt; i++) {
+        int32_t n = (*tasks[cur_task]->file_descs[fd].ops->read)(fd, iov[i].base, iov[i].len);
+        if (n < 0) {
+            return total > 0 ? total : n;
+        }
+        total += n;
+        if ((uint32_t)n < iov[i].len) {
+            break;
+        }
+    }
+    return total;
+}
+
+/* int32_t sys_writev(int32_t fd, const iovec_t* iov, int32_t iovcnt)
+ * Description: writes each buffer of iov to fd in turn, stopping at the
+ *              first short write
+ * Input:  fd - index of the file
+ *         iov - buffers to write
+ *         iovcnt - number of buffers, at most IOV_MAX
+ * Output: -1 on error, total number of bytes written otherwise
+ * Side Effects: writes to fd
+ */
+int32_t sys_writev(int32_t fd, const iovec_t* iov, int32_t iovcnt) {
+    if (fd < 0 || fd >= FILE_DESCS_LENGTH || check_iovec(iov, iovcnt) != 0) {
+        return -1;
+    }
+    int32_t total = 0;
+    int32_t i;
+    for (i = 0; i < iovcnt; i++) {
+        int32_t n = (*tasks[cur_task]->file_descs[fd].ops->write)(fd, iov[i].base, iov[i].len);
+        if (n < 0) {
+            return total > 0 ? total : n;
+        }
+        total += n;
+        if ((uint32_t)n < iov[i].len) {
+            break;
+        }
+    }
+    return total;
+}
@@ -2,6 +2,7 @@
 #define SYSTEM_CALLS_H_
 
 #include "types.h"
+#include "task.h"
 
 extern bool backup_init_ebp;
 //Stops the process that called this and returns control to the proccess that ran sys_execute
@@ -10,6 +11,15 @@ extern int32_t sys_halt(uint32_t status);
 // Starts a new process specified by command
 extern int32_t sys_execute(const uint8_t* command);
 
+// starts a process with two of the caller's files as its stdin and stdout
+extern int32_t sys_execute_fds(const uint8_t* command, int32_t in_fd, int32_t out_fd);
+
+// starts a new process without waiting for it to halt
+extern int32_t sys_spawn(const uint8_t* command);
+
+// waits for a spawned child to halt and collects its status
+extern int32_t sys_waitpid(int32_t pid, uint32_t* status, int32_t flags);
+
 //reads nbytes from the file pointed to by fd into buf
 extern int32_t sys_read(int32_t fd, void* buf, int32_t nbytes);
 
@@ -46,11 +56,37 @@ extern int32_t sys_thread_create(uint32_t *tid, void (*thread_start)());
 // waits for a child thread to exit
 extern int32_t sys_thread_join(uint32_t tid);
 
+// moves the calling thread's TLS block
+extern int32_t sys_set_tls(void *base);
+
 // writes file stats to buf
 extern int32_t sys_stat(int32_t fd, void* buf, int32_t nbytes);
 
 //returns time since system boot
 extern uint32_t sys_time();
 
+// reads many directory entries from fd into buf in one call
+extern int32_t sys_getdents(int32_t fd, void* buf, int32_t nbytes);
+
+// copies up to count bytes from file in_fd to out_fd inside the kernel
+extern int32_t sys_sendfile(int32_t out_fd, int32_t in_fd, int32_t count);
+
+// gets or sets the mode of an open file or sends it a device request
+extern int32_t sys_ioctl(int32_t fd, uint32_t request, uint32_t arg);
+
+// waits until at least one of several files is ready
+extern int32_t sys_poll(pollfd_t* fds, uint32_t nfds, int32_t timeout);
+
+// moves the position of an open file
+extern int32_t sys_lseek(int32_t fd, int32_t offset, int32_t whence);
+
+// reads or writes at an offset without moving the file position
+extern int32_t sys_pread(int32_t fd, void* buf, int32_t nbytes, uint32_t offset);
+extern int32_t sys_pwrite(int32_t fd, const void* buf, int32_t nbytes, uint32_t offset);
+
+// reads into or writes from several buffers in one call
+extern int32_t sys_readv(int32_t fd, const iovec_t* iov, int32_t iovcnt);
+extern int32_t sys_writev(int32_t fd, const iovec_t* iov, int32_t iovcnt);
+
 
 #endif
@@ -2,9 +2,16 @@
 #include "lib.h"
 #include "page.h"
 #include "rtc.h"
+#include "x86_desc.h"
+#include "entry.h"
+#include "apic.h"
 
 uint8_t cur_task = INIT;
 
+// Stack pages of each thread slot. Kernel memory is identity mapped, so these
+// are also the physical pages mapped for the user.
+static uint8_t thread_stack_pages[NUM_TASKS - NUM_PROCS][THREAD_STACK_PAGES][KB4] __attribute__((aligned (KB4)));
+
 //stub functions - default for file_ops
 int32_t default_open(const int8_t *buf) {
     return -1;
@@ -27,7 +34,7 @@ int32_t default_stat(int32_t fd, void *buf, int32_t nbytes) {
 }
 
 /* void setup_vid(uint32_t *dir, uint32_t *table, uint32_t priv)
- * Description: Sets up a 4KB page mapping to video memory
+ * Description: Sets up 4KB page mappings to the terminals' video memory
  * Input:  dir - A pointer to a page directory entry to fill out
  *         table - A pointer to a page table entry to fill out
  *         priv - 0 for kernel, 1 for user
@@ -48,23 +55,27 @@ void setup_vid(uint32_t *dir, uint32_t *table, uint32_t priv) {
     vid_table->readWrite = 1;    //Write enabled
     vid_table->present = 1;
 
-    page_table_kb_entry_t* vid_entry;
-    if (priv == 0) {
-        vid_entry = (page_table_kb_entry_t*)(table + (VIDEO >> 12));
-    } else {
-        vid_entry = (page_table_kb_entry_t*)(table);
+    // The kernel maps every terminal's text page, a user task maps only its own
+    uint32_t i, pages = (priv == 0) ? NUM_TERM : 1;
+    for (i = 0; i < pages; i++) {
+        page_table_kb_entry_t* vid_entry;
+        if (priv == 0) {
+            vid_entry = (page_table_kb_entry_t*)(table + (TERM_PAGE(i) >> 12));
+        } else {
+            vid_entry = (page_table_kb_entry_t*)(table);
+        }
+        vid_entry->addr = TERM_PAGE(i) >> 12;    //Lose lower 12 bits (keep 20 high bits)
+        vid_entry->avail = 0;
+        vid_entry->global = 0;
+        vid_entry->pgTblAttIdx = 0;
+        vid_entry->dirty = 0;
+        vid_entry->accessed = 0;
+        vid_entry->cacheDisabled = 0;
+        vid_entry->writeThrough = 1;  //1 for fun
+        vid_entry->userSupervisor = 0;
+        vid_entry->readWrite = 1;     //Write enabled
+        vid_entry->present = 1;
     }
-    vid_entry->addr = VIDEO >> 12;    //Lose lower 12 bits (keep 20 high bits)
-    vid_entry->avail = 0;
-    vid_entry->global = 0;
-    vid_entry->pgTblAttIdx = 0;
-    vid_entry->dirty = 0;
-    vid_entry->accessed = 0;
-    vid_entry->cacheDisabled = 0;
-    vid_entry->writeThrough = 1;  //1 for fun
-    vid_entry->userSupervisor = 0;
-    vid_entry->readWrite = 1;     //Write enabled
-    vid_entry->present = 1;
 }
 
 /* void setup_kernel_mem(uint32_t *dir)
@@ -115,6 +126,155 @@ void setup_task_mem(uint32_t *dir, uint32_t task) {
     task_entry->present = 1;
 }
 
+/* void setup_apic_mem(uint32_t *dir)
+ * Description: Fills in the 4MB page directory entry at dir with the APIC
+ *              registers at the same address, uncached and kernel only
+ * Input:  dir - the APIC_MMIO_PDE entry of a page directory
+ * Output: none
+ * Side Effects: Writes to *dir
+ */
+void setup_apic_mem(uint32_t *dir) {
+    page_dir_mb_entry_t* apic_entry = (page_dir_mb_entry_t*)dir;
+    apic_entry->addr = APIC_MMIO_BASE >> 22;
+    apic_entry->reserved = 0;
+    apic_entry->pgTblAttIdx = 0;
+    apic_entry->avail = 0;
+    apic_entry->global = 1;
+    apic_entry->pageSize = 1;
+    apic_entry->accessed = 0;
+    apic_entry->dirty = 0;
+    apic_entry->cacheDisabled = 1;  //Device registers
+    apic_entry->writeThrough = 1;
+    apic_entry->userSupervisor = 0;
+    apic_entry->readWrite = 1;
+    apic_entry->present = 1;
+}
+
+/* void setup_thread_stacks(uint32_t *dir, uint32_t *table)
+ * Description: Points a page directory entry at an empty table that thread
+ *              stacks are mapped into as threads are created
+ * Input:  dir - A pointer to the page directory entry for THREAD_STACK_ADDR
+ *         table - The process's thread stack table
+ * Output: none
+ * Side Effects: Writes to *dir and clears table
+ */
+void setup_thread_stacks(uint32_t *dir, uint32_t *table) {
+    memset(table, PAGE_RW, TABLE_SIZE);
+
+    page_dir_kb_entry_t* stack_table = (page_dir_kb_entry_t*)dir;
+    stack_table->addr = (uint32_t)table >> 12;
+    stack_table->avail = 0;
+    stack_table->global = 0;
+    stack_table->pageSize = 0;     //0 for kb
+    stack_table->reserved = 0;
+    stack_table->accessed = 0;
+    stack_table->cacheDisabled = 0;
+    stack_table->writeThrough = 0;
+    stack_table->userSupervisor = 1;
+    stack_table->readWrite = 1;
+    stack_table->present = 1;
+}
+
+/* uint32_t thread_stack_map(uint32_t task)
+ * Description: Maps the stack pages of a thread slot into the thread's
+ *              process. The page below them stays unmapped so an overflow
+ *              faults instead of running into another thread's stack.
+ * Input:  task - a thread slot whose thread_stack_table is set
+ * Output: the user address just past the top of the stack
+ * Side Effects: Writes to the thread stack table, the TLB needs no flush
+ *               since the entries were not present
+ */
+uint32_t thread_stack_map(uint32_t task) {
+    uint32_t first = (task - NUM_PROCS) * THREAD_STACK_SLOT + 1;
+    uint32_t i;
+    for (i = 0; i < THREAD_STACK_PAGES; i++) {
+        page_table_kb_entry_t* entry = (page_table_kb_entry_t*)&tasks[task]->thread_stack_table[first + i];
+        entry->addr = (uint32_t)thread_stack_pages[task - NUM_PROCS][i] >> 12;
+        entry->avail = 0;
+        entry->global = 0;
+        entry->pgTblAttIdx = 0;
+        entry->dirty = 0;
+        entry->accessed = 0;
+        entry->cacheDisabled = 0;
+        entry->writeThrough = 0;
+        entry->userSupervisor = 1;
+        entry->readWrite = 1;
+        entry->present = 1;
+    }
+    return THREAD_STACK_ADDR + (first + THREAD_STACK_PAGES) * KB4;
+}
+
+/* void thread_stack_unmap(uint32_t task)
+ * Description: Unmaps the stack pages of a thread slot from its process
+ * Input:  task - a thread slot that has finished
+ * Output: none
+ * Side Effects: Writes to the thread stack table, the caller flushes the TLB
+ */
+void thread_stack_unmap(uint32_t task) {
+    uint32_t first = (task - NUM_PROCS) * THREAD_STACK_SLOT + 1;
+    uint32_t i;
+    for (i = 0; i < THREAD_STACK_PAGES; i++) {
+        tasks[task]->thread_stack_table[first + i] = PAGE_RW;
+    }
+}
+
+/* void setup_trampoline(uint32_t *table)
+ * Description: Maps the trampoline page read-only into a user video table.
+ *              Every process shares the one physical page.
+ * Input:  table - a process's user video table
+ * Output: none
+ * Side Effects: Writes to *table
+ */
+void setup_trampoline(uint32_t *table) {
+    page_table_kb_entry_t *entry = (page_table_kb_entry_t *)&table[TRAMPOLINE_PTE];
+    entry->addr = (uint32_t)trampoline_page >> 12;
+    entry->avail = 0;
+    entry->global = 0;
+    entry->pgTblAttIdx = 0;
+    entry->dirty = 0;
+    entry->accessed = 0;
+    entry->cacheDisabled = 0;
+    entry->writeThrough = 0;
+    entry->userSupervisor = 1;
+    entry->readWrite = 0;
+    entry->present = 1;
+}
+
+/* uint32_t tls_setup(uint32_t task, uint32_t stack_top)
+ * Description: Gives a new task a zeroed TLS block at the top of its user
+ *              stack. The first word of the block points to the block.
+ * Input:  task - task that is about to enter user space
+ *         stack_top - top of its user stack, mapped in the current page directory
+ * Output: the stack top below the block
+ * Side Effects: Writes to user memory, sets tls_base
+ */
+uint32_t tls_setup(uint32_t task, uint32_t stack_top) {
+    uint32_t base = stack_top - TLS_SIZE;
+    memset((void *)base, 0, TLS_SIZE);
+    *(uint32_t *)base = base;
+    tasks[task]->tls_base = base;
+    return base;
+}
+
+/* void tls_load(uint32_t task)
+ * Description: Moves the USER_TLS segment to the TLS block of task and
+ *              reloads %gs so the new base takes effect. %gs is not saved
+ *              on kernel entry, so every user task runs with USER_TLS in it.
+ * Input:  task - task that is about to run
+ * Output: none
+ * Side Effects: Writes to the GDT and %gs
+ */
+void tls_load(uint32_t task) {
+    SET_SEG_BASE(tls_desc_ptr, tasks[task]->tls_base);
+    asm volatile("                             \n\
+    movw $" str(USER_TLS) ", %%ax              \n\
+    movw %%ax, %%gs                            \n\
+    "
+                 :
+                 :
+                 : "eax", "memory");
+}
+
 /* void create_init()
  * Description: Initializes paging for the kernel and each user task and sets up default values for each task
  * Input:  none
@@ -146,6 +306,7 @@ void create_init() {
     setup_vid(tasks[INIT]->page_directory, tasks[INIT]->kernel_vid_table, 0);
 
     setup_kernel_mem(tasks[INIT]->page_directory + 1);
+    setup_apic_mem(tasks[INIT]->page_directory + APIC_MMIO_PDE);
 
     tasks[INIT]->file_descs = file_desc_arrays[INIT];
     uint32_t file_i;
@@ -160,9 +321,15 @@ void create_init() {
         tasks[task]->kernel_esp = (uint32_t)&task_stacks[task].stack_start;
         tasks[task]->status = TASK_EMPTY;
 
+        // Thread slots get their tables from the process that creates them
+        if (task >= NUM_PROCS) {
+            continue;
+        }
+
         tasks[task]->page_directory = page_directory_tables[task];
         tasks[task]->kernel_vid_table = page_tables[task][0];
         tasks[task]->usr_vid_table = page_tables[task][1];
+        tasks[task]->thread_stack_table = page_tables[task][2];
 
         memset(tasks[task]->page_directory, PAGE_RW, TABLE_SIZE);
         memset(tasks[task]->kernel_vid_table, PAGE_RW, TABLE_SIZE);
@@ -170,13 +337,19 @@ void create_init() {
 
         setup_vid(tasks[task]->page_directory, tasks[task]->kernel_vid_table, 0);
         setup_vid(tasks[task]->page_directory + TASK_VIDEO_OFFSET, tasks[task]->usr_vid_table, 1);
+        setup_trampoline(tasks[task]->usr_vid_table);
+        // Each entry in the table keeps its own permissions
+        ((page_dir_kb_entry_t*)tasks[task]->page_directory + TASK_VIDEO_OFFSET)->userSupervisor = 1;
 
         // 1 * 4MB for virtual address of 4MB
         setup_kernel_mem(tasks[task]->page_directory + 1);
+        setup_apic_mem(tasks[task]->page_directory + APIC_MMIO_PDE);
 
         // 32 * 4MB for virtual address of 128MB
         setup_task_mem(tasks[task]->page_directory + TASK_OFFSET, task);
 
+        setup_thread_stacks(tasks[task]->page_directory + THREAD_STACK_OFFSET, tasks[task]->thread_stack_table);
+
         tasks[task]->file_descs = file_desc_arrays[task];
         uint32_t file_i;
         for (file_i = 0; file_i < FILE_DESCS_LENGTH; file_i++) {
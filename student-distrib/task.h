@@ -15,10 +15,47 @@ void setup_kernel_mem(uint32_t *dir);
 //Fills in a 4MB page directory entry at dir (which provides the virtual address) and maps it to physical address
 void setup_task_mem(uint32_t *dir, uint32_t task);
 
+// Points the page directory entry at dir to an empty table of thread stacks
+void setup_thread_stacks(uint32_t *dir, uint32_t *table);
+
+// Maps the local APIC and the IOAPIC for the kernel
+void setup_apic_mem(uint32_t *dir);
+
+// Maps the stack of a thread slot into its process and returns the top of the stack
+uint32_t thread_stack_map(uint32_t task);
+
+// Unmaps the stack of a thread slot
+void thread_stack_unmap(uint32_t task);
+
+// Maps the trampoline page into a process's user video table
+void setup_trampoline(uint32_t *table);
+
+// Carves a zeroed TLS block off the top of a new user stack and returns the stack top below it
+uint32_t tls_setup(uint32_t task, uint32_t stack_top);
+
+// Points the USER_TLS segment at a task's TLS block and reloads %gs
+void tls_load(uint32_t task);
+
 #define FILE_DESCS_LENGTH 8
-#define NUM_TASKS 10
+// Slots below NUM_PROCS hold processes, each with its own page directory and
+// 4MB of memory. The rest hold threads, which use their process's.
+#define NUM_PROCS 10
+#define NUM_TASKS 32
 #define TASK_OFFSET 32
 #define TASK_VIDEO_OFFSET 33
+#define THREAD_STACK_OFFSET 34
+#define THREAD_STACK_ADDR (THREAD_STACK_OFFSET * MB4)
+// Each thread slot gets a stack of THREAD_STACK_PAGES with an unmapped guard page below it
+#define THREAD_STACK_PAGES 4
+#define THREAD_STACK_SLOT (THREAD_STACK_PAGES + 1)
+// The trampoline page sits just below the uring page in the user video table.
+// TRAMPOLINE gives the user address of one of its entry points.
+#define TRAMPOLINE_PTE 1022
+#define TRAMPOLINE_ADDR (TASK_ADDR + MB4 + TRAMPOLINE_PTE * KB4)
+#define TRAMPOLINE(entry) (TRAMPOLINE_ADDR + ((uint32_t)(entry) - (uint32_t)trampoline_page))
+// Every task starts with a TLS block this big at the top of its user stack.
+// Its first word points to itself so user code can find it through %gs:0.
+#define TLS_SIZE 256
 
 //stub functions - default for file_ops
 int32_t default_open(const int8_t *buf);
@@ -33,6 +70,15 @@ typedef struct file_ops {
     int32_t (*read)(int32_t, void*, int32_t);
     int32_t (*write)(int32_t, const void*, int32_t);
     int32_t (*stat)(int32_t, void*, int32_t);
+    int32_t (*ioctl)(int32_t, uint32_t, uint32_t);
+    // Returns the POLL* events the file is ready for. If it is not ready,
+    // sets the queue that is woken when that may have changed.
+    int32_t (*poll)(int32_t, wait_queue_t**);
+    // Moves file_pos, returns the new position
+    int32_t (*lseek)(int32_t, int32_t, int32_t);
+    // Read and write at an offset without touching file_pos
+    int32_t (*pread)(int32_t, void*, int32_t, uint32_t);
+    int32_t (*pwrite)(int32_t, const void*, int32_t, uint32_t);
 } file_ops_t;
 
 file_ops_t default_ops;
@@ -47,12 +93,52 @@ file_ops_t filesys_ops;
 #define FD_STDIN 3
 #define FD_STDOUT 4
 #define FD_KBD 6
+#define FD_PIPE 7
+#define FD_IRQSOFF 8
+
+// Requests sys_ioctl handles for every file, the rest go to ops->ioctl
+#define IOCTL_GETFL 1
+#define IOCTL_SETFL 2
+
+// File modes set with IOCTL_SETFL
+#define O_NONBLOCK 0x1
+#define O_RAW 0x2
+
+// Events for sys_poll. Files without a poll op are always ready.
+#define POLLIN 0x1
+#define POLLOUT 0x4
+#define POLLNVAL 0x20
+#define POLL_MAX 16
+// Longer timeouts are cut to this many milliseconds (one day), well inside
+// the range the RTC tick deadline can hold without wrapping
+#define POLL_TIMEOUT_MAX 86400000
+
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
+
+#define IOV_MAX 16
+
+// One buffer given to sys_readv or sys_writev. Layout is shared with user space.
+typedef struct iovec {
+    void* base;
+    uint32_t len;
+} iovec_t;
+
+// One file given to sys_poll. Layout is shared with user space.
+typedef struct pollfd {
+    int32_t fd;
+    uint16_t events;
+    uint16_t revents;
+} pollfd_t;
 
 typedef struct file_desc {
     file_ops_t *ops;
     int32_t inode;
     int32_t file_pos;
     int32_t flags;
+    // O_NONBLOCK, O_RAW
+    uint32_t mode;
 } file_desc_t;
 
 #define TASK_EMPTY 0
@@ -61,15 +147,53 @@ typedef struct file_desc {
 #define TASK_ZOMBIE 3
 #define TASK_WAITING_FOR_THREAD 4
 
+// spawned is SPAWN_CHILD for a process started by sys_spawn, which its
+// parent reaps with sys_waitpid. It becomes SPAWN_ORPHAN if the parent halts
+// first, and then nobody keeps its status.
+#define SPAWN_CHILD 1
+#define SPAWN_ORPHAN 2
+
+// Flags for sys_waitpid
+#define WNOHANG 0x1
+
+// Room for the arguments of a process, which sys_getargs copies out
+#define ARGS_LEN 1024
+
 enum signals {
     DIV_ZERO = 0,
     SEGFAULT,
     INTERRUPT,
     ALARM,
     USER1,
+    // Real-time signals are queued with a value, each send is delivered once
+    RT0,
+    RT1,
+    RT2,
+    RT3,
     NUM_SIGNALS
 };
 
+#define RT_MIN RT0
+// Queued real-time signals each task can hold
+#define SIGQUEUE_LEN 8
+
+// How for sys_sigprocmask
+#define SIG_BLOCK 0
+#define SIG_UNBLOCK 1
+#define SIG_SETMASK 2
+
+// Faults cannot be blocked with sys_sigprocmask
+#define SIG_UNBLOCKABLE ((1 << DIV_ZERO) | (1 << SEGFAULT))
+
+// Bits of work_pending, checked on every return to user space
+#define WORK_SIGNAL 0x1
+
+typedef struct sigqueue_entry {
+    uint8_t signal;
+    int32_t value;
+} sigqueue_entry_t;
+
+// Signals sent from outside signals.c go through send_signal
 #define SET_SIGNAL(task, signal) do {tasks[task]->pending_signals |= (1 << signal);} while(0)
 #define CLEAR_SIGNAL(task, signal) do {tasks[task]->pending_signals &= ~(1 << signal);} while(0)
 #define SIGNAL_SET(task, signal) ((tasks[task]->pending_signals & (1 << signal)) != 0)
@@ -80,12 +204,18 @@ void (*signal_handlers[NUM_TASKS][NUM_SIGNALS])(int32_t);
 
 #define INIT 0
 
-file_desc_t file_desc_arrays[NUM_TASKS][FILE_DESCS_LENGTH];
+file_desc_t file_desc_arrays[NUM_PROCS][FILE_DESCS_LENGTH];
 
 #define CLEAR_THREAD(task, tid) do {tasks[task]->thread_status &= ~(1 << tid);} while(0)
 #define SET_THREAD(task, tid) do {tasks[task]->thread_status |= (1 << tid);} while(0)
 
+// The process a task belongs to, which is the task itself unless it is a thread
+#define TASK_PROC(task) (tasks[task]->thread_status == 1 ? tasks[task]->parent : (task))
+
 typedef struct {
+    // WORK_* bits for things to do before returning to user space. The
+    // return path in entry.S tests this word alone, so it has to stay first.
+    volatile uint32_t work_pending;
     // Can be any of TASK_EMPTY, TASK_RUNNING, TASK_SLEEPING,
     // TASK_ZOMBIE, or TASK_WAITING_FOR_THREAD. Used to manage
     // scheduling, threading, and creating new tasks
@@ -93,9 +223,11 @@ typedef struct {
     // An array of files owned by the process
     file_desc_t *file_descs;
     // Pointers to the page directories and tables associated with this process
+    // Threads point at their process's
     uint32_t *page_directory;
     uint32_t *kernel_vid_table;
     uint32_t *usr_vid_table;
+    uint32_t *thread_stack_table;
     // ebp is used for returning to interrupted processes
     uint32_t ebp;
     // A pointer to the kernel stack that this process should be using
@@ -105,32 +237,50 @@ typedef struct {
     // push data to and maintained by backup_uesp
     uint32_t user_esp;
     // A pointer to the arguments given to execute for retrieval by sys_getargs
+    // NULL if there were none, otherwise it points to args
     uint8_t* arg_str;
+    uint8_t args[ARGS_LEN];
     // The terminal this process belongs to
     uint32_t terminal;
     // Any pending signals waiting to be delivered will have a bit set here
     // The format is (1 << signum). Please use SET_SIGNAL, CLEAR_SIGNAL, and SIGNAL_SET
     uint32_t pending_signals;
     // A pointer to the hardware context on the user stack put there before a signal
-    // handler is called. Used by sys_sigreturn.
+    // handler is called, NULL outside a handler. Used by sys_sigreturn.
     hw_context_t *sig_hw_context;
     // If thread_status is 0 this process is a regular process with no threads
     // If thread_status is 1 this process is a thread
     // If thread_status is >1 this process owns threads where each bit set in thread_status
-    // corresponds to the index in tasks of the owned thread.
+    // corresponds to the index in tasks of the owned thread. Threads are always owned
+    // by the process, even when another of its threads created them.
     uint32_t thread_status;
     // Number of rtc interupts needed to return from rtc read
     int32_t rtc_base;
-    // counts down on each rtc interrupt until it reaches 0 at which point
-    // rtc read will return and this will get reset to rtc_base
+    // counts down on each rtc interrupt, and rtc read returns once it reaches 0.
+    // It keeps counting past 0, down to -RTC_COUNTER_FLOOR, and rtc read adds
+    // back a whole number of rtc_base periods so late reads do not drift
     int32_t rtc_counter;
     // If a parent process is waiting for a thread to finish (after sys_thread_join is called)
     // The tid of the thread will be here. Used by sys_halt
     uint8_t thread_waiting;
     // An index into tasks of the parent process
     uint8_t parent;
-    // Whether or not signals are masked for this process.
-    bool signal_mask;
+    // 0 for a process started by sys_execute, otherwise SPAWN_CHILD or SPAWN_ORPHAN
+    uint8_t spawned;
+    // The pid sys_spawn returns, set in the caller when the child starts
+    int32_t spawn_pid;
+    // The status a spawned process halted with, kept while it is a zombie
+    uint32_t exit_status;
+    // Woken when a spawned child of this process halts
+    wait_queue_t child_exit;
+    // Signals that stay pending instead of being delivered, (1 << signum)
+    uint32_t blocked;
+    // Real-time signals waiting to be delivered, oldest first
+    sigqueue_entry_t sigqueue[SIGQUEUE_LEN];
+    uint32_t sigqueue_len;
+    // Base of the task's TLS block, loaded into the USER_TLS segment in %gs
+    // whenever the task runs
+    uint32_t tls_base;
 } pcb_t;
 
 #define KERNEL_STACK_SIZE 0x8000
@@ -17,6 +17,7 @@ void terminal_init() {
     stdin_ops.close = terminal_close;
     stdin_ops.write = stdin_write;
     stdin_ops.read = terminal_read;
+    stdin_ops.poll = stdin_poll;
 
     //setup stdout
     stdout_ops.open = terminal_open;
@@ -25,6 +26,18 @@ void terminal_init() {
     stdout_ops.read = stdout_read;
 }
 
+/* int32_t stdin_poll(int32_t fd, wait_queue_t** wait)
+ * Decription: Reports stdin readable once a key is waiting. A read still
+ *             waits for the whole line to be typed.
+ * Input: fd - ignored
+ *        wait - set to the queue woken when a key is queued
+ * Output: POLLIN if a key is waiting, otherwise 0
+ * Side Effects: None
+ */
+int32_t stdin_poll(int32_t fd, wait_queue_t** wait) {
+    return kbd_poll_terminal(0, wait);
+}
+
 /* int32_t terminal_open(const int8_t* filename)
  * Decription: Opens the terminal, which currently does nothing
  * Input: filename - unused
@@ -85,16 +98,15 @@ int32_t stdout_read(int32_t fd, void* buf, int32_t nbytes){
  * Input: fd - ignored
  *        buf - pointer to string to write
  *        nbytes - number of characters to write
- * Output: 0 for success
+ * Output: number of characters written
  * Side Effects: Writes to video memory
  */
 int32_t terminal_write(int32_t fd, const void* buf, int32_t nbytes) {
-    register int32_t index = 0;
-    while(index < nbytes) {
-        putc(((int8_t*)buf)[index]);
-        index++;
+    if (nbytes < 0) {
+        return -1;
     }
-    return 0;
+    putbuf((const uint8_t*)buf, nbytes);
+    return nbytes;
 }
 
 /* int32_t terminal_read(int32_t fd, void* buf, int32_t nbytes)
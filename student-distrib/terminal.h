@@ -29,6 +29,9 @@ extern int32_t terminal_read(int32_t fd, void* buf, int32_t nbytes);
 //Read from stdout - stub function
 extern int32_t stdout_read(int32_t fd, void* buf, int32_t nbytes);
 
+//Checks whether stdin has keys waiting
+extern int32_t stdin_poll(int32_t fd, wait_queue_t** wait);
+
 extern void clear_hist();
 
 //System calls for stdin/stdout
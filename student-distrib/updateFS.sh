@@ -7,7 +7,8 @@ cd fish
 make
 cd ..
 cp fish/fish fsdir
-./createfs -i fsdir -o student-distrib/filesys_img
+make -C buildfs
+./buildfs/buildfs -i fsdir -o student-distrib/filesys_img -H
 cd student-distrib
 make clean
 make
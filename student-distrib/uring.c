@@ -0,0 +1,140 @@
+/* uring.c - Shared submission/completion rings for batching system calls
+ */
+
+#include "uring.h"
+#include "lib.h"
+#include "page.h"
+#include "task.h"
+#include "system_calls.h"
+
+// One ring page for each process slot. Kernel memory is identity mapped, so
+// the kernel address is also the physical address mapped for the user.
+typedef union uring_page {
+    uring_t ring;
+    uint8_t page[KB4];
+} uring_page_t;
+
+static uring_page_t uring_pages[NUM_PROCS] __attribute__((aligned (KB4)));
+
+/* uring_t* current_uring()
+ * Description: Finds the ring mapped into the current task
+ * Input:  none
+ * Output: the ring, or NULL if the task has not called uring_setup
+ * Side Effects: none
+ */
+static uring_t* current_uring() {
+    page_table_kb_entry_t *entry = (page_table_kb_entry_t *)&tasks[cur_task]->usr_vid_table[URING_PTE];
+    if (!entry->present) {
+        return NULL;
+    }
+    return (uring_t *)(entry->addr << 12);
+}
+
+/* int32_t sys_uring_setup(uint8_t** ring)
+ * Description: Maps an empty ring page into the current task
+ * Input:  ring - pointer to what becomes a pointer to the ring
+ * Output: -1 on error, 0 on success
+ * Side Effects: writes to *ring, changes the task's page tables
+ */
+int32_t sys_uring_setup(uint8_t** ring) {
+    if ((uint32_t)ring < TASK_ADDR || (uint32_t)ring >= (TASK_ADDR + MB4)) {
+        return -1;
+    }
+
+    uint32_t proc = TASK_PROC(cur_task);
+    memset(&uring_pages[proc], 0, sizeof(uring_page_t));
+
+    // The video table's directory entry has to allow user access. Its other
+    // entries keep their own permissions.
+    ((page_dir_kb_entry_t*)tasks[cur_task]->page_directory + TASK_VIDEO_OFFSET)->userSupervisor = 1;
+
+    page_table_kb_entry_t *entry = (page_table_kb_entry_t *)&tasks[cur_task]->usr_vid_table[URING_PTE];
+    entry->addr = (uint32_t)&uring_pages[proc] >> 12;
+    entry->avail = 0;
+    entry->global = 0;
+    entry->pgTblAttIdx = 0;
+    entry->dirty = 0;
+    entry->accessed = 0;
+    entry->cacheDisabled = 0;
+    entry->writeThrough = 0;
+    entry->userSupervisor = 1;
+    entry->readWrite = 1;
+    entry->present = 1;
+
+    // Flush the TLB
+    switch_page_directory(cur_task);
+
+    *ring = (uint8_t *)URING_ADDR;
+    return 0;
+}
+
+/* int32_t uring_run(uring_sqe_t* sqe)
+ * Description: Runs one submitted operation
+ * Input:  sqe - copy of the submission
+ * Output: the result of the system call, -1 for an unknown opcode
+ * Side Effects: whatever the system call does
+ */
+static int32_t uring_run(uring_sqe_t* sqe) {
+    switch (sqe->opcode) {
+    case URING_OP_NOP:
+        return 0;
+    case URING_OP_READ:
+        return sys_read(sqe->fd, (void *)sqe->addr, sqe->len);
+    case URING_OP_WRITE:
+        return sys_write(sqe->fd, (const void *)sqe->addr, sqe->len);
+    case URING_OP_OPEN:
+        return sys_open((const uint8_t *)sqe->addr);
+    case URING_OP_CLOSE:
+        return sys_close(sqe->fd);
+    case URING_OP_STAT:
+        return sys_stat(sqe->fd, (void *)sqe->addr, sqe->len);
+    default:
+        return -1;
+    }
+}
+
+/* int32_t sys_uring_enter(uint32_t to_submit)
+ * Description: Runs up to to_submit operations from the submission queue in
+ *              order, posting a completion for each. Stops early when the
+ *              completion queue is full. Operations run to completion in
+ *              this call, so a batch costs one trap instead of one per call.
+ * Input:  to_submit - maximum number of submissions to run
+ * Output: -1 on error, otherwise the number of submissions consumed
+ * Side Effects: advances sq_head and cq_tail
+ */
+int32_t sys_uring_enter(uint32_t to_submit) {
+    uring_t *ring = current_uring();
+    if (ring == NULL) {
+        return -1;
+    }
+
+    uint32_t head = ring->sq_head;
+    uint32_t pending = ring->sq_tail - head;
+    if (pending > URING_SQ_ENTRIES) {
+        return -1;
+    }
+    if (to_submit > pending) {
+        to_submit = pending;
+    }
+
+    uint32_t done;
+    for (done = 0; done < to_submit; done++) {
+        uint32_t tail = ring->cq_tail;
+        if (tail - ring->cq_head >= URING_CQ_ENTRIES) {
+            break;
+        }
+
+        // Copy the submission so the user can not change it while it runs
+        uring_sqe_t sqe = ring->sqes[(head + done) & (URING_SQ_ENTRIES - 1)];
+        ring->sq_head = head + done + 1;
+
+        uring_cqe_t *cqe = &ring->cqes[tail & (URING_CQ_ENTRIES - 1)];
+        cqe->user_data = sqe.user_data;
+        cqe->res = uring_run(&sqe);
+        // The completion has to be written before the user can see it
+        barrier();
+        ring->cq_tail = tail + 1;
+    }
+
+    return done;
+}
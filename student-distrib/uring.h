@@ -0,0 +1,63 @@
+/* uring.h - Shared submission/completion rings for batching system calls
+ */
+
+#ifndef URING_H
+#define URING_H
+
+#include "types.h"
+#include "page.h"
+
+// The ring is mapped at the last page of the user video table, out of the
+// way of vidmap_all, which uses the first 32 entries
+#define URING_PTE 1023
+#define URING_ADDR (TASK_ADDR + MB4 + URING_PTE * KB4)
+
+// Entries in each queue, powers of two so indices can be masked
+#define URING_SQ_ENTRIES 32
+#define URING_CQ_ENTRIES 64
+
+// Operations a submission can ask for. Each runs the system call of the same name.
+#define URING_OP_NOP 0
+#define URING_OP_READ 1
+#define URING_OP_WRITE 2
+#define URING_OP_OPEN 3
+#define URING_OP_CLOSE 4
+#define URING_OP_STAT 5
+
+// One operation submitted by the user
+typedef struct uring_sqe {
+    uint32_t opcode;
+    int32_t fd;
+    // Buffer for read, write and stat, file name for open
+    uint32_t addr;
+    uint32_t len;
+    // Copied to the completion unchanged
+    uint32_t user_data;
+} uring_sqe_t;
+
+// The result of one operation
+typedef struct uring_cqe {
+    uint32_t user_data;
+    int32_t res;
+} uring_cqe_t;
+
+// The page shared with the user. Indices count up forever and are masked
+// when used. The user writes sq_tail and cq_head, the kernel sq_head and
+// cq_tail. Layout is shared with user space.
+typedef struct uring {
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    uint32_t reserved[4];
+    uring_sqe_t sqes[URING_SQ_ENTRIES];
+    uring_cqe_t cqes[URING_CQ_ENTRIES];
+} uring_t;
+
+// Maps a fresh ring into the current task and points *ring at it
+extern int32_t sys_uring_setup(uint8_t** ring);
+
+// Runs up to to_submit queued operations and posts their completions
+extern int32_t sys_uring_enter(uint32_t to_submit);
+
+#endif
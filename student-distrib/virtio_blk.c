@@ -0,0 +1,186 @@
+#include "virtio_blk.h"
+#include "blkdev.h"
+#include "idt.h"
+#include "lib.h"
+#include "pci.h"
+
+// Device writes land in memory the compiler can not see, and x86 only
+// reorders stores after loads, so a compiler barrier orders ring accesses
+// and a locked instruction is used where a store must be visible before a load.
+#define mb() asm volatile("lock; addl $0, (%%esp)" : : : "memory", "cc")
+
+// One in flight request. The header and status byte are DMA'd, so they live
+// in kernel memory, which is identity mapped.
+typedef struct virtio_blk_slot {
+    virtio_blk_req_hdr_t hdr;
+    volatile uint8_t status;
+    blk_request_t* req;
+} virtio_blk_slot_t;
+
+static uint8_t vring[3 * VIRTQ_ALIGN] __attribute__((aligned(VIRTQ_ALIGN)));
+static virtq_desc_t* desc;
+static virtq_avail_t* avail;
+static volatile virtq_used_t* used;
+static uint16_t queue_size;
+static uint16_t last_used;
+
+static virtio_blk_slot_t slots[VIRTIO_BLK_SLOTS];
+static uint32_t free_slots;
+
+static uint32_t io_base;
+static blkdev_t vda;
+static irqaction virtio_blk_irqaction;
+
+/* void virtio_blk_start(blkdev_t* dev)
+ * Description: moves queued requests onto the virtqueue while there are free
+ *              slots and tells the device about them
+ * Input:  dev - the virtio-blk device
+ * Output: none
+ * Side Effects: writes the descriptor table and available ring, notifies the device
+ */
+static void virtio_blk_start(blkdev_t* dev) {
+    bool added = false;
+
+    while (free_slots) {
+        blk_request_t* req = blk_dequeue(dev);
+        if (req == NULL) {
+            break;
+        }
+
+        uint32_t slot = 0;
+        while (!(free_slots & (1 << slot))) {
+            slot++;
+        }
+        free_slots &= ~(1 << slot);
+
+        virtio_blk_slot_t* s = &slots[slot];
+        s->hdr.type = req->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+        s->hdr.reserved = 0;
+        s->hdr.sector = req->sector;
+        s->status = 0xFF;
+        s->req = req;
+
+        // Slot i always uses descriptors 3i, 3i + 1 and 3i + 2
+        uint16_t head = slot * 3;
+        desc[head].addr = (uint32_t)&s->hdr;
+        desc[head].len = sizeof(virtio_blk_req_hdr_t);
+        desc[head].flags = VIRTQ_DESC_F_NEXT;
+        desc[head].next = head + 1;
+
+        desc[head + 1].addr = (uint32_t)req->buf;
+        desc[head + 1].len = req->count * SECTOR_SIZE;
+        desc[head + 1].flags = VIRTQ_DESC_F_NEXT | (req->write ? 0 : VIRTQ_DESC_F_WRITE);
+        desc[head + 1].next = head + 2;
+
+        desc[head + 2].addr = (uint32_t)&s->status;
+        desc[head + 2].len = 1;
+        desc[head + 2].flags = VIRTQ_DESC_F_WRITE;
+        desc[head + 2].next = 0;
+
+        avail->ring[avail->idx % queue_size] = head;
+        barrier();
+        avail->idx++;
+        added = true;
+    }
+
+    if (added) {
+        mb();
+        outw(0, io_base + VIRTIO_REG_QUEUE_NOTIFY);
+    }
+}
+
+/* void virtio_blk_poll(blkdev_t* dev)
+ * Description: completes every request the device has put on the used
+ *              ring and starts queued ones in the freed slots
+ * Input:  dev - the virtio-blk device
+ * Output: none
+ * Side Effects: completes requests
+ */
+static void virtio_blk_poll(blkdev_t* dev) {
+    uint32_t flags;
+    cli_and_save(flags);
+
+    while (last_used != used->idx) {
+        barrier();
+        uint32_t slot = used->ring[last_used % queue_size].id / 3;
+        last_used++;
+        if (slot >= VIRTIO_BLK_SLOTS || (free_slots & (1 << slot))) {
+            continue;
+        }
+        free_slots |= 1 << slot;
+        blk_complete(slots[slot].req, slots[slot].status == 0 ? 0 : -1);
+    }
+    virtio_blk_start(dev);
+
+    restore_flags(flags);
+}
+
+/* void virtio_blk_irq(int dev_id)
+ * Description: interrupt handler, the line may be shared with other devices
+ * Input:  dev_id - unused
+ * Output: none
+ * Side Effects: reading the ISR register acknowledges the interrupt
+ */
+static void virtio_blk_irq(int dev_id) {
+    if (inb(io_base + VIRTIO_REG_ISR) & VIRTIO_ISR_QUEUE) {
+        virtio_blk_poll(&vda);
+    }
+}
+
+/* int32_t virtio_blk_init(void)
+ * Description: finds the first virtio-blk PCI device, sets up its request
+ *              virtqueue and registers it as block device "vda"
+ * Input:  none
+ * Output: 0 on success, -1 if there is no usable device
+ * Side Effects: resets and programs the device, installs its interrupt handler
+ */
+int32_t virtio_blk_init(void) {
+    pci_dev_t pci;
+    if (pci_find_device(VIRTIO_VENDOR_ID, VIRTIO_BLK_DEVICE_ID, 0, &pci) != 0) {
+        return -1;
+    }
+    uint32_t bar0 = pci_read32(&pci, PCI_BAR0);
+    if (!(bar0 & PCI_BAR_IO)) {
+        return -1;
+    }
+    io_base = bar0 & ~0x3;
+    pci_enable_device(&pci);
+
+    // Reset, then announce a driver that wants no optional features
+    outb(0, io_base + VIRTIO_REG_STATUS);
+    outb(VIRTIO_STATUS_ACKNOWLEDGE, io_base + VIRTIO_REG_STATUS);
+    outb(VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER, io_base + VIRTIO_REG_STATUS);
+    outl(0, io_base + VIRTIO_REG_GUEST_FEATURES);
+
+    outw(0, io_base + VIRTIO_REG_QUEUE_SELECT);
+    queue_size = inw(io_base + VIRTIO_REG_QUEUE_SIZE);
+    if (queue_size < VIRTIO_BLK_SLOTS * 3 || queue_size > VIRTQ_MAX_SIZE) {
+        outb(VIRTIO_STATUS_FAILED, io_base + VIRTIO_REG_STATUS);
+        return -1;
+    }
+
+    // Descriptors and the available ring share the first pages, the used
+    // ring starts on the next page boundary
+    memset(vring, 0, sizeof(vring));
+    desc = (virtq_desc_t*)vring;
+    avail = (virtq_avail_t*)(vring + queue_size * sizeof(virtq_desc_t));
+    uint32_t used_offset = queue_size * sizeof(virtq_desc_t) + sizeof(virtq_avail_t) + queue_size * sizeof(uint16_t);
+    used_offset = (used_offset + VIRTQ_ALIGN - 1) & ~(VIRTQ_ALIGN - 1);
+    used = (virtq_used_t*)(vring + used_offset);
+    last_used = 0;
+    free_slots = (1 << VIRTIO_BLK_SLOTS) - 1;
+    outl((uint32_t)vring / VIRTQ_ALIGN, io_base + VIRTIO_REG_QUEUE_PFN);
+
+    strncpy(vda.name, "vda", BLKDEV_NAME_LEN);
+    vda.num_sectors = inl(io_base + VIRTIO_REG_CONFIG) | ((uint64_t)inl(io_base + VIRTIO_REG_CONFIG + 4) << 32);
+    vda.start = virtio_blk_start;
+    vda.poll = virtio_blk_poll;
+    blkdev_register(&vda);
+
+    virtio_blk_irqaction.handle = virtio_blk_irq;
+    virtio_blk_irqaction.dev_id = pci_read8(&pci, PCI_INTERRUPT_LINE);
+    request_irq(virtio_blk_irqaction.dev_id, &virtio_blk_irqaction);
+
+    outb(VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK, io_base + VIRTIO_REG_STATUS);
+    return 0;
+}
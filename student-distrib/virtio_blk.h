@@ -0,0 +1,79 @@
+/* virtio_blk.h - Legacy (virtio 0.9.5) PCI virtio-blk driver, as provided by
+ * QEMU's -drive if=virtio
+ */
+
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+#include "types.h"
+
+#define VIRTIO_VENDOR_ID 0x1AF4
+#define VIRTIO_BLK_DEVICE_ID 0x1001
+
+// Legacy register layout in BAR0's I/O space
+#define VIRTIO_REG_DEVICE_FEATURES 0x00
+#define VIRTIO_REG_GUEST_FEATURES 0x04
+#define VIRTIO_REG_QUEUE_PFN 0x08
+#define VIRTIO_REG_QUEUE_SIZE 0x0C
+#define VIRTIO_REG_QUEUE_SELECT 0x0E
+#define VIRTIO_REG_QUEUE_NOTIFY 0x10
+#define VIRTIO_REG_STATUS 0x12
+#define VIRTIO_REG_ISR 0x13
+// Device specific configuration, the 64 bit capacity for virtio-blk
+#define VIRTIO_REG_CONFIG 0x14
+
+#define VIRTIO_STATUS_ACKNOWLEDGE 0x1
+#define VIRTIO_STATUS_DRIVER 0x2
+#define VIRTIO_STATUS_DRIVER_OK 0x4
+#define VIRTIO_STATUS_FAILED 0x80
+
+#define VIRTIO_ISR_QUEUE 0x1
+
+#define VIRTQ_DESC_F_NEXT 0x1
+#define VIRTQ_DESC_F_WRITE 0x2
+
+// Legacy virtqueues are laid out in 4KB pages given by page frame number
+#define VIRTQ_ALIGN 4096
+// Largest queue the driver has room for
+#define VIRTQ_MAX_SIZE 256
+
+#define VIRTIO_BLK_T_IN 0
+#define VIRTIO_BLK_T_OUT 1
+
+// Requests in flight at once, each takes 3 descriptors
+#define VIRTIO_BLK_SLOTS 16
+
+typedef struct virtq_desc {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed)) virtq_desc_t;
+
+typedef struct virtq_avail {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+} __attribute__((packed)) virtq_avail_t;
+
+typedef struct virtq_used_elem {
+    uint32_t id;
+    uint32_t len;
+} __attribute__((packed)) virtq_used_elem_t;
+
+typedef struct virtq_used {
+    uint16_t flags;
+    uint16_t idx;
+    virtq_used_elem_t ring[];
+} __attribute__((packed)) virtq_used_t;
+
+typedef struct virtio_blk_req_hdr {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} __attribute__((packed)) virtio_blk_req_hdr_t;
+
+// finds the first virtio-blk device and registers it as "vda", 0 on success
+extern int32_t virtio_blk_init(void);
+
+#endif
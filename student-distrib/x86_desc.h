@@ -15,6 +15,7 @@
 #define USER_DS 0x002B
 #define KERNEL_TSS 0x0033
 #define KERNEL_LDT 0x0038
+#define USER_TLS 0x0043
 
 /* Size of the task state segment (TSS) */
 #define TSS_SIZE 104
@@ -124,6 +125,8 @@ extern uint32_t tss_size;
 extern seg_desc_t tss_desc_ptr;
 extern tss_t tss;
 
+extern seg_desc_t tls_desc_ptr;
+
 /* Sets runtime-settable parameters in the GDT entry for the LDT */
 #define SET_LDT_PARAMS(str, addr, lim)                          \
     do {                                                        \
@@ -144,6 +147,14 @@ extern tss_t tss;
         str.seg_lim_15_00 = (lim) & 0x0000FFFF;                 \
     } while(0)
 
+/* Moves the base of a GDT entry, keeping its limit */
+#define SET_SEG_BASE(str, addr)                                 \
+    do {                                                        \
+        str.base_31_24 = ((uint32_t)(addr) & 0xFF000000) >> 24; \
+        str.base_23_16 = ((uint32_t)(addr) & 0x00FF0000) >> 16; \
+        str.base_15_00 = (uint32_t)(addr) & 0x0000FFFF;         \
+    } while(0)
+
 /* An interrupt descriptor entry (goes into the IDT) */
 typedef union idt_desc_t {
     uint32_t val;
@@ -6,20 +6,35 @@
 #define BUFSIZE 1024
 #define SBUFSIZE 33
 
+/* Reads until n bytes arrive or the file ends, since a pipe hands over
+ * whatever has been written so far */
+static int32_t
+read_full (int32_t fd, uint8_t* buf, int32_t n)
+{
+    int32_t cnt, got = 0;
+
+    while (got < n) {
+        cnt = ece391_read (fd, buf + got, n - got);
+	if (-1 == cnt)
+	    return (0 == got ? -1 : got);
+	if (0 == cnt)
+	    break;
+	got += cnt;
+    }
+    return got;
+}
+
+/* Prints the lines of fd containing s, prefixed by fname unless it is 0 */
 int32_t
-do_one_file (const char* s, const char* fname) 
+do_one_fd (const char* s, int32_t fd, const char* fname)
 {
-    int32_t fd, cnt, last, line_start, line_end, check, s_len;
+    int32_t cnt, last, line_start, line_end, check, s_len;
     uint8_t data[BUFSIZE+1];
 
     s_len = ece391_strlen ((uint8_t*)s);
-    if (-1 == (fd = ece391_open ((uint8_t*)fname))) {
-        ece391_fdputs (1, (uint8_t*)"file open failed\n");
-        return -1;
-    }
     last = 0;
     while (1) {
-        cnt = ece391_read (fd, data + last, BUFSIZE - last);
+        cnt = read_full (fd, data + last, BUFSIZE - last);
 	if (-1 == cnt) {
             ece391_fdputs (1, (uint8_t*)"file read failed\n");
             return -1;
@@ -42,8 +57,10 @@ do_one_file (const char* s, const char* fname)
 	    for (check = line_start; check < line_end; check++) {
 		if (s[0] == data[check] && 
 		    0 == ece391_strncmp ((uint8_t*)(data + check), (uint8_t*)s, s_len)) {
-		    ece391_fdputs (1, (uint8_t*)fname);
-		    ece391_fdputs (1, (uint8_t*)":");
+		    if (0 != fname) {
+			ece391_fdputs (1, (uint8_t*)fname);
+			ece391_fdputs (1, (uint8_t*)":");
+		    }
 		    ece391_fdputs (1, data + line_start);
 		    ece391_fdputs (1, (uint8_t*)"\n");
 		    break;
@@ -58,6 +75,20 @@ do_one_file (const char* s, const char* fname)
 	if (0 == cnt)
 	    break;
     }
+    return 0;
+}
+
+int32_t
+do_one_file (const char* s, const char* fname) 
+{
+    int32_t fd;
+
+    if (-1 == (fd = ece391_open ((uint8_t*)fname))) {
+        ece391_fdputs (1, (uint8_t*)"file open failed\n");
+        return -1;
+    }
+    if (0 != do_one_fd (s, fd, fname))
+        return -1;
     if (-1 == ece391_close (fd)) {
         ece391_fdputs (1, (uint8_t*)"file close failed\n");
         return -1;
@@ -70,12 +101,17 @@ int main ()
     int32_t fd, cnt;
     uint8_t buf[SBUFSIZE];
     uint8_t search[BUFSIZE];
+    fstat_t st;
 
     if (0 != ece391_getargs (search, BUFSIZE)) {
         ece391_fdputs (1, (uint8_t*)"could not read argument\n");
         return 3;
     }
 
+    /* At the end of a pipeline, search what comes in instead of the files */
+    if (0 == ece391_stat (0, &st, sizeof (st)) && STAT_TYPE_PIPE == st.type)
+        return (0 == do_one_fd ((char*)search, 0, 0) ? 0 : 3);
+
     if (-1 == (fd = ece391_open ((uint8_t*)"."))) {
         ece391_fdputs (1, (uint8_t*)"directory open failed\n");
 	return 2;
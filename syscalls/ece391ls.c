@@ -3,49 +3,88 @@
 #include "ece391support.h"
 #include "ece391syscall.h"
 
-#define SBUFSIZE 33
+#define NUM_DIRENTS 64
+#define OUTBUFSIZE 4096
+#define NAME_WIDTH 35
 
-typedef struct fstat {
-    uint8_t type;
-    uint32_t size;
-}fstat_t;
+static uint8_t out[OUTBUFSIZE];
+static uint32_t out_len;
+
+/* Output is batched and written once per getdents call. */
+static void out_flush(void)
+{
+    if (out_len != 0)
+        (void)ece391_write(1, out, out_len);
+    out_len = 0;
+}
+
+static void out_str(const uint8_t* s, uint32_t len)
+{
+    uint32_t i;
+    for (i = 0; i < len; i++) {
+        if (out_len == OUTBUFSIZE)
+            out_flush();
+        out[out_len++] = s[i];
+    }
+}
+
+static void out_num(uint32_t value)
+{
+    uint8_t conv_buf[36];
+    ece391_itoa(value, conv_buf, 10);
+    out_str(conv_buf, ece391_strlen(conv_buf));
+}
 
 int main ()
 {
-    int32_t fd, cnt;
-    uint8_t buf[SBUFSIZE];
+    int32_t fd, cnt, i;
+    uint32_t len, it;
+    dirent_t ents[NUM_DIRENTS];
+    int32_t long_format;
 
     uint8_t args[128];
-    ece391_getargs(args, 128);
+    uint8_t* path = (uint8_t*)".";
+    long_format = 0;
+    if (0 == ece391_getargs(args, 128)) {
+        // ls [-l] [directory]
+        path = args;
+        if (path[0] == '-' && path[1] == 'l' && (path[2] == ' ' || path[2] == '\0')) {
+            long_format = 1;
+            path += 2;
+        }
+        while (*path == ' ') path++;
+        if (*path == '\0')
+            path = (uint8_t*)".";
+    }
 
-    if (-1 == (fd = ece391_open ((uint8_t*)"."))) {
+    if (-1 == (fd = ece391_open (path))) {
         ece391_fdputs (1, (uint8_t*)"directory open failed\n");
         return 2;
     }
 
-    if (!ece391_strcmp(args, (uint8_t*)"-l")) {
-        uint8_t text[33];
-        fstat_t data;
-        uint32_t it;
-        while((ece391_read(fd, text, 33) != 0)) {
-            text[32] = 0;
-            printf("File Name: %s",text);
-            for(it = 0; it < 35 - ece391_strlen(text); it++)
-                printf(" ");
-            ece391_stat(fd, &data, sizeof(fstat_t));
-            printf((uint8_t*)"File Type: %d    File Size: %dB\n", data.type, data.size);
+    while (0 != (cnt = ece391_getdents (fd, ents, sizeof(ents)))) {
+        if (-1 == cnt) {
+            ece391_fdputs (1, (uint8_t*)"directory entry read failed\n");
+            return 3;
         }
-
-    } else {
-        while (0 != (cnt = ece391_read (fd, buf, SBUFSIZE-1))) {
-            if (-1 == cnt) {
-                ece391_fdputs (1, (uint8_t*)"directory entry read failed\n");
-                return 3;
+        for (i = 0; i < cnt / (int32_t)sizeof(dirent_t); i++) {
+            for (len = 0; len < 32 && ents[i].name[len] != '\0'; len++);
+            if (long_format) {
+                out_str((uint8_t*)"File Name: ", 11);
+                out_str(ents[i].name, len);
+                for (it = len; it < NAME_WIDTH; it++)
+                    out_str((uint8_t*)" ", 1);
+                out_str((uint8_t*)"File Type: ", 11);
+                out_num(ents[i].type);
+                out_str((uint8_t*)"    File Size: ", 15);
+                out_num(ents[i].size);
+                out_str((uint8_t*)"B\n", 2);
+            } else {
+                out_str(ents[i].name, len);
+                out_str((uint8_t*)"\n", 1);
             }
-            buf[cnt] = '\n';
-            if (-1 == ece391_write (1, buf, cnt + 1))
-                return 3;
         }
+        out_flush();
     }
     return 0;
 }
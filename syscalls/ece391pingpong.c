@@ -12,6 +12,20 @@
 #define STARTCHAR 'A'
 #define ENDCHAR 'Z'
 
+/* Writes the empty world in buf with c at column j, without touching buf */
+static void draw(uint8_t *buf, int32_t j, uint8_t c)
+{
+    iovec_t iov[3];
+
+    iov[0].base = buf;
+    iov[0].len = j;
+    iov[1].base = &c;
+    iov[1].len = 1;
+    iov[2].base = buf + j + 1;
+    iov[2].len = BUFMAX - ENDING - j;
+    ece391_writev(1, iov, 3);
+}
+
 int main ()
 {
     int32_t i = 0;
@@ -58,15 +72,8 @@ int main ()
 	// Move out
 	for(j = STARTLOOP; j < LOOPMAX; j++)
 	{
-            // Clear inner portion of world
-            for(i = STARTLOOP; i < LOOPMAX; i++)
-            {
-                buf[i]=' ';
-            }
-
             // Draw character
-            buf[j] = curchar;
-            ece391_fdputs (1, buf);
+            draw(buf, j, curchar);
 
             // Wait for RTC tick
             ece391_read(rtc_fd, &garbage, 4);
@@ -75,15 +82,8 @@ int main ()
 	// Bounce back
     	for(j = LOOPMAX - 1; j >= STARTLOOP; j--)
     	{
-            // Clear inner portion of the world
-            for(i = STARTLOOP; i < LOOPMAX; i++)
-            {
-                buf[i]=' ';
-            }
-
             // Draw character
-            buf[j] = curchar;
-            ece391_fdputs (1, buf);
+            draw(buf, j, curchar);
 
             // Wait for RTC tick
             ece391_read(rtc_fd, &garbage, 4);
@@ -5,13 +5,95 @@
 
 #define BUFSIZE 1024
 
+/* The left stage of a pipeline, run from a thread */
+static uint8_t *left_cmd;
+static int32_t left_out;
+static int32_t left_rval;
+
+static void run_left ()
+{
+    left_rval = ece391_execute_fds (left_cmd, -1, left_out);
+}
+
+/* Strips spaces from both ends of s in place and returns the new start */
+static uint8_t *trim (uint8_t *s)
+{
+    uint32_t len;
+
+    while (' ' == *s)
+        s++;
+    len = ece391_strlen (s);
+    while (len > 0 && ' ' == s[len - 1])
+        s[--len] = '\0';
+    return s;
+}
+
+/* Runs "left | right" with both stages at once. The left stage is started
+ * from a thread so that the shell can wait on the right one. Returns the
+ * status of the right stage. */
+static int32_t run_pipeline (uint8_t *left, uint8_t *right)
+{
+    int32_t fds[2];
+    uint32_t tid = 0;
+    int32_t rval;
+
+    if (-1 == ece391_pipe (fds))
+        return -1;
+
+    left_cmd = left;
+    left_out = fds[1];
+    left_rval = 0;
+    ece391_thread_create (&tid, run_left);
+    if (0 == tid) {
+        ece391_close (fds[0]);
+        ece391_close (fds[1]);
+        return -1;
+    }
+
+    rval = ece391_execute_fds (right, fds[0], -1);
+    ece391_thread_join (tid);
+    if (-1 == left_rval)
+        ece391_fdputs (1, (uint8_t*)"no such command\n");
+    return rval;
+}
+
+/* Prints "[pid] msg" for a background job */
+static void job_msg (int32_t pid, const char *msg)
+{
+    uint8_t num[12];
+
+    ece391_fdputs (1, (uint8_t*)"[");
+    ece391_fdputs (1, ece391_itoa (pid, num, 10));
+    ece391_fdputs (1, (uint8_t*)"] ");
+    ece391_fdputs (1, (uint8_t*)msg);
+}
+
+/* Reports every background job that has finished since the last prompt */
+static void reap_jobs ()
+{
+    int32_t pid;
+    uint32_t status;
+
+    while (0 < (pid = ece391_waitpid (-1, &status, WNOHANG))) {
+        if (0 == status)
+            job_msg (pid, "done\n");
+        else if (256 == status)
+            job_msg (pid, "terminated by exception\n");
+        else
+            job_msg (pid, "exited abnormally\n");
+    }
+}
+
 int main ()
 {
-    int32_t cnt, rval;
+    int32_t cnt, rval, pid;
+    uint32_t len;
     uint8_t buf[BUFSIZE];
+    uint8_t *cmd, *pipe, *left, *right;
     ece391_fdputs (1, (uint8_t*)"Starting 391 Shell\n");
 
     while (1) {
+        reap_jobs ();
         ece391_fdputs (1, (uint8_t*)"391OS> ");
 	if (-1 == (cnt = ece391_read (0, buf, BUFSIZE-1))) {
 	    ece391_fdputs (1, (uint8_t*)"read from keyboard failed\n");
@@ -24,7 +106,35 @@ int main ()
 	    return 0;
 	if ('\0' == buf[0])
 	    continue;
-	rval = ece391_execute (buf);
+	/* A trailing & runs the command in the background */
+	cmd = trim (buf);
+	len = ece391_strlen (cmd);
+	if (len > 0 && '&' == cmd[len - 1]) {
+	    cmd[len - 1] = '\0';
+	    cmd = trim (cmd);
+	    for (pipe = cmd; '\0' != *pipe && '|' != *pipe; pipe++);
+	    if ('\0' == cmd[0] || '|' == *pipe) {
+		ece391_fdputs (1, (uint8_t*)"only a single command can run with &\n");
+	    } else if (-1 == (pid = ece391_spawn (cmd))) {
+		ece391_fdputs (1, (uint8_t*)"no such command\n");
+	    } else {
+		job_msg (pid, "started\n");
+	    }
+	    continue;
+	}
+	for (pipe = buf; '\0' != *pipe && '|' != *pipe; pipe++);
+	if ('|' == *pipe) {
+	    *pipe = '\0';
+	    left = trim (buf);
+	    right = trim (pipe + 1);
+	    if ('\0' == left[0] || '\0' == right[0]) {
+		ece391_fdputs (1, (uint8_t*)"missing command around |\n");
+		continue;
+	    }
+	    rval = run_pipeline (left, right);
+	} else {
+	    rval = ece391_execute (buf);
+	}
 	if (-1 == rval)
 	    ece391_fdputs (1, (uint8_t*)"no such command\n");
 	else if (256 == rval)
@@ -230,3 +230,122 @@ int32_t printf(int8_t *format, ...) {
 
     return (buf - format);
 }
+
+/* Returns the calling thread's TLS block */
+ece391_tls_t* ece391_tls(void)
+{
+    ece391_tls_t* tls;
+    asm volatile("movl %%gs:0, %0" : "=r"(tls));
+    return tls;
+}
+
+/* Atomically replace *p with v and return the old value */
+static int32_t atomic_xchg(volatile int32_t* p, int32_t v)
+{
+    asm volatile ("xchgl %0, %1" : "+r" (v), "+m" (*p) : : "memory");
+    return v;
+}
+
+/* Atomically replace *p with new if it holds old, and return what it held */
+static int32_t atomic_cmpxchg(volatile int32_t* p, int32_t old, int32_t new)
+{
+    int32_t prev;
+
+    asm volatile ("lock; cmpxchgl %2, %1"
+                  : "=a" (prev), "+m" (*p)
+                  : "r" (new), "0" (old)
+                  : "memory");
+    return prev;
+}
+
+/* Atomically add v to *p */
+static void atomic_add(volatile int32_t* p, int32_t v)
+{
+    asm volatile ("lock; addl %1, %0" : "+m" (*p) : "r" (v) : "memory");
+}
+
+/* Mutex states: 0 unlocked, 1 locked, 2 locked and someone may be asleep.
+ * Only a contended lock or an unlock with sleepers enters the kernel. */
+void ece391_mutex_init(ece391_mutex_t* m)
+{
+    m->state = 0;
+}
+
+void ece391_mutex_lock(ece391_mutex_t* m)
+{
+    int32_t c;
+
+    if (0 == (c = atomic_cmpxchg (&m->state, 0, 1)))
+        return;
+    if (2 != c)
+        c = atomic_xchg (&m->state, 2);
+    while (0 != c) {
+        ece391_futex ((uint32_t*)&m->state, FUTEX_WAIT, 2);
+        c = atomic_xchg (&m->state, 2);
+    }
+}
+
+void ece391_mutex_unlock(ece391_mutex_t* m)
+{
+    if (2 == atomic_xchg (&m->state, 0))
+        ece391_futex ((uint32_t*)&m->state, FUTEX_WAKE, 1);
+}
+
+/* Waiters sleep on seq, which every signal bumps so a signal between
+ * unlocking the mutex and sleeping is not lost. */
+void ece391_cond_init(ece391_cond_t* c)
+{
+    c->seq = 0;
+}
+
+void ece391_cond_wait(ece391_cond_t* c, ece391_mutex_t* m)
+{
+    int32_t seq = c->seq;
+
+    ece391_mutex_unlock (m);
+    ece391_futex ((uint32_t*)&c->seq, FUTEX_WAIT, seq);
+    /* Others may be asleep on the mutex, so take it as contended */
+    while (0 != atomic_xchg (&m->state, 2))
+        ece391_futex ((uint32_t*)&m->state, FUTEX_WAIT, 2);
+}
+
+void ece391_cond_signal(ece391_cond_t* c)
+{
+    atomic_add (&c->seq, 1);
+    ece391_futex ((uint32_t*)&c->seq, FUTEX_WAKE, 1);
+}
+
+void ece391_cond_broadcast(ece391_cond_t* c)
+{
+    atomic_add (&c->seq, 1);
+    ece391_futex ((uint32_t*)&c->seq, FUTEX_WAKE, 0x7FFFFFFF);
+}
+
+void ece391_barrier_init(ece391_barrier_t* b, int32_t count)
+{
+    ece391_mutex_init (&b->lock);
+    ece391_cond_init (&b->cond);
+    b->count = count;
+    b->waiting = 0;
+    b->phase = 0;
+}
+
+/* Returns 1 in the last thread to arrive and 0 in the others */
+int32_t ece391_barrier_wait(ece391_barrier_t* b)
+{
+    int32_t phase;
+
+    ece391_mutex_lock (&b->lock);
+    phase = b->phase;
+    if (++b->waiting == b->count) {
+        b->waiting = 0;
+        b->phase++;
+        ece391_cond_broadcast (&b->cond);
+        ece391_mutex_unlock (&b->lock);
+        return 1;
+    }
+    while (phase == b->phase)
+        ece391_cond_wait (&b->cond, &b->lock);
+    ece391_mutex_unlock (&b->lock);
+    return 0;
+}
@@ -10,5 +10,51 @@ extern uint8_t *ece391_itoa(uint32_t value, uint8_t* buf, int32_t radix);
 extern uint8_t *ece391_strrev(uint8_t* s);
 extern int32_t printf(int8_t *format, ...);
 
+/* Locks for threads and for programs sharing memory through shm. They stay
+ * in user space unless there is contention, and then sleep in ece391_futex. */
+typedef struct ece391_mutex {
+    volatile int32_t state;
+} ece391_mutex_t;
+
+typedef struct ece391_cond {
+    volatile int32_t seq;
+} ece391_cond_t;
+
+typedef struct ece391_barrier {
+    ece391_mutex_t lock;
+    ece391_cond_t cond;
+    int32_t count;
+    int32_t waiting;
+    volatile int32_t phase;
+} ece391_barrier_t;
+
+extern void ece391_mutex_init(ece391_mutex_t* m);
+extern void ece391_mutex_lock(ece391_mutex_t* m);
+extern void ece391_mutex_unlock(ece391_mutex_t* m);
+extern void ece391_cond_init(ece391_cond_t* c);
+extern void ece391_cond_wait(ece391_cond_t* c, ece391_mutex_t* m);
+extern void ece391_cond_signal(ece391_cond_t* c);
+extern void ece391_cond_broadcast(ece391_cond_t* c);
+extern void ece391_barrier_init(ece391_barrier_t* b, int32_t count);
+extern int32_t ece391_barrier_wait(ece391_barrier_t* b);
+
+/* Every thread starts with its own TLS block, found through %gs. Threads
+ * that want a bigger one can build it anywhere and pass it to
+ * ece391_set_tls, as long as it starts with this layout. */
+#define ECE391_TLS_SIZE 256
+
+typedef struct ece391_tls {
+    /* Points to this block */
+    struct ece391_tls* self;
+    /* Result of the last system call that failed in this thread */
+    int32_t err;
+    /* Free for the thread's own use, no locking needed */
+    uint8_t scratch[ECE391_TLS_SIZE - 8];
+} ece391_tls_t;
+
+extern ece391_tls_t* ece391_tls(void);
+
+#define ece391_errno (ece391_tls()->err)
+
 #endif /* ECE391SUPPORT_H */
 
@@ -3,6 +3,25 @@
 
 #include <stdint.h>
 
+/* One file for ece391_poll, with the events wanted and the events that happened. */
+typedef struct pollfd {
+    int32_t fd;
+    uint16_t events;
+    uint16_t revents;
+} pollfd_t;
+
+#define POLLIN 0x1
+#define POLLOUT 0x4
+#define POLLNVAL 0x20
+
+/* One buffer for ece391_readv and ece391_writev. */
+typedef struct iovec {
+    void *base;
+    uint32_t len;
+} iovec_t;
+
+#define IOV_MAX 16
+
 /* All calls return >= 0 on success or -1 on failure. */
 
 /*  
@@ -27,6 +46,114 @@ extern int32_t ece391_thread_create(uint32_t *tid, void (*thread_start)());
 extern int32_t ece391_thread_join(uint32_t tid);
 extern int32_t ece391_stat(int32_t fd, void *buf, int32_t nbytes);
 extern int32_t ece391_time();
+extern int32_t ece391_getdents(int32_t fd, void *buf, int32_t nbytes);
+extern int32_t ece391_sendfile(int32_t out_fd, int32_t in_fd, int32_t count);
+extern int32_t ece391_ioctl(int32_t fd, uint32_t request, uint32_t arg);
+extern int32_t ece391_poll(pollfd_t *fds, uint32_t nfds, int32_t timeout);
+extern int32_t ece391_uring_setup(uint8_t **ring);
+extern int32_t ece391_uring_enter(uint32_t to_submit);
+extern int32_t ece391_lseek(int32_t fd, int32_t offset, int32_t whence);
+extern int32_t ece391_pread(int32_t fd, void *buf, int32_t nbytes, uint32_t offset);
+extern int32_t ece391_pwrite(int32_t fd, const void *buf, int32_t nbytes, uint32_t offset);
+extern int32_t ece391_readv(int32_t fd, const iovec_t *iov, int32_t iovcnt);
+extern int32_t ece391_writev(int32_t fd, const iovec_t *iov, int32_t iovcnt);
+extern int32_t ece391_pipe(int32_t fds[2]);
+/* Like ece391_execute, with in_fd and out_fd moved to the new program as
+ * its stdin and stdout. Pass -1 to keep the terminal. Both are closed in
+ * the caller afterwards, even if the command could not be run. */
+extern int32_t ece391_execute_fds(const uint8_t* command, int32_t in_fd, int32_t out_fd);
+/* Shared memory segments, found by name. A segment is mapped at the same
+ * address in every program and lives until the last one unmaps it or
+ * halts. ece391_shm_map returns the segment's size. */
+extern int32_t ece391_shm_create(const uint8_t* name, uint32_t size, uint8_t** addr);
+extern int32_t ece391_shm_map(const uint8_t* name, uint8_t** addr);
+extern int32_t ece391_shm_unmap(const uint8_t* name);
+/* FUTEX_WAIT sleeps while *addr == val, FUTEX_WAKE wakes up to val sleepers. */
+extern int32_t ece391_futex(uint32_t* addr, int32_t op, int32_t val);
+extern int32_t ece391_set_tls(void* base);
+extern int32_t ece391_sigprocmask(int32_t how, uint32_t set, uint32_t* oldset);
+extern int32_t ece391_sigqueue(uint32_t task, int32_t signum, int32_t value);
+extern int32_t ece391_spawn(const uint8_t* command);
+extern int32_t ece391_waitpid(int32_t pid, uint32_t* status, int32_t flags);
+
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+
+/* Filled in by ece391_stat. */
+typedef struct fstat {
+    uint8_t type;
+    uint32_t size;
+} fstat_t;
+
+/* Type reported by ece391_stat for either end of a pipe. */
+#define STAT_TYPE_PIPE 7
+
+/* Values for whence in ece391_lseek. */
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
+
+/* Requests every file accepts through ece391_ioctl. */
+#define IOCTL_GETFL 1
+#define IOCTL_SETFL 2
+/* Throws away the keys waiting on /dev/kbd. */
+#define KBD_FLUSH 0x100
+
+/* File modes for IOCTL_SETFL. */
+#define O_NONBLOCK 0x1
+#define O_RAW 0x2
+
+/* One key press or release returned by /dev/kbd in O_RAW mode. */
+typedef struct kbd_event {
+    uint16_t scancode;
+    uint16_t key;
+    uint32_t time;
+} kbd_event_t;
+
+/* Submission and completion rings shared with the kernel by
+ * ece391_uring_setup. Queue an operation by filling sqes[sq_tail % 32] and
+ * then incrementing sq_tail. ece391_uring_enter runs queued operations and
+ * posts a cqe for each, which is consumed by incrementing cq_head. */
+#define URING_SQ_ENTRIES 32
+#define URING_CQ_ENTRIES 64
+
+#define URING_OP_NOP 0
+#define URING_OP_READ 1
+#define URING_OP_WRITE 2
+#define URING_OP_OPEN 3
+#define URING_OP_CLOSE 4
+#define URING_OP_STAT 5
+
+typedef struct uring_sqe {
+    uint32_t opcode;
+    int32_t fd;
+    uint32_t addr;
+    uint32_t len;
+    uint32_t user_data;
+} uring_sqe_t;
+
+typedef struct uring_cqe {
+    uint32_t user_data;
+    int32_t res;
+} uring_cqe_t;
+
+typedef struct uring {
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    uint32_t reserved[4];
+    uring_sqe_t sqes[URING_SQ_ENTRIES];
+    uring_cqe_t cqes[URING_CQ_ENTRIES];
+} uring_t;
+
+/* One record filled in by ece391_getdents. */
+typedef struct dirent {
+    uint8_t name[32];
+    uint32_t type;
+    uint32_t inode;
+    uint32_t size;
+} dirent_t;
 
 enum signums {
 	DIV_ZERO = 0,
@@ -34,9 +161,26 @@ enum signums {
 	INTERRUPT,
 	ALARM,
 	USER1,
+	RT0,
+	RT1,
+	RT2,
+	RT3,
 	NUM_SIGNALS
 };
 
+/* Signals from RT_MIN up are queued, and each one sent with ece391_sigqueue
+ * reaches the handler with its value: void handler(int32_t signum, int32_t value) */
+#define RT_MIN RT0
+#define SIGMASK(signum) (1 << (signum))
+
+/* Flags for ece391_waitpid */
+#define WNOHANG 0x1
+
+/* How for ece391_sigprocmask */
+#define SIG_BLOCK 0
+#define SIG_UNBLOCK 1
+#define SIG_SETMASK 2
+
 enum kbd_layout {
     QWERTY = 0,
     DVORAK,
@@ -293,13 +293,67 @@ int err_vidmap(void) {
  }
 
 
+static volatile int trampoline_ran;
+
+/* trampoline_handler
+ * USER1 handler for err_trampoline, returns through the trampoline page
+ */
+void trampoline_handler(int signum, int value) {
+	trampoline_ran++;
+}
+
+/* trampoline_thread
+ * thread for err_trampoline, returns through the trampoline page
+ */
+void trampoline_thread(void) {
+	trampoline_ran++;
+}
+
+/* TEST 9 err_trampoline
+ * returns from a signal handler and from a thread in an exec'd program,
+ * both of which go through the trampoline page
+ * prints "[TEST_NAME]: PASS" if behavior is EXPECTED
+ *     and then returns 0
+ * prints "[TEST_NAME]: FAIL" if behavior is UNEXPECTED
+ *     and then returns 2
+ */
+int err_trampoline(void)
+{
+	int fail = 0;
+	uint32_t tid;
+
+	trampoline_ran = 0;
+	ece391_set_handler(USER1, trampoline_handler);
+	if (0 != ece391_sigqueue(0, USER1, 0) || trampoline_ran != 1) {
+		ece391_fdputs (1, (uint8_t*)"signal handler return fail\n");
+		fail = 2;
+	}
+	ece391_set_handler(USER1, 0);
+
+	trampoline_ran = 0;
+	if (0 != ece391_thread_create(&tid, trampoline_thread) ||
+		0 != ece391_thread_join(tid) || trampoline_ran != 1) {
+		ece391_fdputs (1, (uint8_t*)"thread return fail\n");
+		fail = 2;
+	}
+
+	if (fail) {
+		ece391_fdputs (1, (uint8_t*)"err_trampoline: FAIL\n");
+	} else {
+		ece391_fdputs (1, (uint8_t*)"err_trampoline: PASS\n");
+	}
+
+	return fail;
+}
+
+
 int main ()
 {
 	int32_t cnt, select;
     uint8_t buf[128];
 	int fail = 0;
 
-    ece391_fdputs (1, (uint8_t*)"Choose from tests 1-8. 0 to run all: ");
+    ece391_fdputs (1, (uint8_t*)"Choose from tests 1-9. 0 to run all: ");
     if (-1 == (cnt = ece391_read (0, buf, 127))) {
         ece391_fdputs (1, (uint8_t*)"Can't read test #\n");
 		return 2;
@@ -316,6 +370,7 @@ int main ()
 			fail += err_vidmap();
 			fail += err_stdin_out();
 			fail += err_syscall_num();
+			fail += err_trampoline();
 			if(fail) {
 				ece391_fdputs (1, (uint8_t*)"\nOverall Tests: FAIL\n");
 			} else {
@@ -338,8 +393,10 @@ int main ()
 			return err_stdin_out();
 		case 8:
 			return err_syscall_num();
+		case 9:
+			return err_trampoline();
 		default:
-			ece391_fdputs (1, (uint8_t*)"Invalid test number. Choose from tests 1-8 or 0");
+			ece391_fdputs (1, (uint8_t*)"Invalid test number. Choose from tests 1-9 or 0");
 			break;
 	}
     return 0;
@@ -17,5 +17,27 @@
 #define SYS_THREAD_JOIN 14
 #define SYS_STAT 15
 #define SYS_TIME 16
+#define SYS_GETDENTS 17
+#define SYS_SENDFILE 18
+#define SYS_IOCTL 19
+#define SYS_POLL 20
+#define SYS_URING_SETUP 21
+#define SYS_URING_ENTER 22
+#define SYS_LSEEK 23
+#define SYS_PREAD 24
+#define SYS_PWRITE 25
+#define SYS_READV 26
+#define SYS_WRITEV 27
+#define SYS_PIPE 28
+#define SYS_EXECUTE_FDS 29
+#define SYS_SHM_CREATE 30
+#define SYS_SHM_MAP 31
+#define SYS_SHM_UNMAP 32
+#define SYS_FUTEX 33
+#define SYS_SET_TLS 34
+#define SYS_SIGPROCMASK 35
+#define SYS_SIGQUEUE 36
+#define SYS_SPAWN 37
+#define SYS_WAITPID 38
 
 #endif /* ECE391SYSNUM_H */